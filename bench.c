@@ -0,0 +1,492 @@
+/*
+Benchmark suite runner for the PM/0 virtual machine
+
+Compiles every PL/0 kernel in the suite directory (lex ->
+parsercodegen_complete) and times it on each VM mode with --replay, so the
+runs are untraced and their outputs and instruction count are checked
+against the "expect" lines in the kernel's header comment. Reports
+instructions per second and ns per instruction for each kernel and mode,
+and compares them against a stored baseline.
+
+Language: C (only)
+
+To Compile:
+    gcc -O2 -std=c11 -o bench bench.c
+    (lex, parsercodegen_complete and vm must be built first)
+
+To Execute:
+    ./bench [--bin dir] [--suite dir] [--mode name,...] [--repeat N]
+            [--baseline file] [--save] [--threshold pct] [--list] [kernel ...]
+where:
+    --bin        directory holding lex, parsercodegen_complete and vm (default .)
+    --suite      directory of *.pl0 kernels (default bench)
+    --mode       only run the named VM modes (see --list)
+    --repeat     runs per kernel and mode, the fastest one counts (default 5)
+    --baseline   baseline file (default <suite>/baseline.txt)
+    --save       write this run's results to the baseline file
+    --threshold  slowdown in ns/instruction, in percent, that counts as a
+                 regression (default 5)
+    --list       print the modes and kernels and exit
+    kernel       only run the named kernels (file name without .pl0)
+Notes:
+    - a kernel's header comment lists what it must produce, one per line:
+      "expect o <value>" for each SYS output in order, then
+      "expect n <instructions>" for the executed instruction count
+    - times are the VM's own execute-phase measurement (load and compile
+      are not included)
+    - baseline lines are "<kernel> <mode> <ns/instruction>"; kernels and
+      modes missing from it are reported without a comparison
+    - exit status is 1 if a kernel fails to build, gives wrong results or
+      regresses past the threshold, 0 otherwise
+    - vm-memo runs with the elf.memo the compiler writes (vm --memo); the
+      instructions its cache hits skip still count, so its ns/instruction
+      against vm's is the speedup
+    - vm-lift runs the kernel compiled with --lift (lift.txt), which
+      executes the same instructions with fewer static link walks
+    - new VM modes are added as rows of the modes table
+*/
+
+#define _GNU_SOURCE // fork, mkdtemp and realpath under -std=c11
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define MAX_KERNELS 128
+#define MAX_EXPECT 256   // expected outputs per kernel
+#define MAX_BASELINE 1024
+#define MAX_ARGS 32
+#define PATH_LEN 4096
+#define NAME_LEN 64
+
+// a way of running the VM
+typedef struct mode {
+    const char *name;
+    const char *vm_flags;
+    const char *program; // the compiled kernel it runs, in the kernel's directory
+} mode;
+
+mode modes[] = {
+    {"vm",      "",                "elf.txt"},
+    {"vm-tos",  "--tos",           "elf.txt"},
+    {"vm-memo", "--memo elf.memo", "elf.txt"},
+    {"vm-lift", "",                "lift.txt"},
+};
+const int num_modes = sizeof modes / sizeof modes[0];
+
+typedef struct baseline_entry {
+    char kernel[NAME_LEN];
+    char mode[NAME_LEN];
+    double ns;
+} baseline_entry;
+
+baseline_entry baseline[MAX_BASELINE];
+int baseline_count = 0;
+int enabled[sizeof modes / sizeof modes[0]];
+
+char lex_path[PATH_LEN], compiler_path[PATH_LEN], vm_path[PATH_LEN];
+char work_dir[] = "/tmp/bench.XXXXXX";
+int timeout_seconds = 60;
+
+
+// runs argv inside dir with stdout/stderr redirected to files (NULL = /dev/null).
+// returns the exit code, or -(signal) when the process was killed
+int run_command(char *const argv[], const char *dir, const char *out_path, const char *err_path)
+{
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        return -SIGABRT;
+    }
+    if (pid == 0)
+    {
+        if (chdir(dir) != 0) _exit(127);
+        int in = open("/dev/null", O_RDONLY);
+        int out = open(out_path ? out_path : "/dev/null", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int err = open(err_path ? err_path : "/dev/null", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (in < 0 || out < 0 || err < 0) _exit(127);
+        dup2(in, 0);
+        dup2(out, 1);
+        dup2(err, 2);
+        // runaway kernels are stopped by the CPU limit (SIGXCPU)
+        struct rlimit limit = {(rlim_t)timeout_seconds, (rlim_t)timeout_seconds + 1};
+        setrlimit(RLIMIT_CPU, &limit);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    int wstatus;
+    while (waitpid(pid, &wstatus, 0) < 0) ;
+    if (WIFSIGNALED(wstatus)) return -WTERMSIG(wstatus);
+    return WEXITSTATUS(wstatus);
+}
+
+// splits "a b c" into argv slots after the ones already in args, returns the new count
+int add_args(char **args, int count, char *flags)
+{
+    for (char *word = strtok(flags, " "); word && count < MAX_ARGS - 1; word = strtok(NULL, " "))
+    {
+        args[count++] = word;
+    }
+    args[count] = NULL;
+    return count;
+}
+
+int find_tool(char *dest, const char *dir, const char *name)
+{
+    char path[PATH_LEN];
+    snprintf(path, sizeof path, "%s/%s", dir, name);
+    if (!realpath(path, dest) || access(dest, X_OK) != 0)
+    {
+        fprintf(stderr, "ERROR: %s not found (build it or pass --bin)\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+int compare_names(const void *a, const void *b)
+{
+    return strcmp((const char *)a, (const char *)b);
+}
+
+// fills names with the kernels in suite (without .pl0), sorted; returns the count
+int list_kernels(const char *suite, char names[][NAME_LEN])
+{
+    DIR *dir = opendir(suite);
+    if (!dir)
+    {
+        perror(suite);
+        return -1;
+    }
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && count < MAX_KERNELS)
+    {
+        size_t len = strlen(entry->d_name);
+        if (len > 4 && len - 4 < NAME_LEN && strcmp(entry->d_name + len - 4, ".pl0") == 0)
+        {
+            memcpy(names[count], entry->d_name, len - 4);
+            names[count][len - 4] = '\0';
+            count++;
+        }
+    }
+    closedir(dir);
+    qsort(names, count, NAME_LEN, compare_names);
+    return count;
+}
+
+// writes the kernel's "expect" lines as a --replay log; returns 0 if it has none
+int write_replay_log(const char *source_path, const char *log_path)
+{
+    FILE *source = fopen(source_path, "r");
+    FILE *log = fopen(log_path, "w");
+    char line[512];
+    int expectations = 0;
+    if (!source || !log)
+    {
+        if (source) fclose(source);
+        if (log) fclose(log);
+        return 0;
+    }
+    while (fgets(line, sizeof line, source))
+    {
+        char kind;
+        long long value;
+        const char *text = strstr(line, "expect ");
+        if (text && sscanf(text, "expect %c %lld", &kind, &value) == 2 && (kind == 'o' || kind == 'n'))
+        {
+            fprintf(log, "%c %lld\n", kind, value);
+            expectations++;
+        }
+    }
+    fclose(source);
+    fclose(log);
+    return expectations > 0;
+}
+
+// reads the VM's "replay: ok, N instructions in T s" report
+int read_replay_report(const char *path, long long *instructions, double *seconds, char *verdict, size_t size)
+{
+    FILE *file = fopen(path, "r");
+    char line[512];
+    int found = 0;
+    if (!file) return 0;
+    snprintf(verdict, size, "no report");
+    while (fgets(line, sizeof line, file))
+    {
+        char result[32];
+        if (sscanf(line, "replay: %31[^,], %lld instructions in %lf s", result, instructions, seconds) == 3)
+        {
+            found = strcmp(result, "ok") == 0;
+        }
+        else if (strncmp(line, "replay: ", 8) == 0 || strncmp(line, "runtime error", 13) == 0)
+        {
+            // the first complaint explains a mismatch
+            if (strcmp(verdict, "no report") == 0)
+            {
+                line[strcspn(line, "\n")] = '\0';
+                snprintf(verdict, size, "%s", line);
+            }
+        }
+    }
+    fclose(file);
+    return found;
+}
+
+int load_baseline(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    char line[512];
+    if (!file) return 0;
+    while (fgets(line, sizeof line, file) && baseline_count < MAX_BASELINE)
+    {
+        baseline_entry *entry = &baseline[baseline_count];
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%63s %63s %lf", entry->kernel, entry->mode, &entry->ns) == 3) baseline_count++;
+    }
+    fclose(file);
+    return 1;
+}
+
+// ns/instruction recorded for kernel in mode, or -1
+double baseline_ns(const char *kernel, const char *mode_name)
+{
+    for (int i = 0; i < baseline_count; i++)
+    {
+        if (strcmp(baseline[i].kernel, kernel) == 0 && strcmp(baseline[i].mode, mode_name) == 0) return baseline[i].ns;
+    }
+    return -1;
+}
+
+// whether the compiler left a program in dir's elf.txt rather than an error
+int kernel_compiled(const char *dir)
+{
+    char path[PATH_LEN + 32];
+    snprintf(path, sizeof path, "%s/elf.txt", dir);
+    FILE *file = fopen(path, "r");
+    if (!file) return 0;
+    int first = fgetc(file);
+    fclose(file);
+    return first != 'E' && first != EOF; // "Error: ..." from the compiler
+}
+
+// compiles kernel into its own directory; returns 0 (after reporting) on failure
+int build_kernel(const char *suite, const char *kernel, char *dir)
+{
+    char source_path[PATH_LEN], path[PATH_LEN + 32];
+    char *args[MAX_ARGS];
+
+    snprintf(dir, PATH_LEN, "%s/%s", work_dir, kernel);
+    mkdir(dir, 0755);
+    snprintf(source_path, sizeof source_path, "%s/%s.pl0", suite, kernel);
+    snprintf(path, sizeof path, "%s/expect.log", dir);
+    if (!write_replay_log(source_path, path))
+    {
+        printf("%-12s no \"expect\" lines in %s\n", kernel, source_path);
+        return 0;
+    }
+    char *source = realpath(source_path, NULL);
+    if (!source)
+    {
+        perror(source_path);
+        return 0;
+    }
+    args[0] = lex_path;
+    args[1] = source;
+    args[2] = NULL;
+    int failed = run_command(args, dir, NULL, NULL) != 0;
+    free(source);
+    args[0] = compiler_path;
+    args[1] = "--lift"; // lift.txt for the vm-lift mode; the compiler always writes elf.txt
+    args[2] = NULL;
+    if (!failed) failed = run_command(args, dir, NULL, NULL) != 0 || !kernel_compiled(dir);
+    char lift_path[PATH_LEN + 32];
+    snprintf(path, sizeof path, "%s/elf.txt", dir);
+    snprintf(lift_path, sizeof lift_path, "%s/lift.txt", dir);
+    if (!failed) failed = rename(path, lift_path) != 0;
+    args[1] = "--memo"; // elf.memo for the vm-memo mode
+    if (!failed) failed = run_command(args, dir, NULL, NULL) != 0 || !kernel_compiled(dir);
+    if (failed)
+    {
+        printf("%-12s does not compile\n", kernel);
+        return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *bin_dir = ".";
+    const char *suite = "bench";
+    const char *baseline_path = NULL;
+    char default_baseline[PATH_LEN + 16];
+    char *only_modes = NULL;
+    const char *selected[MAX_KERNELS];
+    int selected_count = 0;
+    int repeat = 5, save = 0, list = 0;
+    double threshold = 5.0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bin") == 0 && i + 1 < argc) bin_dir = argv[++i];
+        else if (strcmp(argv[i], "--suite") == 0 && i + 1 < argc) suite = argv[++i];
+        else if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) only_modes = argv[++i];
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) repeat = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) baseline_path = argv[++i];
+        else if (strcmp(argv[i], "--save") == 0) save = 1;
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) threshold = atof(argv[++i]);
+        else if (strcmp(argv[i], "--list") == 0) list = 1;
+        else if (argv[i][0] != '-' && selected_count < MAX_KERNELS) selected[selected_count++] = argv[i];
+        else
+        {
+            fprintf(stderr, "Usage: %s [--bin dir] [--suite dir] [--mode name,...] [--repeat N] "
+                            "[--baseline file] [--save] [--threshold pct] [--list] [kernel ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (repeat < 1) repeat = 1;
+    if (!baseline_path)
+    {
+        snprintf(default_baseline, sizeof default_baseline, "%s/baseline.txt", suite);
+        baseline_path = default_baseline;
+    }
+
+    static char kernels[MAX_KERNELS][NAME_LEN];
+    int kernel_count = list_kernels(suite, kernels);
+    if (kernel_count < 0) return 1;
+    if (list)
+    {
+        for (int m = 0; m < num_modes; m++) printf("mode   %-8s vm %s\n", modes[m].name, modes[m].vm_flags);
+        for (int k = 0; k < kernel_count; k++) printf("kernel %s\n", kernels[k]);
+        return 0;
+    }
+    for (int m = 0; m < num_modes; m++) enabled[m] = only_modes == NULL;
+    for (char *name = only_modes ? strtok(only_modes, ",") : NULL; name; name = strtok(NULL, ","))
+    {
+        int found = 0;
+        for (int m = 0; m < num_modes; m++)
+        {
+            if (strcmp(modes[m].name, name) == 0) enabled[m] = found = 1;
+        }
+        if (!found)
+        {
+            fprintf(stderr, "ERROR: unknown mode %s (see --list)\n", name);
+            return 1;
+        }
+    }
+    for (int s = 0; s < selected_count; s++)
+    {
+        int found = 0;
+        for (int k = 0; k < kernel_count; k++) found |= strcmp(kernels[k], selected[s]) == 0;
+        if (!found)
+        {
+            fprintf(stderr, "ERROR: no kernel %s in %s (see --list)\n", selected[s], suite);
+            return 1;
+        }
+    }
+    if (!find_tool(lex_path, bin_dir, "lex") || !find_tool(compiler_path, bin_dir, "parsercodegen_complete")
+        || !find_tool(vm_path, bin_dir, "vm")) return 1;
+    int have_baseline = load_baseline(baseline_path);
+    FILE *save_file = NULL;
+    if (save)
+    {
+        save_file = fopen(baseline_path, "w");
+        if (!save_file)
+        {
+            perror(baseline_path);
+            return 1;
+        }
+        fprintf(save_file, "# kernel mode ns/instruction (written by bench --save)\n");
+    }
+    if (!mkdtemp(work_dir))
+    {
+        perror("error w/ work directory");
+        return 1;
+    }
+
+    printf("%-12s %-8s %12s %9s %10s %9s %8s\n", "kernel", "mode", "instructions", "ns/instr", "Minstr/s",
+           "baseline", "change");
+    int failures = 0, regressions = 0;
+    for (int k = 0; k < kernel_count; k++)
+    {
+        int wanted = selected_count == 0;
+        for (int s = 0; s < selected_count; s++) wanted |= strcmp(kernels[k], selected[s]) == 0;
+        if (!wanted) continue;
+
+        char dir[PATH_LEN];
+        if (!build_kernel(suite, kernels[k], dir))
+        {
+            failures++;
+            continue;
+        }
+        for (int m = 0; m < num_modes; m++)
+        {
+            if (!enabled[m]) continue;
+            char flags[256], err_path[PATH_LEN + 32], verdict[512];
+            char *args[MAX_ARGS];
+            long long instructions = 0;
+            double best = -1;
+            int ok = 1;
+            snprintf(err_path, sizeof err_path, "%s/replay.err", dir);
+            for (int r = 0; r < repeat && ok; r++)
+            {
+                int n = 0;
+                double seconds = 0;
+                args[n++] = vm_path;
+                snprintf(flags, sizeof flags, "%s", modes[m].vm_flags);
+                n = add_args(args, n, flags);
+                args[n++] = "--replay";
+                args[n++] = "expect.log";
+                args[n++] = (char *)modes[m].program;
+                args[n] = NULL;
+                int code = run_command(args, dir, NULL, err_path);
+                ok = read_replay_report(err_path, &instructions, &seconds, verdict, sizeof verdict) && code == 0;
+                if (ok && (best < 0 || seconds < best)) best = seconds;
+            }
+            if (!ok)
+            {
+                printf("%-12s %-8s FAILED: %s\n", kernels[k], modes[m].name, verdict);
+                failures++;
+                continue;
+            }
+
+            double ns = instructions > 0 ? best * 1e9 / instructions : 0.0;
+            double rate = best > 0 ? instructions / best / 1e6 : 0.0;
+            double base = baseline_ns(kernels[k], modes[m].name);
+            printf("%-12s %-8s %12lld %9.3f %10.1f", kernels[k], modes[m].name, instructions, ns, rate);
+            if (base > 0)
+            {
+                double change = (ns - base) / base * 100.0;
+                int regressed = change > threshold;
+                regressions += regressed;
+                printf(" %9.3f %+7.1f%%%s\n", base, change, regressed ? "  REGRESSION" : "");
+            }
+            else
+            {
+                printf(" %9s %8s\n", "-", "-");
+            }
+            if (save_file) fprintf(save_file, "%s %s %.4f\n", kernels[k], modes[m].name, ns);
+        }
+    }
+
+    if (save_file)
+    {
+        fclose(save_file);
+        printf("\nbaseline written to %s\n", baseline_path);
+    }
+    else if (!have_baseline)
+    {
+        printf("\nno baseline at %s (run with --save to record one)\n", baseline_path);
+    }
+    if (regressions) printf("\n%d result(s) more than %.1f%% slower than the baseline\n", regressions, threshold);
+
+    char *cleanup[] = {"rm", "-rf", work_dir, NULL};
+    run_command(cleanup, "/", NULL, NULL);
+    return failures || regressions ? 1 : 0;
+}
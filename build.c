@@ -0,0 +1,387 @@
+/*
+Parallel build driver for multi-unit PL/0 programs
+
+Compiles each source (a program or a module) to an object with
+lex -> parsercodegen_complete --object, running up to --jobs compiles at
+once, then links the objects into elf.txt. A unit is only recompiled when
+its source changed since the last build, and the link only runs when some
+object was rebuilt or the output is not the one the last link wrote from
+these objects.
+
+Language: C (only)
+
+To Compile:
+    gcc -O2 -std=c11 -o build build.c
+    (lex, parsercodegen_complete and linker must be built first)
+
+To Execute:
+    ./build [--bin dir] [--jobs N] [--dir path] [-o elf.txt] source ...
+where:
+    --bin   directory holding lex, parsercodegen_complete and linker (default .)
+    --jobs  compiles to run at the same time (default: online CPUs)
+    --dir   build directory for the objects (default .pm0build)
+    -o      linked output (default elf.txt)
+    source  PL/0 sources, exactly one of them a program
+Notes:
+    - each source <name>.* is compiled in <dir>/<name>.d, since lex and
+      the compiler work on tokens.txt in the current directory; the object
+      is <dir>/<name>.o and the compiler's listing is <dir>/<name>.d/listing.txt
+    - <dir>/<name>.hash holds the FNV-1a hash of the source the object was
+      built from; a source with the same hash is not recompiled
+    - <dir>/link.hash holds the hash of what the last link read (the output
+      path, and the object paths and contents in order) and of the output
+      it wrote; the link is skipped only when both still match, so a
+      changed unit list or an output overwritten since (for example by
+      parsercodegen_complete's own elf.txt) is relinked
+    - compile errors are printed with the unit's name and leave no object,
+      so the unit is rebuilt next time
+    - exit status is 1 if a unit fails to compile or the link fails
+*/
+
+#define _GNU_SOURCE // fork, realpath and sysconf under -std=c11
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define MAX_UNITS 64
+#define MAX_ARGS 80
+#define PATH_LEN 4096
+#define NAME_LEN 64
+
+typedef struct unit {
+    char source[PATH_LEN];  // absolute path of the source
+    char name[NAME_LEN];    // file name without directory and extension
+    char work[PATH_LEN];    // <dir>/<name>.d
+    char object[PATH_LEN];  // <dir>/<name>.o
+    char stamp[PATH_LEN];   // <dir>/<name>.hash
+    unsigned long long hash;
+    pid_t pid;              // running compile, 0 if none
+} unit;
+
+unit units[MAX_UNITS];
+int unit_count = 0;
+char lex_path[PATH_LEN], compiler_path[PATH_LEN], linker_path[PATH_LEN];
+
+
+int find_tool(char *dest, const char *dir, const char *name)
+{
+    char path[PATH_LEN];
+    snprintf(path, sizeof path, "%s/%s", dir, name);
+    if (!realpath(path, dest) || access(dest, X_OK) != 0)
+    {
+        fprintf(stderr, "ERROR: %s not found (build it or pass --bin)\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+// continues a 64-bit FNV-1a hash over size bytes
+unsigned long long hash_bytes(unsigned long long hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// 64-bit FNV-1a of a file's contents; 0 if it cannot be read
+unsigned long long hash_file(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return 0;
+    unsigned long long hash = FNV_OFFSET;
+    int c;
+    while ((c = getc(fp)) != EOF)
+    {
+        unsigned char byte = (unsigned char)c;
+        hash = hash_bytes(hash, &byte, 1);
+    }
+    fclose(fp);
+    return hash;
+}
+
+// what the link reads: the output path and, in link order, each object's
+// path and contents
+unsigned long long link_inputs_hash(const char *output_path)
+{
+    unsigned long long hash = hash_bytes(FNV_OFFSET, output_path, strlen(output_path) + 1);
+    for (int i = 0; i < unit_count; i++)
+    {
+        unsigned long long object = hash_file(units[i].object);
+        hash = hash_bytes(hash, units[i].object, strlen(units[i].object) + 1);
+        hash = hash_bytes(hash, &object, sizeof object);
+    }
+    return hash;
+}
+
+// the output is up to date when the link stamp names these inputs and the
+// output is still the file that link wrote: another build, or the compiler
+// writing its own elf.txt, changes one or the other
+int link_up_to_date(const char *link_stamp, unsigned long long inputs, const char *output_path)
+{
+    FILE *fp = fopen(link_stamp, "r");
+    unsigned long long stored_inputs = 0, stored_output = 0;
+    int ok = fp && fscanf(fp, "%llx %llx", &stored_inputs, &stored_output) == 2 && stored_inputs == inputs &&
+             stored_output == hash_file(output_path) && stored_output != 0;
+    if (fp) fclose(fp);
+    return ok;
+}
+
+// a unit is up to date when its object exists and was built from this source
+int up_to_date(unit *u)
+{
+    FILE *fp = fopen(u->stamp, "r");
+    unsigned long long stored = 0;
+    int ok = fp && fscanf(fp, "%llx", &stored) == 1 && stored == u->hash && access(u->object, R_OK) == 0;
+    if (fp) fclose(fp);
+    return ok;
+}
+
+// the child of a compile job: lex then parsercodegen_complete --object
+// in the unit's work directory, with their output in listing.txt
+void compile_unit(unit *u)
+{
+    if (chdir(u->work) != 0) _exit(127);
+    int in = open("/dev/null", O_RDONLY);
+    int out = open("listing.txt", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (in < 0 || out < 0) _exit(127);
+    dup2(in, 0);
+    dup2(out, 1);
+    dup2(out, 2);
+    pid_t lex = fork();
+    if (lex == 0)
+    {
+        execl(lex_path, lex_path, u->source, (char *)NULL);
+        _exit(127);
+    }
+    int wstatus;
+    if (lex < 0 || waitpid(lex, &wstatus, 0) < 0 || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) _exit(1);
+    execl(compiler_path, compiler_path, "--object", u->object, (char *)NULL);
+    _exit(127);
+}
+
+// an object starts with "pm0-object"; on a compile error the compiler
+// writes the message there instead
+int object_ok(unit *u, char *message, size_t size)
+{
+    FILE *fp = fopen(u->object, "r");
+    message[0] = '\0';
+    if (!fp)
+    {
+        snprintf(message, size, "no object written");
+        return 0;
+    }
+    int ok = fgets(message, (int)size, fp) && strcmp(message, "pm0-object 1\n") == 0;
+    fclose(fp);
+    message[strcspn(message, "\n")] = '\0';
+    return ok;
+}
+
+// records a finished compile; returns 0 if it failed
+int finish_unit(unit *u, int wstatus)
+{
+    char message[512];
+    u->pid = 0;
+    if (WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0 && object_ok(u, message, sizeof message))
+    {
+        FILE *fp = fopen(u->stamp, "w");
+        if (fp)
+        {
+            fprintf(fp, "%llx\n", u->hash);
+            fclose(fp);
+        }
+        printf("compiled %s\n", u->name);
+        return 1;
+    }
+    if (message[0]) fprintf(stderr, "ERROR: %s: %s\n", u->name, message);
+    else fprintf(stderr, "ERROR: %s: compiler failed (see %s/listing.txt)\n", u->name, u->work);
+    remove(u->object);
+    remove(u->stamp);
+    return 0;
+}
+
+// the value of --jobs: a whole number from 1 to MAX_UNITS (more could not
+// run at once). returns 0 for anything else
+long parse_jobs(const char *word)
+{
+    char *end;
+    long value = strtol(word, &end, 10);
+    if (end == word || *end != '\0' || value < 1 || value > MAX_UNITS) return 0;
+    return value;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *bin_dir = ".", *build_dir = ".pm0build", *output_path = "elf.txt";
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bin") == 0 && i + 1 < argc) bin_dir = argv[++i];
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+        {
+            jobs = parse_jobs(argv[++i]);
+            if (!jobs)
+            {
+                fprintf(stderr, "ERROR: --jobs needs a whole number from 1 to %d, not \"%s\"\n", MAX_UNITS, argv[i]);
+                fprintf(stderr, "Usage: %s [--bin dir] [--jobs N] [--dir path] [-o elf.txt] source ...\n", argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) build_dir = argv[++i];
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) output_path = argv[++i];
+        else if (argv[i][0] != '-' && unit_count < MAX_UNITS)
+        {
+            unit *u = &units[unit_count++];
+            if (!realpath(argv[i], u->source))
+            {
+                perror(argv[i]);
+                return 1;
+            }
+            const char *base = strrchr(u->source, '/') + 1;
+            size_t len = strcspn(base, ".");
+            if (len >= NAME_LEN) len = NAME_LEN - 1;
+            memcpy(u->name, base, len);
+            u->name[len] = '\0';
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--bin dir] [--jobs N] [--dir path] [-o elf.txt] source ...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (unit_count == 0)
+    {
+        fprintf(stderr, "Usage: %s [--bin dir] [--jobs N] [--dir path] [-o elf.txt] source ...\n", argv[0]);
+        return 1;
+    }
+    if (jobs < 1) jobs = 1;
+    if (!find_tool(lex_path, bin_dir, "lex") || !find_tool(compiler_path, bin_dir, "parsercodegen_complete") ||
+        !find_tool(linker_path, bin_dir, "linker"))
+    {
+        return 1;
+    }
+    mkdir(build_dir, 0755);
+    char dir[PATH_LEN];
+    if (!realpath(build_dir, dir))
+    {
+        perror(build_dir);
+        return 1;
+    }
+
+    for (int i = 0; i < unit_count; i++)
+    {
+        unit *u = &units[i];
+        for (int j = 0; j < i; j++)
+        {
+            if (strcmp(units[j].name, u->name) == 0)
+            {
+                fprintf(stderr, "ERROR: %s and %s would share the object %s.o\n", units[j].source, u->source, u->name);
+                return 1;
+            }
+        }
+        if (snprintf(u->work, sizeof u->work, "%s/%s.d", dir, u->name) >= (int)sizeof u->work ||
+            snprintf(u->object, sizeof u->object, "%s/%s.o", dir, u->name) >= (int)sizeof u->object ||
+            snprintf(u->stamp, sizeof u->stamp, "%s/%s.hash", dir, u->name) >= (int)sizeof u->stamp)
+        {
+            fprintf(stderr, "ERROR: the build files of %s would have paths longer than %d bytes\n", u->source, PATH_LEN - 1);
+            return 1;
+        }
+        mkdir(u->work, 0755);
+        u->hash = hash_file(u->source);
+    }
+
+    // start a compile whenever fewer than jobs are running, and wait for
+    // whichever finishes first
+    int running = 0, failed = 0, compiled = 0, next = 0;
+    while (next < unit_count || running > 0)
+    {
+        if (next < unit_count && running < jobs)
+        {
+            unit *u = &units[next++];
+            if (up_to_date(u)) continue;
+            fflush(stdout);
+            u->pid = fork();
+            if (u->pid == 0) compile_unit(u);
+            if (u->pid < 0)
+            {
+                perror("fork");
+                u->pid = 0;
+                failed++;
+                continue;
+            }
+            running++;
+            continue;
+        }
+        int wstatus;
+        pid_t pid = waitpid(-1, &wstatus, 0);
+        if (pid < 0) break;
+        for (int i = 0; i < unit_count; i++)
+        {
+            if (units[i].pid == pid)
+            {
+                running--;
+                if (finish_unit(&units[i], wstatus)) compiled++;
+                else failed++;
+            }
+        }
+    }
+    if (failed)
+    {
+        fprintf(stderr, "build: %d of %d units failed to compile\n", failed, unit_count);
+        return 1;
+    }
+
+    char link_stamp[PATH_LEN];
+    if (snprintf(link_stamp, sizeof link_stamp, "%s/link.hash", dir) >= (int)sizeof link_stamp)
+    {
+        fprintf(stderr, "ERROR: the link stamp of %s would have a path longer than %d bytes\n", dir, PATH_LEN - 1);
+        return 1;
+    }
+    unsigned long long link_inputs = link_inputs_hash(output_path);
+    if (compiled == 0 && link_up_to_date(link_stamp, link_inputs, output_path))
+    {
+        printf("build: %d units up to date, %s not relinked\n", unit_count, output_path);
+        return 0;
+    }
+    remove(link_stamp); // until this link succeeds
+    char *args[MAX_ARGS];
+    int count = 0;
+    args[count++] = linker_path;
+    args[count++] = "-o";
+    args[count++] = (char *)output_path;
+    for (int i = 0; i < unit_count && count < MAX_ARGS - 1; i++) args[count++] = units[i].object;
+    args[count] = NULL;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        execv(linker_path, args);
+        _exit(127);
+    }
+    int wstatus;
+    if (pid < 0 || waitpid(pid, &wstatus, 0) < 0 || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0)
+    {
+        fprintf(stderr, "build: link failed\n");
+        remove(output_path); // so the next build links again
+        return 1;
+    }
+    FILE *fp = fopen(link_stamp, "w");
+    if (fp)
+    {
+        fprintf(fp, "%llx %llx\n", link_inputs, hash_file(output_path));
+        fclose(fp);
+    }
+    printf("build: compiled %d of %d units, linked %s\n", compiled, unit_count, output_path);
+    return 0;
+}
@@ -0,0 +1,936 @@
+/*
+Differential testing harness for the PL/0 toolchain
+
+Runs PL/0 programs (hand-written files and/or randomly generated ones)
+with a set of input vectors through every compile/execute configuration
+and compares each configuration against the reference pipeline
+(lex -> parsercodegen_complete -> vm). Any program that shows a mismatch
+is minimized line by line and written out as a small reproducer.
+
+Language: C (only)
+
+To Compile:
+    gcc -O2 -std=c11 -o difftest difftest.c
+    (lex, parsercodegen_complete and vm must be built first)
+
+To Execute:
+    ./difftest [--bin dir] [--generate N] [--seed S] [--input "v1 v2 ..."]...
+               [--config name,...] [--timeout sec] [--out dir] [--list]
+               [program.pl0 ...]
+where:
+    --bin       directory holding lex, parsercodegen_complete and vm (default .)
+    --generate  also test N generated programs (seeds S, S+1, ...)
+    --input     one input vector (repeatable, replaces the default vectors)
+    --config    only run the named configurations (ref always runs)
+    --timeout   CPU seconds allowed per tool run (default 10)
+    --out       directory for minimized reproducers (default difftest-out)
+    --list      print the configurations and exit
+Notes:
+    - compared per run: SYS output values, halt status (halt / runtime
+      error / timeout / crash), executed instruction count and the final
+      traced machine state, for the observations each configuration has.
+      The count of a program with a COB is not compared under --threads,
+      where it depends on how the tasks interleave
+    - relative speed is the reference's total execution time divided by
+      the configuration's (compile time is not included)
+    - exit status is 0 when every run matched, 1 otherwise
+    - new execution modes are added as rows of the configs table
+*/
+
+#define _GNU_SOURCE // fork, mkdtemp and realpath under -std=c11
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define MAX_INPUTS 32    // input vectors per run
+#define MAX_OUTPUTS 256  // SYS outputs kept per run
+#define MAX_LINES 4096   // source lines handled by the minimizer
+#define MAX_STATE 4096   // final trace line kept per run
+#define MAX_ARGS 32
+#define PATH_LEN 4096
+
+// what a configuration can be compared on
+#define CMP_STATUS 1  // halt / error / timeout / crash
+#define CMP_OUTPUT 2  // SYS 0 1 values
+#define CMP_COUNT 4   // executed instructions (halted runs only)
+#define CMP_STATE 8   // last trace line (halted runs only)
+#define CMP_ALL (CMP_STATUS | CMP_OUTPUT | CMP_COUNT | CMP_STATE)
+
+// how the compiled program is executed
+enum runner {
+    RUN_VM,           // vm <flags> --record log elf.txt
+    RUN_REPLAY,       // vm <flags> --replay <reference log> elf.txt, untraced
+    RUN_NATIVE,       // parsercodegen_complete --native, untraced
+    RUN_NATIVE_TRACE, // --emit-c built with -DPM0_TRACE
+    RUN_BATCH         // vm <flags> --batch: the input first, then every input vector
+};
+
+// run results
+enum run_status {
+    STATUS_HALT = 0,
+    STATUS_ERROR,     // runtime error or failed read
+    STATUS_TIMEOUT,   // killed after --timeout CPU seconds
+    STATUS_CRASH,     // any other signal
+    STATUS_NO_BUILD   // compiler or C compiler failed
+};
+const char *status_names[] = {"halt", "error", "timeout", "crash", "no build"};
+
+typedef struct config {
+    const char *name;
+    const char *compile_flags; // extra parsercodegen_complete flags
+    int runner;
+    const char *vm_flags;      // extra vm flags
+    int compare;               // CMP_* observations that must match ref
+    int halted_only;           // only meaningful when ref halts
+} config;
+
+// the first row is the reference every other row is checked against
+config configs[] = {
+    {"ref",          "",                  RUN_VM,           "",            CMP_ALL,                  0},
+    {"vm-threads4",  "",                  RUN_VM,           "--threads 4", CMP_ALL,                  0},
+    {"vm-replay",    "",                  RUN_REPLAY,       "",            CMP_ALL,                  0},
+    {"vm-tos",       "",                  RUN_VM,           "--tos --no-trace", CMP_STATUS | CMP_OUTPUT | CMP_COUNT, 0},
+    {"vm-tos-replay", "",                 RUN_REPLAY,       "--tos",       CMP_ALL,                  0},
+    {"vm-limits",    "",                  RUN_VM,           "--max-instructions 1000000000000 --timeout 3600", CMP_ALL, 0},
+    {"no-bounds",    "--no-bounds-check", RUN_VM,           "",            CMP_STATUS | CMP_OUTPUT,  1},
+    {"dce",          "--dce",             RUN_VM,           "",            CMP_STATUS | CMP_OUTPUT | CMP_COUNT, 0},
+    {"const-fold",   "--const-fold",      RUN_VM,           "",            CMP_STATUS | CMP_OUTPUT,  0},
+    {"lift",         "--lift",            RUN_VM,           "",            CMP_STATUS | CMP_OUTPUT | CMP_COUNT, 0},
+    {"precompute",   "--precompute",      RUN_VM,           "",            CMP_STATUS | CMP_OUTPUT,  0},
+    {"native-trace", "",                  RUN_NATIVE_TRACE, "",            CMP_ALL,                  0},
+    {"native",       "",                  RUN_NATIVE,       "",            CMP_STATUS | CMP_OUTPUT,  0},
+    {"vm-batch",     "",                  RUN_BATCH,        "",            CMP_STATUS | CMP_OUTPUT,  0},
+    {"vm-memo",      "--memo",            RUN_VM,           "--memo elf.memo", CMP_ALL,              0},
+};
+const int num_configs = sizeof configs / sizeof configs[0];
+
+// what one run of one configuration produced
+typedef struct observation {
+    int status;
+    int outputs[MAX_OUTPUTS];
+    int output_count;
+    long long count;          // -1 when the configuration cannot tell
+    char state[MAX_STATE];    // "" when untraced
+    double seconds;           // execution only
+    int uses_cob;             // the compiled program has a COB
+} observation;
+
+// per-configuration totals for the report
+typedef struct config_totals {
+    int runs, mismatches, skipped;
+    double seconds;
+} config_totals;
+
+config_totals totals[sizeof configs / sizeof configs[0]];
+int enabled[sizeof configs / sizeof configs[0]];
+
+char lex_path[PATH_LEN], compiler_path[PATH_LEN], vm_path[PATH_LEN];
+char work_dir[] = "/tmp/difftest.XXXXXX";
+const char *out_dir = "difftest-out";
+int timeout_seconds = 10;
+const char *inputs[MAX_INPUTS];
+int input_count = 0;
+int reproducers = 0;
+
+
+double seconds_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// runs argv inside dir with stdin/stdout redirected to files (NULL = /dev/null).
+// returns the exit code, or -(signal) when the process was killed
+int run_command(char *const argv[], const char *dir, const char *in_path, const char *out_path, double *seconds)
+{
+    double start = seconds_now();
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        return -SIGABRT;
+    }
+    if (pid == 0)
+    {
+        if (chdir(dir) != 0) _exit(127);
+        int in = open(in_path ? in_path : "/dev/null", O_RDONLY);
+        int out = open(out_path ? out_path : "/dev/null", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int err = open("/dev/null", O_WRONLY);
+        if (in < 0 || out < 0 || err < 0) _exit(127);
+        dup2(in, 0);
+        dup2(out, 1);
+        dup2(err, 2);
+        // runaway programs are stopped by the CPU limit (SIGXCPU)
+        struct rlimit limit = {(rlim_t)timeout_seconds, (rlim_t)timeout_seconds + 1};
+        setrlimit(RLIMIT_CPU, &limit);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    int wstatus;
+    while (waitpid(pid, &wstatus, 0) < 0) ;
+    if (seconds) *seconds = seconds_now() - start;
+    if (WIFSIGNALED(wstatus)) return -WTERMSIG(wstatus);
+    return WEXITSTATUS(wstatus);
+}
+
+// splits "a b c" into argv slots after the ones already in args, returns the new count
+int add_args(char **args, int count, char *flags)
+{
+    for (char *word = strtok(flags, " "); word && count < MAX_ARGS - 1; word = strtok(NULL, " "))
+    {
+        args[count++] = word;
+    }
+    args[count] = NULL;
+    return count;
+}
+
+// reads "Output result is: n" lines, counts trace lines and keeps the last one
+void parse_output(const char *path, observation *obs, int traced)
+{
+    FILE *file = fopen(path, "r");
+    char *line = NULL;
+    size_t line_cap = 0;
+    long long trace_lines = 0;
+    if (!file) return;
+    while (getline(&line, &line_cap, file) > 0)
+    {
+        char *text = line;
+        // prompts are printed without a newline, so they prefix the next line
+        while (strncmp(text, "Please Enter an Integer: ", 25) == 0) text += 25;
+        text[strcspn(text, "\n")] = '\0';
+        int value;
+        if (sscanf(text, "Output result is: %d", &value) == 1)
+        {
+            if (obs->output_count < MAX_OUTPUTS) obs->outputs[obs->output_count++] = value;
+        }
+        else if (traced && *text && strncmp(text, "Initial values:", 15) != 0)
+        {
+            trace_lines++;
+            snprintf(obs->state, sizeof obs->state, "%s", text);
+        }
+    }
+    free(line);
+    fclose(file);
+    if (traced && obs->count < 0) obs->count = trace_lines;
+}
+
+// reads the first line of vm --batch output: "ok <outputs>..." or
+// "error <reason>: <outputs>..."
+void parse_batch_output(const char *path, observation *obs)
+{
+    FILE *file = fopen(path, "r");
+    char word[32];
+    if (!file) return;
+    if (fscanf(file, "%31s", word) == 1 && (strcmp(word, "ok") == 0 || strcmp(word, "error") == 0))
+    {
+        obs->status = strcmp(word, "ok") == 0 ? STATUS_HALT : STATUS_ERROR;
+        if (obs->status == STATUS_ERROR) fscanf(file, "%*[^:\n]:"); // skip the reason
+        int value;
+        while (fscanf(file, "%*[ ]%d", &value) == 1)
+        {
+            if (obs->output_count < MAX_OUTPUTS) obs->outputs[obs->output_count++] = value;
+        }
+    }
+    fclose(file);
+}
+
+// reads the instruction count from a --record log
+long long record_count(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    char kind;
+    long long value, count = -1;
+    if (!file) return -1;
+    while (fscanf(file, " %c %lld", &kind, &value) == 2)
+    {
+        if (kind == 'n') count = value;
+    }
+    fclose(file);
+    return count;
+}
+
+// 1 if the elf.txt at path has a COB (op 10) instruction
+int elf_uses_cob(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    int op, l, m, found = 0;
+    if (!file) return 0;
+    while (!found && fscanf(file, "%d %d %d", &op, &l, &m) == 3) found = op == 10;
+    fclose(file);
+    return found;
+}
+
+int status_of(int code)
+{
+    if (code == -SIGXCPU || code == -SIGKILL) return STATUS_TIMEOUT;
+    if (code < 0) return STATUS_CRASH;
+    return code == 0 ? STATUS_HALT : STATUS_ERROR;
+}
+
+// compiles source for configuration c in its own directory and runs it on input.
+// ref_log is the reference run's --record log (for RUN_REPLAY)
+void run_config(int c, const char *source, const char *input, const char *ref_log, observation *obs)
+{
+    config *cfg = &configs[c];
+    char dir[PATH_LEN], path[PATH_LEN + 32], flags[256];
+    char *args[MAX_ARGS];
+    memset(obs, 0, sizeof *obs);
+    obs->count = -1;
+    obs->status = STATUS_NO_BUILD;
+
+    snprintf(dir, sizeof dir, "%s/%s", work_dir, cfg->name);
+    mkdir(dir, 0755);
+    snprintf(path, sizeof path, "%s/prog.pl0", dir);
+    FILE *file = fopen(path, "w");
+    if (!file) return;
+    fputs(source, file);
+    fclose(file);
+
+    // lex -> parsercodegen_complete (-> cc)
+    args[0] = lex_path;
+    args[1] = "prog.pl0";
+    args[2] = NULL;
+    if (run_command(args, dir, NULL, NULL, NULL) != 0) return;
+    int n = 0;
+    args[n++] = compiler_path;
+    snprintf(flags, sizeof flags, "%s", cfg->compile_flags);
+    n = add_args(args, n, flags);
+    if (cfg->runner == RUN_NATIVE) { args[n++] = "--native"; args[n++] = "prog"; }
+    if (cfg->runner == RUN_NATIVE_TRACE) { args[n++] = "--emit-c"; args[n++] = "prog.c"; }
+    args[n] = NULL;
+    if (run_command(args, dir, NULL, NULL, NULL) != 0) return;
+    snprintf(path, sizeof path, "%s/elf.txt", dir);
+    file = fopen(path, "r");
+    if (!file) return;
+    int first = fgetc(file);
+    fclose(file);
+    if (first == 'E' || first == EOF) return; // "Error: ..." from the compiler
+    obs->uses_cob = elf_uses_cob(path);
+
+    if (cfg->runner == RUN_NATIVE_TRACE)
+    {
+        const char *cc = getenv("CC");
+        args[0] = (char *)((cc && *cc) ? cc : "cc");
+        args[1] = "-O2";
+        args[2] = "-DPM0_TRACE";
+        args[3] = "-o";
+        args[4] = "prog";
+        args[5] = "prog.c";
+        args[6] = NULL;
+        if (run_command(args, dir, NULL, NULL, NULL) != 0) return;
+    }
+
+    // execute
+    char in_path[PATH_LEN + 32], out_path[PATH_LEN + 32], log_path[PATH_LEN + 32];
+    snprintf(in_path, sizeof in_path, "%s/input.txt", dir);
+    snprintf(out_path, sizeof out_path, "%s/output.txt", dir);
+    snprintf(log_path, sizeof log_path, "%s/run.log", dir);
+    file = fopen(in_path, "w");
+    if (!file) return;
+    fprintf(file, "%s\n", input);
+    // the other vectors run in lanes beside it, so the lanes branch apart
+    for (int i = 0; cfg->runner == RUN_BATCH && i < input_count; i++) fprintf(file, "%s\n", inputs[i]);
+    fclose(file);
+
+    n = 0;
+    if (cfg->runner == RUN_BATCH)
+    {
+        args[n++] = vm_path;
+        snprintf(flags, sizeof flags, "%s", cfg->vm_flags);
+        n = add_args(args, n, flags);
+        args[n++] = "--batch";
+        args[n++] = in_path;
+        args[n++] = "elf.txt";
+    }
+    else if (cfg->runner == RUN_VM || cfg->runner == RUN_REPLAY)
+    {
+        args[n++] = vm_path;
+        snprintf(flags, sizeof flags, "%s", cfg->vm_flags);
+        n = add_args(args, n, flags);
+        args[n++] = (cfg->runner == RUN_VM) ? "--record" : "--replay";
+        args[n++] = (cfg->runner == RUN_VM) ? log_path : (char *)ref_log;
+        args[n++] = "elf.txt";
+    }
+    else
+    {
+        args[n++] = "./prog";
+    }
+    args[n] = NULL;
+    int code = run_command(args, dir, in_path, out_path, &obs->seconds);
+    obs->status = status_of(code);
+
+    if (cfg->runner == RUN_REPLAY)
+    {
+        // the VM itself checks outputs and count against the reference log;
+        // exit 2 means it found a difference
+        if (code == 2) obs->status = STATUS_CRASH;
+        return;
+    }
+    if (cfg->runner == RUN_BATCH)
+    {
+        parse_batch_output(out_path, obs);
+        return;
+    }
+    if (cfg->runner == RUN_VM) obs->count = record_count(log_path);
+    parse_output(out_path, obs, cfg->runner != RUN_NATIVE);
+}
+
+// describes the first difference between ref and obs in buffer, returns 1 if any
+int differs(const observation *ref, const observation *obs, int c, char *buffer, size_t size)
+{
+    int compare = configs[c].compare;
+    if (configs[c].runner == RUN_REPLAY)
+    {
+        // the log holds the reference's exit status, so an error or limit
+        // is replayed and checked like a halt
+        if (obs->status != ref->status)
+        {
+            snprintf(buffer, size, "replay run ended with %s, ref %s", obs->status == STATUS_CRASH ? "a mismatch" : status_names[obs->status],
+                     status_names[ref->status]);
+            return 1;
+        }
+        return 0;
+    }
+    if ((compare & CMP_STATUS) && ref->status != obs->status)
+    {
+        snprintf(buffer, size, "status %s, ref %s", status_names[obs->status], status_names[ref->status]);
+        return 1;
+    }
+    if (compare & CMP_OUTPUT)
+    {
+        int count = ref->output_count < obs->output_count ? ref->output_count : obs->output_count;
+        for (int i = 0; i < count; i++)
+        {
+            if (ref->outputs[i] != obs->outputs[i])
+            {
+                snprintf(buffer, size, "output %d is %d, ref %d", i + 1, obs->outputs[i], ref->outputs[i]);
+                return 1;
+            }
+        }
+        if (ref->output_count != obs->output_count)
+        {
+            snprintf(buffer, size, "%d outputs, ref %d", obs->output_count, ref->output_count);
+            return 1;
+        }
+    }
+    if (ref->status != STATUS_HALT) return 0;
+    // COB tasks on several threads interleave differently from run to run,
+    // so a task that waits for another runs as many instructions as the wait takes
+    if (obs->uses_cob && strstr(configs[c].vm_flags, "--threads")) compare &= ~CMP_COUNT;
+    if ((compare & CMP_COUNT) && ref->count >= 0 && obs->count >= 0 && ref->count != obs->count)
+    {
+        snprintf(buffer, size, "%lld instructions, ref %lld", obs->count, ref->count);
+        return 1;
+    }
+    if ((compare & CMP_STATE) && *ref->state && *obs->state && strcmp(ref->state, obs->state) != 0)
+    {
+        snprintf(buffer, size, "final state \"%s\", ref \"%s\"", obs->state, ref->state);
+        return 1;
+    }
+    return 0;
+}
+
+// runs ref and configuration c; 1 if the ref compiles and c disagrees with it
+int still_fails(const char *source, const char *input, int c)
+{
+    observation ref, obs;
+    char ref_log[PATH_LEN + 32], reason[MAX_STATE + 64];
+    run_config(0, source, input, NULL, &ref);
+    if (ref.status == STATUS_NO_BUILD || ref.status == STATUS_TIMEOUT) return 0;
+    if (configs[c].halted_only && ref.status != STATUS_HALT) return 0;
+    snprintf(ref_log, sizeof ref_log, "%s/%s/run.log", work_dir, configs[0].name);
+    run_config(c, source, input, ref_log, &obs);
+    return differs(&ref, &obs, c, reason, sizeof reason);
+}
+
+// joins the kept lines into one source string (caller frees)
+char *join_lines(char **lines, const int *keep, int line_count)
+{
+    size_t size = 1;
+    for (int i = 0; i < line_count; i++) size += strlen(lines[i]) + 1;
+    char *text = malloc(size), *cursor = text;
+    if (!text)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < line_count; i++)
+    {
+        if (keep && !keep[i]) continue;
+        size_t len = strlen(lines[i]);
+        memcpy(cursor, lines[i], len);
+        cursor[len] = '\n';
+        cursor += len + 1;
+    }
+    *cursor = '\0';
+    return text;
+}
+
+// delta debugging (ddmin) over source lines: drops chunks of lines as long as
+// the program still compiles under ref and configuration c still disagrees
+void minimize(char *source, const char *input, int c, const char *label, const char *reason)
+{
+    char *lines[MAX_LINES];
+    int keep[MAX_LINES], trial[MAX_LINES];
+    int line_count = 0;
+    for (char *line = strtok(source, "\n"); line && line_count < MAX_LINES; line = strtok(NULL, "\n"))
+    {
+        lines[line_count] = line;
+        keep[line_count++] = 1;
+    }
+
+    int chunks = 2;
+    int remaining = line_count;
+    while (remaining >= 2)
+    {
+        int reduced = 0;
+        int chunk_size = (remaining + chunks - 1) / chunks;
+        for (int start = 0; start < remaining && !reduced; start += chunk_size)
+        {
+            // try the complement of the kept lines [start, start + chunk_size)
+            int position = 0;
+            for (int i = 0; i < line_count; i++)
+            {
+                trial[i] = keep[i];
+                if (!keep[i]) continue;
+                if (position >= start && position < start + chunk_size) trial[i] = 0;
+                position++;
+            }
+            char *candidate = join_lines(lines, trial, line_count);
+            if (still_fails(candidate, input, c))
+            {
+                memcpy(keep, trial, sizeof(int) * line_count);
+                remaining -= (remaining - start < chunk_size) ? remaining - start : chunk_size;
+                chunks = chunks > 2 ? chunks - 1 : 2;
+                reduced = 1;
+            }
+            free(candidate);
+        }
+        if (reduced) continue;
+        if (chunks >= remaining) break;
+        chunks = chunks * 2 < remaining ? chunks * 2 : remaining;
+    }
+
+    char path[PATH_LEN];
+    mkdir(out_dir, 0755);
+    snprintf(path, sizeof path, "%s/mismatch-%d.pl0", out_dir, ++reproducers);
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        perror("error w/ reproducer");
+        return;
+    }
+    fprintf(file, "/* difftest: %s, config %s, input \"%s\": %s */\n", label, configs[c].name, input, reason);
+    for (int i = 0; i < line_count; i++)
+    {
+        if (keep[i]) fprintf(file, "%s\n", lines[i]);
+    }
+    fclose(file);
+    printf("    minimized to %d of %d lines: %s\n", remaining, line_count, path);
+}
+
+// tests one program under every input vector and enabled configuration.
+// returns the number of mismatching runs
+int test_program(const char *source, const char *label)
+{
+    int failures = 0;
+    for (int v = 0; v < input_count; v++)
+    {
+        observation ref, obs;
+        char ref_log[PATH_LEN + 32], reason[MAX_STATE + 64];
+        run_config(0, source, inputs[v], NULL, &ref);
+        if (ref.status == STATUS_NO_BUILD)
+        {
+            printf("%s: does not compile, skipped\n", label);
+            return failures;
+        }
+        totals[0].runs++;
+        totals[0].seconds += ref.seconds;
+        snprintf(ref_log, sizeof ref_log, "%s/%s/run.log", work_dir, configs[0].name);
+
+        for (int c = 1; c < num_configs; c++)
+        {
+            if (!enabled[c]) continue;
+            if (configs[c].halted_only && ref.status != STATUS_HALT)
+            {
+                totals[c].skipped++;
+                continue;
+            }
+            run_config(c, source, inputs[v], ref_log, &obs);
+            totals[c].runs++;
+            totals[c].seconds += obs.seconds;
+            if (!differs(&ref, &obs, c, reason, sizeof reason)) continue;
+
+            totals[c].mismatches++;
+            failures++;
+            printf("%s: MISMATCH %s, input \"%s\": %s\n", label, configs[c].name, inputs[v], reason);
+            char *copy = strdup(source);
+            if (copy)
+            {
+                minimize(copy, inputs[v], c, label, reason);
+                free(copy);
+            }
+            // the minimizer reused the work directories; restore the reference log
+            run_config(0, source, inputs[v], NULL, &ref);
+        }
+    }
+    if (!failures) printf("%s: ok\n", label);
+    return failures;
+}
+
+
+// random program generator. Programs are kept small enough for the 500-word
+// PAS, terminate (loop counters are never assigned in loop bodies and
+// procedures only call earlier ones) and keep values within +-96 after every
+// assignment so no configuration hits signed overflow. One statement per line
+// so the minimizer can drop them independently
+unsigned long long rng_state;
+
+unsigned rng(unsigned bound)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (unsigned)(rng_state % bound);
+}
+
+#define GEN_GLOBALS 4
+#define GEN_ARRAY 8
+#define GEN_PROCS 2
+
+typedef struct gen_scope {
+    int proc;        // -1 for main
+    int loop_depth;  // enclosing while loops (their counters may index the array)
+    int budget;      // statements left
+} gen_scope;
+
+// a variable the generator may read in the current scope
+void gen_atom(FILE *out, gen_scope *scope)
+{
+    int pick = rng(6);
+    if (pick == 0) fprintf(out, "%u", rng(20));
+    else if (pick == 1) fprintf(out, "k%u", rng(2));
+    else if (pick == 2 && scope->proc >= 0) fprintf(out, "t%u", rng(2));
+    else if (pick == 3 && scope->loop_depth > 0) fprintf(out, "%c%d", scope->proc >= 0 ? 'u' : 'i', rng(scope->loop_depth));
+    else if (pick == 4) fprintf(out, "a[%u]", rng(GEN_ARRAY));
+    else fprintf(out, "g%u", rng(GEN_GLOBALS));
+}
+
+// sum of up to three terms, each an atom, atom * atom or atom / digit
+void gen_expression(FILE *out, gen_scope *scope)
+{
+    int terms = 1 + rng(3);
+    for (int t = 0; t < terms; t++)
+    {
+        if (t) fprintf(out, " %c ", rng(2) ? '+' : '-');
+        gen_atom(out, scope);
+        int kind = rng(4);
+        if (kind == 0) { fprintf(out, " * "); gen_atom(out, scope); }
+        else if (kind == 1) fprintf(out, " / %u", 1 + rng(9));
+    }
+}
+
+void gen_condition(FILE *out, gen_scope *scope)
+{
+    static const char *relations[] = {"=", "<>", "<", "<=", ">", ">="};
+    if (rng(5) == 0)
+    {
+        fprintf(out, "odd ");
+        gen_expression(out, scope);
+        return;
+    }
+    gen_expression(out, scope);
+    fprintf(out, " %s ", relations[rng(6)]);
+    gen_expression(out, scope);
+}
+
+void gen_target(FILE *out, gen_scope *scope)
+{
+    if (scope->proc >= 0 && rng(2)) fprintf(out, "t%u", rng(2));
+    else if (rng(4) == 0 && scope->loop_depth > 0) fprintf(out, "a[%c%d]", scope->proc >= 0 ? 'u' : 'i', rng(scope->loop_depth));
+    else fprintf(out, "g%u", rng(GEN_GLOBALS));
+}
+
+void gen_statements(FILE *out, gen_scope *scope, int indent);
+
+// one statement line (or block of lines) ending with ";"
+void gen_statement(FILE *out, gen_scope *scope, int indent)
+{
+    scope->budget--;
+    int pick = rng(10);
+    if (pick <= 3)
+    {
+        // assignment, folded back into [-96, 96]
+        char target[16];
+        FILE *name = fmemopen(target, sizeof target, "w");
+        gen_target(name, scope);
+        fclose(name);
+        fprintf(out, "%*s%s := ", indent, "", target);
+        gen_expression(out, scope);
+        fprintf(out, "; %s := %s - %s / 97 * 97;\n", target, target, target);
+    }
+    else if (pick == 4)
+    {
+        fprintf(out, "%*swrite ", indent, "");
+        gen_expression(out, scope);
+        fprintf(out, ";\n");
+    }
+    else if (pick == 5 && scope->proc < 0)
+    {
+        int g = rng(GEN_GLOBALS);
+        fprintf(out, "%*sread g%d; g%d := g%d - g%d / 97 * 97;\n", indent, "", g, g, g, g);
+    }
+    else if (pick == 6 && scope->proc != 0)
+    {
+        // main may call any procedure, a procedure only earlier ones
+        int limit = scope->proc < 0 ? GEN_PROCS : scope->proc;
+        fprintf(out, "%*scall p%u;\n", indent, "", rng(limit));
+    }
+    else if (pick == 7 && scope->loop_depth < 2 && scope->budget > 2)
+    {
+        // counters run 0..n-1 with n <= GEN_ARRAY so they can index the array
+        char counter = scope->proc >= 0 ? 'u' : 'i';
+        int depth = scope->loop_depth;
+        fprintf(out, "%*s%c%d := 0;\n", indent, "", counter, depth);
+        fprintf(out, "%*swhile %c%d < %u do begin\n", indent, "", counter, depth, 1 + rng(GEN_ARRAY));
+        scope->loop_depth++;
+        gen_statements(out, scope, indent + 2);
+        scope->loop_depth--;
+        fprintf(out, "%*s%c%d := %c%d + 1\n", indent + 2, "", counter, depth, counter, depth);
+        fprintf(out, "%*send;\n", indent, "");
+    }
+    else if (pick == 8 && scope->budget > 2)
+    {
+        fprintf(out, "%*sif ", indent, "");
+        gen_condition(out, scope);
+        fprintf(out, " then begin\n");
+        gen_statements(out, scope, indent + 2);
+        fprintf(out, "%*sk0 := k0\n", indent + 2, "");
+        fprintf(out, "%*send else begin\n", indent, "");
+        gen_statements(out, scope, indent + 2);
+        fprintf(out, "%*sk0 := k0\n", indent + 2, "");
+        fprintf(out, "%*send fi;\n", indent, "");
+    }
+    else
+    {
+        fprintf(out, "%*swrite ", indent, "");
+        gen_atom(out, scope);
+        fprintf(out, ";\n");
+    }
+}
+
+void gen_statements(FILE *out, gen_scope *scope, int indent)
+{
+    int count = 1 + (rng(3) == 0);
+    for (int s = 0; s < count && scope->budget > 0; s++) gen_statement(out, scope, indent);
+}
+
+// writes program number seed into a malloc'd string
+char *generate_program(unsigned long long seed)
+{
+    char *text = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&text, &size);
+    if (!out)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    rng_state = seed * 0x9E3779B97F4A7C15ull + 1;
+
+    // k0 and k1 are plain variables used as constants (k0 := k0 pads blocks)
+    fprintf(out, "var g0, g1, g2, g3, k0, k1, i0, i1, a[%d];\n", GEN_ARRAY);
+    for (int p = 0; p < GEN_PROCS; p++)
+    {
+        gen_scope scope = {p, 0, 1 + rng(2)};
+        fprintf(out, "procedure p%d;\n", p);
+        fprintf(out, "  var t0, t1, u0, u1;\n");
+        fprintf(out, "begin\n");
+        fprintf(out, "  t0 := g%u;\n", rng(GEN_GLOBALS));
+        while (scope.budget > 0) gen_statement(out, &scope, 2);
+        fprintf(out, "  t0 := t0\n");
+        fprintf(out, "end;\n");
+    }
+    gen_scope scope = {-1, 0, 3 + rng(4)};
+    fprintf(out, "begin\n");
+    fprintf(out, "  k0 := %u; k1 := %u;\n", 1 + rng(9), rng(20));
+    while (scope.budget > 0) gen_statement(out, &scope, 2);
+    for (int g = 0; g < GEN_GLOBALS; g++) fprintf(out, "  write g%d;\n", g);
+    fprintf(out, "  k0 := k0\n");
+    fprintf(out, "end.\n");
+    fclose(out);
+    return text;
+}
+
+// the generator cannot see code size, so oversized programs are regenerated
+int fits_pas(const char *source)
+{
+    observation ref;
+    run_config(0, source, "0 0 0 0 0 0 0 0", NULL, &ref);
+    if (ref.status == STATUS_NO_BUILD) return 0;
+    char path[PATH_LEN + 32], line[256];
+    snprintf(path, sizeof path, "%s/%s/elf.txt", work_dir, configs[0].name);
+    FILE *file = fopen(path, "r");
+    int instructions = 0;
+    if (!file) return 0;
+    while (fgets(line, sizeof line, file)) instructions++;
+    fclose(file);
+    return instructions <= 140; // leaves about 80 words of stack
+}
+
+
+char *read_file(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (!file) return NULL;
+    char *text = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&text, &size);
+    int ch;
+    while ((ch = fgetc(file)) != EOF) fputc(ch, out);
+    fclose(out);
+    fclose(file);
+    return text;
+}
+
+int find_tool(char *dest, const char *dir, const char *name)
+{
+    char path[PATH_LEN];
+    snprintf(path, sizeof path, "%s/%s", dir, name);
+    if (!realpath(path, dest) || access(dest, X_OK) != 0)
+    {
+        fprintf(stderr, "ERROR: %s not found (build it or pass --bin)\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *bin_dir = ".";
+    int generate = 0;
+    unsigned long long seed = 1;
+    const char *files[256];
+    int file_count = 0;
+    char *only = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bin") == 0 && i + 1 < argc) bin_dir = argv[++i];
+        else if (strcmp(argv[i], "--generate") == 0 && i + 1 < argc) generate = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc && input_count < MAX_INPUTS) inputs[input_count++] = argv[++i];
+        else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) only = argv[++i];
+        else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) timeout_seconds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) out_dir = argv[++i];
+        else if (strcmp(argv[i], "--list") == 0)
+        {
+            for (int c = 0; c < num_configs; c++)
+            {
+                printf("%-14s compile: %-20s run: %s%s\n", configs[c].name,
+                       *configs[c].compile_flags ? configs[c].compile_flags : "-",
+                       configs[c].runner == RUN_VM ? "vm " : configs[c].runner == RUN_REPLAY ? "vm --replay " :
+                       configs[c].runner == RUN_BATCH ? "vm --batch " :
+                       configs[c].runner == RUN_NATIVE ? "native" : "native (traced)",
+                       configs[c].vm_flags);
+            }
+            return 0;
+        }
+        else if (argv[i][0] != '-' && file_count < 256) files[file_count++] = argv[i];
+        else
+        {
+            fprintf(stderr, "Usage: %s [--bin dir] [--generate N] [--seed S] [--input \"v ...\"]... "
+                            "[--config name,...] [--timeout sec] [--out dir] [--list] [program.pl0 ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (timeout_seconds < 1) timeout_seconds = 1;
+    if (file_count == 0 && generate == 0)
+    {
+        fprintf(stderr, "ERROR: give program files and/or --generate N\n");
+        return 1;
+    }
+    if (input_count == 0)
+    {
+        inputs[input_count++] = "7 12 3 5";
+        inputs[input_count++] = "0 -5 40 1";
+        inputs[input_count++] = "96 -96 2 9";
+    }
+    for (int c = 0; c < num_configs; c++)
+    {
+        enabled[c] = (only == NULL || c == 0);
+    }
+    for (char *name = only ? strtok(only, ",") : NULL; name; name = strtok(NULL, ","))
+    {
+        int found = 0;
+        for (int c = 0; c < num_configs; c++)
+        {
+            if (strcmp(configs[c].name, name) == 0) enabled[c] = found = 1;
+        }
+        if (!found)
+        {
+            fprintf(stderr, "ERROR: unknown configuration %s (see --list)\n", name);
+            return 1;
+        }
+    }
+    if (!find_tool(lex_path, bin_dir, "lex") || !find_tool(compiler_path, bin_dir, "parsercodegen_complete")
+        || !find_tool(vm_path, bin_dir, "vm")) return 1;
+    if (!mkdtemp(work_dir))
+    {
+        perror("error w/ work directory");
+        return 1;
+    }
+
+    int failures = 0;
+    for (int f = 0; f < file_count; f++)
+    {
+        char *source = read_file(files[f]);
+        if (!source)
+        {
+            fprintf(stderr, "ERROR: cannot read %s\n", files[f]);
+            failures++;
+            continue;
+        }
+        failures += test_program(source, files[f]);
+        free(source);
+    }
+    for (int g = 0; g < generate; g++)
+    {
+        char label[64];
+        char *source;
+        // regenerate with the next seed until the program fits
+        do
+        {
+            source = generate_program(seed);
+            snprintf(label, sizeof label, "generated seed %llu", seed);
+            seed++;
+            if (fits_pas(source)) break;
+            free(source);
+            source = NULL;
+        } while (1);
+        failures += test_program(source, label);
+        free(source);
+    }
+
+    // report
+    printf("\nconfig         runs  mismatches  skipped  exec_ms    speed_vs_ref\n");
+    for (int c = 0; c < num_configs; c++)
+    {
+        if (!enabled[c]) continue;
+        double speed = totals[c].seconds > 0 ? totals[0].seconds / totals[c].seconds : 0.0;
+        printf("%-14s %5d %11d %8d %9.2f %10.2fx\n", configs[c].name, totals[c].runs, totals[c].mismatches,
+               totals[c].skipped, totals[c].seconds * 1e3, speed);
+    }
+
+    char *cleanup[] = {"rm", "-rf", work_dir, NULL};
+    run_command(cleanup, "/", NULL, NULL, NULL);
+    return failures ? 1 : 0;
+}
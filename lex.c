@@ -9,21 +9,29 @@ Language: C (only)
 
 To Compile:
     Scanner:
-        gcc -O2 -std=c11 -o lex lex.c
+        gcc -O2 -std=c11 -pthread -o lex lex.c
     Parser/Code Generator:
-        gcc -O2 -std=c11 -o parsercodegen_complete parsercodegen_complete.c
+        gcc -O2 -std=c11 -pthread -o parsercodegen_complete parsercodegen_complete.c
     Virtual Machine:
-        gcc -O2 -std=c11 -o vm vm.c
+        gcc -O2 -std=c11 -pthread -o vm vm.c -lrt
+    Metrics viewer:
+        gcc -O2 -std=c11 -o vmstat vmstat.c -lrt
 
 To Execute (on Eustis):
-    ./lex <input_file.txt>
+    ./lex [--stats] [--debug] [--threads N | --scale N] <input_file.txt>
     ./parsercodegen_complete
-    ./vm elf.txt
+    ./vm [--threads N] [--debug elf.dbg] [--profile] elf.txt
 where:
     <input_file.txt> is the path to the PL/0 source program
 Notes:
     - lex.c accepts ONE command-line argument (input PL/0 source file)
-    - parsercodegen_complete.c accepts NO command-line arguments
+      (optional: --threads N lexes chunks of the file in parallel, at
+                 least 256 KiB each, and sequentially below 512 KiB,
+                 --scale N times 1..N threads against the sequential lexer,
+                 --debug also writes the line/column of each token to tokens.pos)
+    - the scanner core (lexRange) is in lexer.h, shared with
+      parsercodegen_complete --batch
+    - parsercodegen_complete.c reads tokens.txt and takes no file arguments
     - Input filename is hard-coded in parsercodegen_complete.c
     - Implements recursive-descent parser for extended PL/0 grammar
     - Supports procedures, call statements, and if-then-else
@@ -37,169 +45,253 @@ Instructor: Dr. Jie Lin
 
 Due Date: Friday, November 21, 2025 at 11:59 PM ET
 */
+#define _GNU_SOURCE // clock_gettime and perf_event_open for --stats
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-#define MAX_ID_LEN 11
-#define MAX_NUM_LEN 5
-#define MAX_SOURCE_SIZE 10000
-#define MAX_LEXEMES 500
+#include <pthread.h>
+#include "phase_stats.h"
+#include "lexer.h"
+#define MAX_THREADS 64
 FILE *fptr;
-typedef enum
-{
-skipsym = 1, identsym, numbersym, plussym, minussym,
-multsym, slashsym, eqlsym, neqsym,
-lessym, leqsym, gtrsym, geqsym, lparentsym,
-rparentsym, commasym, semicolonsym, periodsym, becomessym,
-beginsym, endsym, ifsym, fisym, thensym, whilesym,
-dosym, callsym, constsym, varsym, procsym,
-writesym, readsym, elsesym, evensym
-} token_type;
+// spelling of fixed symbols and reserved words for the lexeme table
+const char *spelling[] =
+{
+[plussym] = "+", [minussym] = "-", [multsym] = "*", [slashsym] = "/",
+[eqlsym] = "=", [neqsym] = "<>", [lessym] = "<", [leqsym] = "<=",
+[gtrsym] = ">", [geqsym] = ">=", [lparentsym] = "(", [rparentsym] = ")",
+[commasym] = ",", [semicolonsym] = ";", [periodsym] = ".", [becomessym] = ":=",
+[beginsym] = "begin", [endsym] = "end", [ifsym] = "if", [fisym] = "fi",
+[thensym] = "then", [whilesym] = "while", [dosym] = "do", [callsym] = "call",
+[constsym] = "const", [varsym] = "var", [procsym] = "procedure",
+[writesym] = "write", [readsym] = "read", [elsesym] = "else", [evensym] = "odd",
+[cobeginsym] = "cobegin", [coendsym] = "coend",
+[lbracketsym] = "[", [rbracketsym] = "]", [returnsym] = "return",
+[modulesym] = "module", [externsym] = "extern"
+};
+char *source = NULL; // whole input file, null-terminated
+int sourceLength = 0;
+tokenStream tokens; // tokens of the whole source
+void error(tokenStream *ts, const int msg, const char *context)
+{
+ts->table = growArray(ts->table, &ts->cap, ts->count + 1, sizeof(lexeme));
+// keep the context text (for errors only)
+ts->table[ts->count].token = msg;
+ts->table[ts->count].value = intern(ts, context, boundedLength(context));
+ts->table[ts->count].offset = ts->tokenStart;
+ts->count++;
+}
+// text of a table entry for printing
+const char *lexemeText(const tokenStream *ts, const lexeme *entry, char *numBuffer)
+{
+if (entry->token <= 0 || entry->token == identsym || entry->token == skipsym)
+return nameText(ts, entry->value);
+if (entry->token == numbersym)
+{
+sprintf(numBuffer, "%d", entry->value);
+return numBuffer;
+}
+return spelling[entry->token];
+}
+void lexer(const char *input)
+{
+lexRange(&tokens, input, 0, (int)strlen(input), 0);
+}
+// parallel lexing: the source is cut into chunks that start right after a
+// whitespace character, so no identifier, number or two-character symbol
+// spans a boundary. Only /* */ comments can, and comment state is a simple
+// character-level automaton, so each chunk first computes its end state for
+// both possible start states; a sequential pass then fixes the real start
+// state of every chunk before the chunks are lexed in parallel
 typedef struct
 {
-char lexeme[MAX_ID_LEN + 1];
-int token;
-int value;
-} lexeme;
-const char *reserved[] =
+const char *input;
+int begin, end;
+int endState[2]; // comment state at end for start state 0 / 1
+int inComment;   // resolved start state
+tokenStream out;
+int *remap;      // chunk name id -> merged name id
+int offset;      // first merged table slot
+lexeme *dest;
+} lexChunk;
+int commentStateAfter(const char *input, int begin, int end, int inComment)
 {
-"const","var","procedure","call","begin","end","if","fi","then",
-"else","while","do","read","write","odd"
-};
-const int reservedTokens[] =
+int i = begin;
+while (i < end)
 {
-constsym, varsym, procsym, callsym, beginsym, endsym,
-ifsym, fisym, thensym, elsesym, whilesym, dosym,
-readsym, writesym, evensym
-};
-const int numReserved = 15;
-char source[MAX_SOURCE_SIZE];
-lexeme table[MAX_LEXEMES];
-int tableIndex = 0;
-int isReserved(const char *word)
+if (inComment)
 {
-for (int i = 0; i < numReserved; i++)
+if (input[i] == '*' && input[i + 1] == '/') { inComment = 0; i += 2; }
+else i++;
+}
+else
 {
-if (strcmp(word, reserved[i]) == 0)
-return reservedTokens[i];
+if (input[i] == '/' && input[i + 1] == '*') { inComment = 1; i += 2; }
+else i++;
 }
-return 0;
 }
-void addLexeme(const char *word, int token, int value)
+return inComment;
+}
+void *scanChunk(void *arg)
 {
-// prevents overflow
-if (tableIndex >= MAX_LEXEMES) return;
-// copy word to lexeme table
-strncpy(table[tableIndex].lexeme, word, MAX_ID_LEN);
-table[tableIndex].token = token;
-table[tableIndex].value = value;
-tableIndex++;
+lexChunk *chunk = arg;
+chunk->endState[0] = commentStateAfter(chunk->input, chunk->begin, chunk->end, 0);
+chunk->endState[1] = commentStateAfter(chunk->input, chunk->begin, chunk->end, 1);
+return NULL;
 }
-void error(const int msg, const char *context)
+void *lexChunkRange(void *arg)
 {
-if (tableIndex >= MAX_LEXEMES) return;
-// copy context to lexeme table (for errors only)
-strncpy(table[tableIndex].lexeme, context, MAX_ID_LEN);
-table[tableIndex].token = msg;
-table[tableIndex].value = 1;
-tableIndex++;
+lexChunk *chunk = arg;
+lexRange(&chunk->out, chunk->input, chunk->begin, chunk->end, chunk->inComment);
+return NULL;
 }
-void handleComment(const char *input, int *i)
+void *copyChunk(void *arg)
+{
+lexChunk *chunk = arg;
+tokenStream *part = &chunk->out;
+for (int t = 0; t < part->count; t++)
 {
-*i += 2; // Skip the opening "/*"
-while (input[*i] != '\0' && !(input[*i] == '*' && input[*i + 1] == '/'))
+lexeme entry = part->table[t];
+if (entry.token <= 0 || entry.token == identsym || entry.token == skipsym)
+entry.value = chunk->remap[entry.value];
+chunk->dest[chunk->offset + t] = entry;
+}
+return NULL;
+}
+void runChunks(lexChunk *chunks, int count, void *(*work)(void *))
 {
-(*i)++;
+pthread_t threads[MAX_THREADS];
+for (int k = 1; k < count; k++) pthread_create(&threads[k], NULL, work, &chunks[k]);
+work(&chunks[0]);
+for (int k = 1; k < count; k++) pthread_join(threads[k], NULL);
+}
+// lexes input on up to threadCount threads into ts; same result as lexer()
+void lexParallel(tokenStream *ts, const char *input, int length, int threadCount)
+{
+lexChunk chunks[MAX_THREADS];
+int count = 0, begin = 0;
+if (threadCount > MAX_THREADS) threadCount = MAX_THREADS;
+for (int k = 1; k <= threadCount && begin < length; k++)
+{
+int end = (int)((long long)length * k / threadCount);
+if (end < begin) end = begin;
+// move the cut to just after the next whitespace character
+while (end < length && !isspace(input[end])) end++;
+if (end < length) end++;
+if (k == threadCount) end = length;
+memset(&chunks[count], 0, sizeof chunks[count]);
+chunks[count].input = input;
+chunks[count].begin = begin;
+chunks[count].end = end;
+count++;
+begin = end;
 }
-if (input[*i] == '\0')
+runChunks(chunks, count, scanChunk);
+int state = 0;
+for (int k = 0; k < count; k++)
 {
-// Unclosed comment - handle gracefully, just return
-return;
+chunks[k].inComment = state;
+state = chunks[k].endState[state];
 }
-*i += 2;
+runChunks(chunks, count, lexChunkRange);
+// merge: intern each chunk's distinct names once (sequential, in chunk order
+// so ids match the sequential lexer), then copy the tokens in parallel
+int total = ts->count;
+for (int k = 0; k < count; k++)
+{
+tokenStream *part = &chunks[k].out;
+chunks[k].remap = malloc((part->nameCount + 1) * sizeof(int));
+if (!chunks[k].remap)
+{
+fprintf(stderr, "out of memory\n");
+exit(1);
 }
-void lexer(const char *input)
+for (int id = 0; id < part->nameCount; id++)
+{
+const char *text = nameText(part, id);
+chunks[k].remap[id] = intern(ts, text, (int)strlen(text));
+}
+chunks[k].offset = total;
+total += part->count;
+}
+ts->table = growArray(ts->table, &ts->cap, total, sizeof(lexeme));
+ts->count = total;
+for (int k = 0; k < count; k++) chunks[k].dest = ts->table;
+runChunks(chunks, count, copyChunk);
+for (int k = 0; k < count; k++)
+{
+free(chunks[k].remap);
+freeStream(&chunks[k].out);
+}
+}
+// the --threads path. lexParallel adds a scan pass and a merge to the
+// lexing, about 1.3-1.5x the sequential time in all at one thread, and a
+// thread start per chunk, so only inputs with LEX_CHUNK_MIN characters for
+// every thread are split; a smaller one gets fewer threads, or the
+// sequential lexer when one would do it all
+#define LEX_CHUNK_MIN (256 * 1024)
+void lexThreads(tokenStream *ts, const char *input, int length, int threadCount)
+{
+if (threadCount > length / LEX_CHUNK_MIN) threadCount = length / LEX_CHUNK_MIN;
+if (threadCount > 1) lexParallel(ts, input, length, threadCount);
+else lexRange(ts, input, 0, length, 0);
+}
+int sameTokens(const tokenStream *a, const tokenStream *b)
 {
-int i = 0;
-// while we don't reach null terminator
-while (input[i] != '\0')
-{
-if (isspace(input[i])) { i++; continue; }
-if (input[i] == '/' && input[i + 1] == '*')
-{
-handleComment(input, &i);
-continue;
-}
-// identifier or reserved word
-if (isalpha(input[i]))
-{
-char buffer[MAX_ID_LEN + 5]; int j = 0;
-while (isalnum(input[i]) && j < MAX_ID_LEN) buffer[j++] = input[i++];
-buffer[j] = '\0';
-// If identifier is too long, set to skipsym
-if (isalnum(input[i]))
-{
-while (isalnum(input[i])) i++; // Skip the rest of the identifier
-addLexeme(buffer, skipsym, 0); // Mark as skipsym
-continue;
-}
-int res = isReserved(buffer);
-if (res) addLexeme(buffer, res, 0);
-else addLexeme(buffer, identsym, 0);
-continue;
-}
-// number
-if (isdigit(input[i]))
-{
-char buffer[MAX_NUM_LEN + 5]; int j = 0;
-while (isdigit(input[i]) && j < MAX_NUM_LEN) buffer[j++] = input[i++];
-buffer[j] = '\0';
-// If number is too long, set to skipsym
-if (isdigit(input[i]))
-{
-while (isdigit(input[i])) i++; // Skip the rest of the number
-addLexeme(buffer, skipsym, 0); // Mark as skipsym
-continue;
-}
-addLexeme(buffer, numbersym, atoi(buffer));
-continue;
-}
-// special symbols
-switch (input[i])
-{
-case '+': addLexeme("+", plussym, 0); i++; break;
-case '-': addLexeme("-", minussym, 0); i++; break;
-case '*': addLexeme("*", multsym, 0); i++; break;
-case '/': addLexeme("/", slashsym, 0); i++; break;
-case '=': addLexeme("=", eqlsym, 0); i++; break;
-case '<':
-if (input[i + 1] == '=') { addLexeme("<=", leqsym, 0); i += 2; }
-else if (input[i + 1] == '>') { addLexeme("<>", neqsym, 0); i += 2;
-}
-else { addLexeme("<", lessym, 0); i++; }
-break;
-case '>':
-if (input[i + 1] == '=') { addLexeme(">=", geqsym, 0); i += 2; }
-else { addLexeme(">", gtrsym, 0); i++; }
-break;
-case ':':
-if (input[i + 1] == '=') { addLexeme(":=", becomessym, 0); i +=
-2; }
-else { i++; } // Skip lone colon - handle gracefully
-break;
-case '(': addLexeme("(", lparentsym, 0); i++; break;
-case ')': addLexeme(")", rparentsym, 0); i++; break;
-case ',': addLexeme(",", commasym, 0); i++; break;
-case ';': addLexeme(";", semicolonsym, 0); i++; break;
-case '.': addLexeme(".", periodsym, 0); i++; break;
-// Skip invalid symbols gracefully - don't generate error tokens
-default:
-addLexeme(&input[i], skipsym, 0); // Mark invalid symbol as skipsym
-i++; // Move to the next character
-break;
+if (a->count != b->count) return 0;
+for (int t = 0; t < a->count; t++)
+{
+const lexeme *x = &a->table[t], *y = &b->table[t];
+if (x->token != y->token || x->offset != y->offset) return 0;
+if (x->token <= 0 || x->token == identsym || x->token == skipsym)
+{
+if (strcmp(nameText(a, x->value), nameText(b, y->value)) != 0) return 0;
+}
+else if (x->value != y->value) return 0;
+}
+return 1;
 }
+// --scale N: lexes the source with 1..N threads and reports the speedup
+// over the sequential lexer on stderr, checking every result is identical.
+// It always splits (lexParallel), to measure the parallel path itself;
+// the last line says how many threads --threads would use on this input
+int reportScaling(int maxThreads)
+{
+tokenStream sequential = {0};
+int repeats = 1;
+// repeat small inputs so each timing covers at least ~1M characters
+if (sourceLength > 0 && sourceLength < 1000000) repeats = 1000000 / sourceLength;
+double start = stats_clock_ms(CLOCK_MONOTONIC);
+for (int r = 0; r < repeats; r++)
+{
+freeStream(&sequential);
+lexRange(&sequential, source, 0, sourceLength, 0);
 }
+double baseMs = (stats_clock_ms(CLOCK_MONOTONIC) - start) / repeats;
+fprintf(stderr, "threads\tms\tspeedup\n");
+fprintf(stderr, "seq\t%.3f\t1.00\n", baseMs);
+int identical = 1;
+for (int n = 1; n <= maxThreads && n <= MAX_THREADS; n++)
+{
+tokenStream parallel = {0};
+start = stats_clock_ms(CLOCK_MONOTONIC);
+for (int r = 0; r < repeats; r++)
+{
+freeStream(&parallel);
+lexParallel(&parallel, source, sourceLength, n);
+}
+double ms = (stats_clock_ms(CLOCK_MONOTONIC) - start) / repeats;
+int same = sameTokens(&sequential, &parallel);
+identical &= same;
+fprintf(stderr, "%d\t%.3f\t%.2f%s\n", n, ms, ms > 0 ? baseMs / ms : 0.0, same ? "" : "\tMISMATCH");
+freeStream(&parallel);
+}
+freeStream(&sequential);
+int useful = sourceLength / LEX_CHUNK_MIN;
+fprintf(stderr, "--threads %d would use %d on this input (%d characters, at least %d per thread)\n",
+maxThreads, useful > 1 ? (useful < maxThreads ? useful : maxThreads) : 1, sourceLength, LEX_CHUNK_MIN);
+return identical ? 0 : 1;
 }
 void printSource(const char *input)
 {
@@ -211,24 +303,26 @@ printf("\nLexeme Table:\n");
 printf("\n");
 printf("lexeme\t token type\n");
 // loop through and print table
-for (int i=0; i<tableIndex; i++)
+for (int i=0; i<tokens.count; i++)
 {
+char numBuffer[16];
+const char *text = lexemeText(&tokens, &tokens.table[i], numBuffer);
 // error handling
-if(table[i].token > 0)
+if(tokens.table[i].token > 0)
 {
-printf("%-12s %d\n", table[i].lexeme, table[i].token);
+printf("%-12s %d\n", text, tokens.table[i].token);
 }
-else if(table[i].token == -1)
+else if(tokens.table[i].token == -1)
 {
-printf("%-12s %s\n", table[i].lexeme, "Indentifier too long");
+printf("%-12s %s\n", text, "Indentifier too long");
 }
-else if(table[i].token == -2)
+else if(tokens.table[i].token == -2)
 {
-printf("%-12s %s\n", table[i].lexeme, "Number too long");
+printf("%-12s %s\n", text, "Number too long");
 }
-else if(table[i].token == -3)
+else if(tokens.table[i].token == -3)
 {
-printf("%-12s %s\n", table[i].lexeme, "Invalid Symbol");
+printf("%-12s %s\n", text, "Invalid Symbol");
 }
 }
 printf("\n");
@@ -237,44 +331,168 @@ void printTokenList()
 {
 // printf("Token List:\n");
 // printf("\n");
-for (int i=0; i<tableIndex; i++)
+for (int i=0; i<tokens.count; i++)
 {
 // Only output valid tokens (positive token values)
 // Do NOT output error tokens (negative values) as skipsym
-if(table[i].token > 0)
+if(tokens.table[i].token > 0)
 {
-fprintf(fptr, "%d ", table[i].token);
-if (table[i].token == identsym || table[i].token == numbersym)
+fprintf(fptr, "%d ", tokens.table[i].token);
+if (tokens.table[i].token == identsym)
 {
-fprintf(fptr, "%s ", table[i].lexeme);
+fprintf(fptr, "%s ", nameText(&tokens, tokens.table[i].value));
+}
+else if (tokens.table[i].token == numbersym)
+{
+// the digits as written (leading zeros included), as tokens.txt always had
+const char *digits = source + tokens.table[i].offset;
+fprintf(fptr, "%.*s ", (int)strspn(digits, "0123456789"), digits);
 }
 }
 // Skip error tokens - don't output anything for them
 }
 fprintf(fptr, "\n");
 }
-int main(int argc, char *argv[])
+// --debug: writes the line and column of every token in tokens.txt, in the
+// same order, so the parser can map the code it emits back to the source
+void printTokenPositions(FILE *out, const char *path)
 {
-fptr = fopen("tokens.txt","w");
-// file input handling
-if (argc != 2)
+int count = 0;
+for (int i=0; i<tokens.count; i++)
 {
-printf("Usage: %s <sourcefile>\n", argv[0]);
-return 1;
+if (tokens.table[i].token > 0) count++;
+}
+char *full = realpath(path, NULL);
+fprintf(out, "source %s\n", full ? full : path);
+fprintf(out, "tokens %d\n", count);
+free(full);
+// offsets only grow, so one sweep over the source finds every line
+int line = 1, lineStart = 0, scanned = 0;
+for (int i=0; i<tokens.count; i++)
+{
+if (tokens.table[i].token <= 0) continue;
+int offset = tokens.table[i].offset;
+while (scanned < offset)
+{
+if (source[scanned] == '\n')
+{
+line++;
+lineStart = scanned + 1;
 }
-FILE *fp = fopen(argv[1], "r");
+scanned++;
+}
+fprintf(out, "%d %d\n", line, offset - lineStart + 1);
+}
+}
+// reads the whole file into source, returns 0 on failure
+int readSource(const char *path)
+{
+FILE *fp = fopen(path, "r");
 if (!fp)
 {
 perror("File open error");
-return 1;
+return 0;
 }
-size_t bytesRead = fread(source, 1, MAX_SOURCE_SIZE-1, fp);
-source[bytesRead] = '\0'; // null-terminate the string
+int cap = 0;
+size_t bytesRead;
+do
+{
+source = growArray(source, &cap, sourceLength + 65536, 1);
+bytesRead = fread(source + sourceLength, 1, cap - sourceLength - 1, fp);
+sourceLength += (int)bytesRead;
+} while (bytesRead > 0);
+source[sourceLength] = '\0'; // null-terminate the string
+sourceLength = (int)strlen(source); // lexing stops at an embedded null
 fclose(fp);
+return 1;
+}
+// the value of --threads or --scale: a whole number from 1 to MAX_THREADS.
+// returns 0 for anything else
+int parseThreads(const char *word)
+{
+char *end;
+long value = strtol(word, &end, 10);
+if (end == word || *end != '\0' || value < 1 || value > MAX_THREADS) return 0;
+return (int)value;
+}
+int main(int argc, char *argv[])
+{
+int threadCount = 1; // --threads
+int scaleThreads = 0; // --scale
+int debugPositions = 0; // --debug
+// optional flags before the file:
+// --stats reports phase timings as JSON on stderr
+while (argc > 2 && strncmp(argv[1], "--", 2) == 0)
+{
+if (strcmp(argv[1], "--stats") == 0)
+{
+stats_init();
+}
+else if (strcmp(argv[1], "--debug") == 0)
+{
+debugPositions = 1;
+}
+else if (strcmp(argv[1], "--threads") == 0 && argc > 3)
+{
+threadCount = parseThreads(argv[2]);
+if (!threadCount)
+{
+printf("Error: --threads needs a whole number from 1 to %d, not \"%s\"\n", MAX_THREADS, argv[2]);
+printf("Usage: %s [--stats] [--debug] [--threads N | --scale N] <sourcefile>\n", argv[0]);
+return 1;
+}
+argv++;
+argc--;
+}
+else if (strcmp(argv[1], "--scale") == 0 && argc > 3)
+{
+scaleThreads = parseThreads(argv[2]);
+if (!scaleThreads)
+{
+printf("Error: --scale needs a whole number from 1 to %d, not \"%s\"\n", MAX_THREADS, argv[2]);
+printf("Usage: %s [--stats] [--debug] [--threads N | --scale N] <sourcefile>\n", argv[0]);
+return 1;
+}
+argv++;
+argc--;
+}
+else break;
+argv++;
+argc--;
+}
+// file input handling
+if (argc != 2)
+{
+printf("Usage: %s [--stats] [--debug] [--threads N | --scale N] <sourcefile>\n", argv[0]);
+return 1;
+}
+stats_begin("read");
+if (!readSource(argv[1])) return 1;
+stats_end();
+if (scaleThreads > 0) return reportScaling(scaleThreads);
+fptr = fopen("tokens.txt","w");
 // main program flow
 // printSource(source);
-lexer(source);
+stats_begin("lexer");
+if (threadCount > 1) lexThreads(&tokens, source, sourceLength, threadCount);
+else lexer(source);
+stats_end();
 // printLexemeTable();
+stats_begin("printTokenList");
 printTokenList();
+fflush(fptr);
+stats_end();
+if (debugPositions)
+{
+FILE *positions = fopen("tokens.pos", "w");
+if (!positions)
+{
+perror("tokens.pos");
+return 1;
+}
+printTokenPositions(positions, argv[1]);
+fclose(positions);
+}
+stats_report("lex");
 return 0;
-}
\ No newline at end of file
+}
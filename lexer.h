@@ -0,0 +1,276 @@
+/*
+Scanner core shared by lex.c and parsercodegen_complete.c (--batch).
+
+lexRange() turns a range of PL/0 source into a tokenStream: the token
+table plus the string pool its name ids refer to. All state lives in the
+stream, so streams on different threads can be filled at the same time
+(lex --threads lexes chunks of one file, --batch lexes whole files).
+Identifiers and numbers that are too long, and invalid symbols, become
+skipsym; each lexeme keeps the byte offset of its first character.
+*/
+#ifndef LEXER_H
+#define LEXER_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#define MAX_ID_LEN 11
+#define MAX_NUM_LEN 5
+typedef enum
+{
+skipsym = 1, identsym, numbersym, plussym, minussym,
+multsym, slashsym, eqlsym, neqsym,
+lessym, leqsym, gtrsym, geqsym, lparentsym,
+rparentsym, commasym, semicolonsym, periodsym, becomessym,
+beginsym, endsym, ifsym, fisym, thensym, whilesym,
+dosym, callsym, constsym, varsym, procsym,
+writesym, readsym, elsesym, evensym,
+cobeginsym, coendsym, lbracketsym, rbracketsym, returnsym,
+modulesym, externsym
+} token_type;
+// compact token: identifiers and skipped text carry an interned name id,
+// numbers carry their value
+typedef struct
+{
+int token;
+int value;
+int offset; // byte offset of the lexeme in the source
+} lexeme;
+// lexer output: the token table plus the string pool its name ids refer to.
+// every distinct name is stored once in pool
+typedef struct
+{
+lexeme *table; // grows as needed
+int count, cap;
+char *pool;
+int poolUsed, poolCap;
+int *nameStart; // pool offset of each name id
+int nameCount, nameCap;
+int *nameHash; // open addressing, holds id + 1 (0 = empty)
+int hashCap;
+int tokenStart; // source offset of the lexeme being scanned
+} tokenStream;
+static const char *reserved[] =
+{
+"const","var","procedure","call","begin","end","if","fi","then",
+"else","while","do","read","write","odd",
+"cobegin","coend","return","module","extern"
+};
+static const int reservedTokens[] =
+{
+constsym, varsym, procsym, callsym, beginsym, endsym,
+ifsym, fisym, thensym, elsesym, whilesym, dosym,
+readsym, writesym, evensym,
+cobeginsym, coendsym, returnsym, modulesym, externsym
+};
+static const int numReserved = 20;
+static int isReserved(const char *word)
+{
+for (int i = 0; i < numReserved; i++)
+{
+if (strcmp(word, reserved[i]) == 0)
+return reservedTokens[i];
+}
+return 0;
+}
+static void *growArray(void *array, int *cap, int need, size_t elemSize)
+{
+if (need <= *cap) return array;
+int newCap = *cap ? *cap : 64;
+while (newCap < need) newCap *= 2;
+array = realloc(array, newCap * elemSize);
+if (!array)
+{
+fprintf(stderr, "out of memory\n");
+exit(1);
+}
+*cap = newCap;
+return array;
+}
+static void freeStream(tokenStream *ts)
+{
+free(ts->table);
+free(ts->pool);
+free(ts->nameStart);
+free(ts->nameHash);
+memset(ts, 0, sizeof *ts);
+}
+static const char *nameText(const tokenStream *ts, int id)
+{
+return ts->pool + ts->nameStart[id];
+}
+static unsigned hashName(const char *word, int len)
+{
+unsigned h = 2166136261u;
+for (int i = 0; i < len; i++) h = (h ^ (unsigned char)word[i]) * 16777619u;
+return h;
+}
+// returns the id of word[0..len), adding it to the pool on first use
+static int intern(tokenStream *ts, const char *word, int len)
+{
+if (ts->nameCount * 2 >= ts->hashCap)
+{
+// rehash at half load
+int oldCap = ts->hashCap;
+int *old = ts->nameHash;
+ts->hashCap = oldCap ? oldCap * 2 : 256;
+ts->nameHash = calloc(ts->hashCap, sizeof(int));
+if (!ts->nameHash)
+{
+fprintf(stderr, "out of memory\n");
+exit(1);
+}
+for (int i = 0; i < oldCap; i++)
+{
+if (!old[i]) continue;
+const char *text = nameText(ts, old[i] - 1);
+unsigned h = hashName(text, (int)strlen(text)) & (ts->hashCap - 1);
+while (ts->nameHash[h]) h = (h + 1) & (ts->hashCap - 1);
+ts->nameHash[h] = old[i];
+}
+free(old);
+}
+unsigned h = hashName(word, len) & (ts->hashCap - 1);
+while (ts->nameHash[h])
+{
+const char *text = nameText(ts, ts->nameHash[h] - 1);
+if (strncmp(text, word, len) == 0 && text[len] == '\0') return ts->nameHash[h] - 1;
+h = (h + 1) & (ts->hashCap - 1);
+}
+ts->pool = growArray(ts->pool, &ts->poolCap, ts->poolUsed + len + 1, 1);
+ts->nameStart = growArray(ts->nameStart, &ts->nameCap, ts->nameCount + 1, sizeof(int));
+memcpy(ts->pool + ts->poolUsed, word, len);
+ts->pool[ts->poolUsed + len] = '\0';
+ts->nameStart[ts->nameCount] = ts->poolUsed;
+ts->poolUsed += len + 1;
+ts->nameHash[h] = ts->nameCount + 1;
+return ts->nameCount++;
+}
+// lexeme text is capped at MAX_ID_LEN characters
+static int boundedLength(const char *word)
+{
+int len = 0;
+while (len < MAX_ID_LEN && word[len] != '\0') len++;
+return len;
+}
+static void addLexeme(tokenStream *ts, const char *word, int token, int value)
+{
+ts->table = growArray(ts->table, &ts->cap, ts->count + 1, sizeof(lexeme));
+// names are interned once, other tokens keep only their value
+if (token == identsym || token == skipsym)
+{
+value = intern(ts, word, boundedLength(word));
+}
+ts->table[ts->count].token = token;
+ts->table[ts->count].value = value;
+ts->table[ts->count].offset = ts->tokenStart;
+ts->count++;
+}
+// skips to just past the closing "*/", or to end if the comment stays open
+static void skipCommentBody(const char *input, int *i, int end)
+{
+while (*i < end && !(input[*i] == '*' && input[*i + 1] == '/'))
+{
+(*i)++;
+}
+if (*i >= end)
+{
+// Unclosed comment - handle gracefully, just return
+*i = end;
+return;
+}
+*i += 2;
+}
+static void handleComment(const char *input, int *i, int end)
+{
+*i += 2; // Skip the opening "/*"
+skipCommentBody(input, i, end);
+}
+// lexes input[begin..end) into ts; inComment says begin lies inside a /* */ comment
+static void lexRange(tokenStream *ts, const char *input, int begin, int end, int inComment)
+{
+int i = begin;
+if (inComment) skipCommentBody(input, &i, end);
+// while we don't reach the end of the range
+while (i < end)
+{
+if (isspace(input[i])) { i++; continue; }
+if (input[i] == '/' && input[i + 1] == '*')
+{
+handleComment(input, &i, end);
+continue;
+}
+ts->tokenStart = i;
+// identifier or reserved word
+if (isalpha(input[i]))
+{
+char buffer[MAX_ID_LEN + 5]; int j = 0;
+while (isalnum(input[i]) && j < MAX_ID_LEN) buffer[j++] = input[i++];
+buffer[j] = '\0';
+// If identifier is too long, set to skipsym
+if (isalnum(input[i]))
+{
+while (isalnum(input[i])) i++; // Skip the rest of the identifier
+addLexeme(ts, buffer, skipsym, 0); // Mark as skipsym
+continue;
+}
+int res = isReserved(buffer);
+if (res) addLexeme(ts, buffer, res, 0);
+else addLexeme(ts, buffer, identsym, 0);
+continue;
+}
+// number
+if (isdigit(input[i]))
+{
+char buffer[MAX_NUM_LEN + 5]; int j = 0;
+while (isdigit(input[i]) && j < MAX_NUM_LEN) buffer[j++] = input[i++];
+buffer[j] = '\0';
+// If number is too long, set to skipsym
+if (isdigit(input[i]))
+{
+while (isdigit(input[i])) i++; // Skip the rest of the number
+addLexeme(ts, buffer, skipsym, 0); // Mark as skipsym
+continue;
+}
+addLexeme(ts, buffer, numbersym, atoi(buffer));
+continue;
+}
+// special symbols
+switch (input[i])
+{
+case '+': addLexeme(ts, "+", plussym, 0); i++; break;
+case '-': addLexeme(ts, "-", minussym, 0); i++; break;
+case '*': addLexeme(ts, "*", multsym, 0); i++; break;
+case '/': addLexeme(ts, "/", slashsym, 0); i++; break;
+case '=': addLexeme(ts, "=", eqlsym, 0); i++; break;
+case '<':
+if (input[i + 1] == '=') { addLexeme(ts, "<=", leqsym, 0); i += 2; }
+else if (input[i + 1] == '>') { addLexeme(ts, "<>", neqsym, 0); i += 2;
+}
+else { addLexeme(ts, "<", lessym, 0); i++; }
+break;
+case '>':
+if (input[i + 1] == '=') { addLexeme(ts, ">=", geqsym, 0); i += 2; }
+else { addLexeme(ts, ">", gtrsym, 0); i++; }
+break;
+case ':':
+if (input[i + 1] == '=') { addLexeme(ts, ":=", becomessym, 0); i +=
+2; }
+else { i++; } // Skip lone colon - handle gracefully
+break;
+case '(': addLexeme(ts, "(", lparentsym, 0); i++; break;
+case ')': addLexeme(ts, ")", rparentsym, 0); i++; break;
+case '[': addLexeme(ts, "[", lbracketsym, 0); i++; break;
+case ']': addLexeme(ts, "]", rbracketsym, 0); i++; break;
+case ',': addLexeme(ts, ",", commasym, 0); i++; break;
+case ';': addLexeme(ts, ";", semicolonsym, 0); i++; break;
+case '.': addLexeme(ts, ".", periodsym, 0); i++; break;
+// Skip invalid symbols gracefully - don't generate error tokens
+default:
+addLexeme(ts, &input[i], skipsym, 0); // Mark invalid symbol as skipsym
+i++; // Move to the next character
+break;
+}
+}
+}
+#endif
@@ -0,0 +1,360 @@
+/*
+Linker for separately compiled PL/0 units
+
+Joins the objects written by parsercodegen_complete --object into one
+elf.txt for the VM. The program unit (the one with a main block) comes
+first, so its main JMP stays at address 0; modules follow in the order
+given. Every unit's globals are placed in main's frame one after another,
+and main's INC is resized to hold them all.
+
+Language: C (only)
+
+To Compile:
+    gcc -O2 -std=c11 -o linker linker.c
+
+To Execute:
+    ./linker [-o elf.txt] [--map] object ...
+where:
+    -o      output file (default elf.txt)
+    --map   print where each unit's code and globals and each exported
+            symbol ended up
+    object  objects from parsercodegen_complete --object, exactly one of
+            them a program
+Notes:
+    - the object format is described above write_object() in
+      parsercodegen_complete.c
+    - extern procedure and extern var declarations are resolved against the
+      exports of the other units; the parameter count of a procedure and the
+      size of a variable must match its definition
+    - undefined and duplicate symbols are reported with the units involved,
+      and nothing is written; exit status is 1 on any error, 0 otherwise
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_UNITS 64
+#define MAX_CODE_LENGTH 1000 // the VM's PAS_SIZE holds at most this much code
+#define NAME_LEN 64
+
+typedef struct instruction {
+    int op, l, m;
+} instruction;
+
+typedef struct export {
+    char name[NAME_LEN];
+    int is_proc;
+    int value;  // procedures: code index in the unit; variables: offset from 3
+    int extra;  // procedures: parameter count (-1: none); variables: size
+} export;
+
+typedef struct relocation {
+    int index;
+    char kind[8];          // code, data, frame, proc or var
+    char name[NAME_LEN];   // proc and var
+    int extra;             // proc: parameter count, var: size
+} relocation;
+
+typedef struct unit {
+    const char *path;
+    char name[NAME_LEN];   // module name, "program" for the program
+    int is_program;
+    instruction *code;
+    int code_length;
+    int data_words;
+    export *exports;
+    int export_count;
+    relocation *relocs;
+    int reloc_count;
+    int code_base;         // first instruction in the linked program
+    int data_base;         // address of the first global in main's frame
+} unit;
+
+unit units[MAX_UNITS];
+int unit_count = 0;
+int errors = 0;
+
+
+// reads one object; returns 0 and reports the problem if it is malformed
+int read_object(const char *path, unit *u)
+{
+    FILE *fp = fopen(path, "r");
+    char kind[NAME_LEN];
+    int version;
+    if (!fp)
+    {
+        perror(path);
+        return 0;
+    }
+    memset(u, 0, sizeof *u);
+    u->path = path;
+    if (fscanf(fp, "pm0-object %d unit %63s", &version, kind) != 2 || version != 1)
+    {
+        fprintf(stderr, "ERROR: %s is not a PL/0 object\n", path);
+        fclose(fp);
+        return 0;
+    }
+    if (strcmp(kind, "program") == 0)
+    {
+        u->is_program = 1;
+        strcpy(u->name, "program");
+    }
+    else if (strcmp(kind, "module") != 0 || fscanf(fp, "%63s", u->name) != 1)
+    {
+        goto malformed;
+    }
+
+    if (fscanf(fp, " code %d", &u->code_length) != 1 || u->code_length < 0 || u->code_length > MAX_CODE_LENGTH) goto malformed;
+    u->code = malloc((u->code_length + 1) * sizeof *u->code);
+    for (int i = 0; i < u->code_length; i++)
+    {
+        if (fscanf(fp, "%d %d %d", &u->code[i].op, &u->code[i].l, &u->code[i].m) != 3) goto malformed;
+    }
+    if (fscanf(fp, " data %d", &u->data_words) != 1 || u->data_words < 0) goto malformed;
+
+    if (fscanf(fp, " exports %d", &u->export_count) != 1 || u->export_count < 0) goto malformed;
+    u->exports = malloc((u->export_count + 1) * sizeof *u->exports);
+    for (int i = 0; i < u->export_count; i++)
+    {
+        export *e = &u->exports[i];
+        if (fscanf(fp, "%7s %63s %d %d", kind, e->name, &e->value, &e->extra) != 4) goto malformed;
+        if (strcmp(kind, "proc") == 0) e->is_proc = 1;
+        else if (strcmp(kind, "var") != 0) goto malformed;
+    }
+
+    if (fscanf(fp, " relocs %d", &u->reloc_count) != 1 || u->reloc_count < 0) goto malformed;
+    u->relocs = malloc((u->reloc_count + 1) * sizeof *u->relocs);
+    for (int i = 0; i < u->reloc_count; i++)
+    {
+        relocation *r = &u->relocs[i];
+        if (fscanf(fp, "%d %7s", &r->index, r->kind) != 2 || r->index < 0 || r->index >= u->code_length) goto malformed;
+        if (strcmp(r->kind, "proc") == 0 || strcmp(r->kind, "var") == 0)
+        {
+            if (fscanf(fp, "%63s %d", r->name, &r->extra) != 2) goto malformed;
+        }
+        else if (strcmp(r->kind, "code") != 0 && strcmp(r->kind, "data") != 0 && strcmp(r->kind, "frame") != 0)
+        {
+            goto malformed;
+        }
+    }
+    fclose(fp);
+    return 1;
+
+malformed:
+    fprintf(stderr, "ERROR: %s: malformed object\n", path);
+    fclose(fp);
+    return 0;
+}
+
+// finds an exported symbol; *owner gets its unit
+export *find_export(const char *name, int is_proc, unit **owner)
+{
+    for (int i = 0; i < unit_count; i++)
+    {
+        for (int j = 0; j < units[i].export_count; j++)
+        {
+            export *e = &units[i].exports[j];
+            if (e->is_proc == is_proc && strcmp(e->name, name) == 0)
+            {
+                *owner = &units[i];
+                return e;
+            }
+        }
+    }
+    return NULL;
+}
+
+// reports symbols exported by more than one unit
+void check_duplicates(void)
+{
+    for (int i = 0; i < unit_count; i++)
+    {
+        for (int j = 0; j < units[i].export_count; j++)
+        {
+            for (int k = i + 1; k < unit_count; k++)
+            {
+                for (int n = 0; n < units[k].export_count; n++)
+                {
+                    if (strcmp(units[i].exports[j].name, units[k].exports[n].name) == 0)
+                    {
+                        fprintf(stderr, "ERROR: %s is defined in both %s and %s\n",
+                                units[i].exports[j].name, units[i].path, units[k].path);
+                        errors++;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// a symbol used several times in a unit is only reported once
+int reported_before(unit *u, relocation *r)
+{
+    for (relocation *earlier = u->relocs; earlier < r; earlier++)
+    {
+        if (strcmp(earlier->kind, r->kind) == 0 && strcmp(earlier->name, r->name) == 0) return 1;
+    }
+    return 0;
+}
+
+// applies one relocation to a unit's code, now that every base is known
+void relocate(unit *u, relocation *r, int total_globals)
+{
+    instruction *ins = &u->code[r->index];
+    unit *owner;
+    export *e;
+    if (strcmp(r->kind, "code") == 0)
+    {
+        ins->m += 3 * u->code_base;
+    }
+    else if (strcmp(r->kind, "data") == 0)
+    {
+        ins->m += u->data_base - 3;
+    }
+    else if (strcmp(r->kind, "frame") == 0)
+    {
+        ins->m = 3 + total_globals;
+    }
+    else if ((e = find_export(r->name, strcmp(r->kind, "proc") == 0, &owner)) == NULL)
+    {
+        if (reported_before(u, r)) return;
+        fprintf(stderr, "ERROR: %s: undefined %s %s\n", u->path,
+                strcmp(r->kind, "proc") == 0 ? "procedure" : "variable", r->name);
+        errors++;
+    }
+    else if (e->extra != r->extra)
+    {
+        if (reported_before(u, r)) return;
+        fprintf(stderr, "ERROR: %s: %s %s is declared with %s %d but %s defines it with %d\n",
+                u->path, e->is_proc ? "procedure" : "variable", r->name,
+                e->is_proc ? "parameter count" : "size", r->extra, owner->path, e->extra);
+        errors++;
+    }
+    else if (e->is_proc)
+    {
+        ins->m = 3 * (owner->code_base + e->value);
+    }
+    else
+    {
+        ins->m += owner->data_base + e->value;
+    }
+}
+
+void print_map(int total_code, int total_globals)
+{
+    printf("%-16s %8s %8s %8s %8s\n", "unit", "code", "length", "data", "words");
+    for (int i = 0; i < unit_count; i++)
+    {
+        printf("%-16s %8d %8d %8d %8d\n", units[i].name, 3 * units[i].code_base,
+               units[i].code_length, units[i].data_base, units[i].data_words);
+        for (int j = 0; j < units[i].export_count; j++)
+        {
+            export *e = &units[i].exports[j];
+            if (e->is_proc)
+                printf("    proc %-12s %8d\n", e->name, 3 * (units[i].code_base + e->value));
+            else
+                printf("    var  %-12s %8d\n", e->name, units[i].data_base + e->value);
+        }
+    }
+    printf("total %d instructions, %d globals\n", total_code, total_globals);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *output_path = "elf.txt";
+    const char *paths[MAX_UNITS];
+    int path_count = 0, show_map = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            output_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--map") == 0)
+        {
+            show_map = 1;
+        }
+        else if (argv[i][0] != '-' && path_count < MAX_UNITS)
+        {
+            paths[path_count++] = argv[i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-o elf.txt] [--map] object ...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (path_count == 0)
+    {
+        fprintf(stderr, "Usage: %s [-o elf.txt] [--map] object ...\n", argv[0]);
+        return 1;
+    }
+
+    // the program goes first so that its main JMP is the entry point
+    int program = -1;
+    for (int i = 0; i < path_count; i++)
+    {
+        unit u;
+        if (!read_object(paths[i], &u)) return 1;
+        if (u.is_program)
+        {
+            if (program >= 0)
+            {
+                fprintf(stderr, "ERROR: %s and %s are both programs\n", units[program].path, u.path);
+                return 1;
+            }
+            program = i;
+        }
+        units[unit_count++] = u;
+    }
+    if (program < 0)
+    {
+        fprintf(stderr, "ERROR: no program among the objects, only modules\n");
+        return 1;
+    }
+    unit first = units[program];
+    memmove(&units[1], &units[0], program * sizeof *units);
+    units[0] = first;
+
+    int total_code = 0, total_globals = 0;
+    for (int i = 0; i < unit_count; i++)
+    {
+        units[i].code_base = total_code;
+        units[i].data_base = 3 + total_globals;
+        total_code += units[i].code_length;
+        total_globals += units[i].data_words;
+    }
+    if (total_code > MAX_CODE_LENGTH)
+    {
+        fprintf(stderr, "ERROR: linked program has %d instructions, more than %d\n", total_code, MAX_CODE_LENGTH);
+        return 1;
+    }
+
+    check_duplicates();
+    for (int i = 0; i < unit_count; i++)
+    {
+        for (int j = 0; j < units[i].reloc_count; j++)
+        {
+            relocate(&units[i], &units[i].relocs[j], total_globals);
+        }
+    }
+    if (errors) return 1;
+
+    FILE *out = fopen(output_path, "w");
+    if (!out)
+    {
+        perror(output_path);
+        return 1;
+    }
+    for (int i = 0; i < unit_count; i++)
+    {
+        for (int j = 0; j < units[i].code_length; j++)
+        {
+            fprintf(out, "%d %d %d\n", units[i].code[j].op, units[i].code[j].l, units[i].code[j].m);
+        }
+    }
+    fclose(out);
+    if (show_map) print_map(total_code, total_globals);
+    return 0;
+}
@@ -9,24 +9,83 @@ Language: C (only)
 
 To Compile:
     Scanner:
-        gcc -O2 -std=c11 -o lex lex.c
+        gcc -O2 -std=c11 -pthread -o lex lex.c
     Parser/Code Generator:
-        gcc -O2 -std=c11 -o parsercodegen_complete parsercodegen_complete.c
+        gcc -O2 -std=c11 -pthread -o parsercodegen_complete parsercodegen_complete.c
     Virtual Machine:
-        gcc -O2 -std=c11 -o vm vm.c
+        gcc -O2 -std=c11 -pthread -o vm vm.c -lrt
+    Metrics viewer:
+        gcc -O2 -std=c11 -o vmstat vmstat.c -lrt
 
 To Execute (on Eustis):
-    ./lex <input_file.txt>
-    ./parsercodegen_complete
-    ./vm elf.txt
+    ./lex [--stats] [--debug] [--threads N | --scale N] <input_file.txt>
+    ./parsercodegen_complete [options below]
+    ./vm [--threads N] [--debug elf.dbg] [--profile] elf.txt
 where:
     <input_file.txt> is the path to the PL/0 source program
 Notes:
     - lex.c accepts ONE command-line argument (input PL/0 source file)
-    - parsercodegen_complete.c accepts NO command-line arguments
+    - parsercodegen_complete.c reads tokens.txt and takes no file arguments
+      (optional: --emit-c <file.c> writes the program as C,
+                 --native <exe> also builds it with $CC (default
+                 cc) -O2, run directly rather than through a shell,
+                 --no-bounds-check drops array index checks,
+                 --const-fold computes operations on constants at
+                 compile time,
+                 --lift addresses globals with LDA/STA and moves
+                 some procedure variables into main's frame,
+                 --dce drops procedures unreachable from main,
+                 --precompute [--fuel N] runs the program at compile time
+                 up to its first read (at most N instructions, default
+                 10000000) and emits code that recreates its outputs and
+                 state instead,
+                 --object <file> writes a relocatable object for
+                 linker.c instead of elf.txt,
+                 --debug writes elf.dbg mapping each instruction to its
+                 source line (needs tokens.pos from lex --debug),
+                 --memo writes elf.memo, the procedures vm --memo may
+                 cache and the variables they read and write,
+                 --stats reports phase timings as JSON on stderr)
+    - --batch <dir> [--jobs N] [--out <dir>] lexes and compiles every *.pl0
+      file in dir on N threads (default: online CPUs) and prints one line
+      per file: its instruction count, or file:line:col and the error.
+      --out writes each result as <name>.pl0.elf. Exit status 1 if any
+      file failed
+    - --precompute keeps the code from the first read (or COB) on; the
+      instructions it appends stand in for the run up to there, so outputs,
+      results and runtime errors are unchanged but vm counts fewer
+      instructions, and each added instruction takes 3 words of stack.
+      A run that errs or outlasts the fuel is left to vm
+    - all compiler state lives in a compiler struct; error() jumps back to
+      compile(), which returns the error code, so one process can compile
+      many programs, on several threads at once
     - Input filename is hard-coded in parsercodegen_complete.c
     - Implements recursive-descent parser for extended PL/0 grammar
+    - the parser builds an AST in an arena (one bump allocator, reset
+      between compilations) and emits nothing; the optional passes
+      (--const-fold) rewrite the tree and code generation walks it once.
+      --stats times parse, const_fold and codegen separately
     - Supports procedures, call statements, and if-then-else
+    - cobegin call p; call q coend emits COB 0 n followed by the n calls
+    - var a[n]; declares an array accessed through LDX/STX; each index is
+      checked by CHK unless compiled with --no-bounds-check
+    - procedure f(a, b); declares value parameters. Such a procedure is a
+      function: f(x, y) in an expression calls it, return e leaves e as its
+      result (0 if the body ends without return) and call f(x, y)
+      discards it. Arguments stay where the caller pushed them, above the
+      callee's frame, and RTN/RTV (OPR n 0 / OPR n 12) pop them
+    - --lift replaces the static link walk of LOD/STO: globals are
+      reached with LDA/STA 0 M (offset M of main's frame, no walk), and a
+      scalar local of a procedure that is neither recursive nor run by
+      COB, is set before it is read on every call and is used by the
+      procedures nested in it moves into main's frame as well. Outputs and
+      instruction counts are unchanged; arrays and --object builds are not
+      lifted
+    - module name; followed by declarations (no main, ends with .) is a
+      separately compiled unit. extern var x, a[n]; and
+      extern procedure f(a, b); at the start of any unit name globals and
+      procedures of other units. Both need --object; linker.c joins the
+      objects into elf.txt, putting every unit's globals in main's frame
     - Generates PM/0 assembly code (see Appendix A for ISA)
     - VM must support EVEN instruction (OPR 0 11)
     - All development and testing performed on Eustis
@@ -39,34 +98,47 @@ Due Date: Friday, November 21, 2025 at 11:59 PM ET
 */
 
 // Libraries
+#define _GNU_SOURCE // clock_gettime and perf_event_open for --stats
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
+#include <setjmp.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "phase_stats.h"
+#include "lexer.h"
 
 // Constants
 #define MAX_SYMBOL_TABLE_SIZE 500
 #define MAX_CODE_LENGTH 1000
-#define MAX_TOKENS 1000
 #define MAX_IDENT_LEN 12
 #define MAX_NUMBER_LEN 5
 #define TOKEN_FILENAME "tokens.txt"
 #define CODE_FILENAME "elf.txt"
+#define POSITION_FILENAME "tokens.pos" // written by lex --debug
+#define DEBUG_FILENAME "elf.dbg"
+#define PAS_SIZE 500 // must match vm.c, used by the C translation
+#define TOP (PAS_SIZE - 1) // address of the first instruction
 
 // Enum Definitions
-enum token_type {
-    skipsym = 1, identsym, numbersym, plussym, minussym,
-    multsym, slashsym, eqlsym, neqsym,
-    lessym, leqsym, gtrsym, geqsym, lparentsym,
-    rparentsym, commasym, semicolonsym, periodsym, becomessym,
-    beginsym, endsym, ifsym, fisym, thensym, whilesym,
-    dosym, callsym, constsym, varsym, procsym,
-    writesym, readsym, elsesym, evensym
-};
-
 enum opcode {
-    LIT = 1, OPR, LOD, STO, CAL, INC, JMP, JPC, SYS
+    LIT = 1, OPR, LOD, STO, CAL, INC, JMP, JPC, SYS, COB,
+    LDX, STX, CHK, // indexed load/store and array bounds check
+    LDA, STA       // load/store at offset M of main's frame, without a static link walk (--lift)
 };
 
+// OPR L M operations that return from a procedure; L is the number of
+// argument words the caller pushed, popped along with the frame
+#define RTN 0
+#define RTV 12 // RTN that leaves the top of the stack on the caller's stack
+
 enum symbol_kind {
     CONSTANT = 1, VARIABLE = 2, PROCEDURE = 3
 };
@@ -74,11 +146,16 @@ enum symbol_kind {
 // Struct Definitions
 typedef struct {
     int kind; // const = 1, var = 2, proc = 3
-    char name[MAX_IDENT_LEN]; // symbol name
+    int name; // interned name id
     int val; // value for constants
     int level; // scope level
     int addr; // address (or code index for procedures)
     int mark; // marked for deletion (0 = valid, 1 = invalid)
+    int size; // element count for arrays, 0 for scalars
+    int params; // procedures: parameter count, -1 without a parameter list (no result)
+    int end; // procedures: code index of the return closing the body
+    int external; // declared extern: defined by another unit, resolved by the linker
+    int lifted; // --lift: a procedure's variable moved into main's frame (addr is its offset there)
 } symbol;
 
 typedef struct {
@@ -88,48 +165,180 @@ typedef struct {
 } instruction;
 
 typedef struct {
-    int type; // token type
-    char name[MAX_IDENT_LEN]; // identifier name or number string
-    int value; // numeric value
+    int type;  // token type
+    int value; // name id for identifiers, numeric value for numbers
+    int line, col; // source position (0 unless read from tokens.pos)
 } token;
 
-// Global Variables
-instruction code[MAX_CODE_LENGTH];
-symbol sym_table[MAX_SYMBOL_TABLE_SIZE];
-int code_index = 0; // Next available code index
-int sym_index = 0;  // Next available symbol table index
-int token_list[10000]; // Array to hold all tokens
-char token_lexeme[10000][MAX_IDENT_LEN]; // Array to hold lexemes/values
-int token_count = 0; // Total tokens read
-int token_ptr = 0;   // Current token index
-int error_flag = 0;  // Flag to indicate an error has occurred
-FILE *code_file;     // File pointer for elf.txt
-
-// The current token's ID, lexeme/value, and numeric value (if applicable)
-int current_token;
-char current_lexeme[MAX_IDENT_LEN];
-int current_number_val; // For numbersym
+typedef struct {
+    int line, col;
+} source_position;
+
+// The parser's output: one tree per unit, allocated from an arena and
+// dropped with it. Statements and expressions share one node type
+enum node_kind {
+    // statements; pos is where they start
+    NODE_ASSIGN = 1, // sym := right, or sym[left] := right for an array
+    NODE_CALL,       // call sym(left...), the result discarded if it has one
+    NODE_RETURN,     // return left, popping value argument words
+    NODE_READ,       // read sym, or sym[left]
+    NODE_WRITE,      // write left
+    NODE_BEGIN,      // begin left... end
+    NODE_IF,         // if left then right else alt fi
+    NODE_WHILE,      // while left do right
+    NODE_COBEGIN,    // cobegin left... coend, each a NODE_CALL
+    // expressions
+    NODE_NUMBER,     // value; constants are replaced by their value
+    NODE_VARIABLE,   // sym
+    NODE_ELEMENT,    // sym[left]
+    NODE_FUNCTION,   // sym(left...), leaving the result
+    NODE_BINARY,     // left right OPR 0 value (ADD..DIV, EQL..GEQ)
+    NODE_EVEN        // left OPR 0 value (EVEN)
+};
+
+typedef struct node {
+    int kind;
+    union {
+        int sym;   // symbol of a variable, array or procedure
+        int value; // constant, OPR m of an operator, or parameters of a return
+    };
+    source_position pos;
+    struct node *left, *right, *alt;
+    struct node *next; // next statement of a begin, argument of a call, or call of a cobegin
+} node;
+
+// a procedure body, or main's
+typedef struct ast_block {
+    int proc;      // procedure symbol, -1 for main
+    int level;     // level of the body
+    int data_size; // words INC reserves
+    struct ast_block *procs; // first procedure declared in it
+    struct ast_block *next;  // next procedure declared at the same level
+    node *body;    // NULL if empty
+    int syms, sym_end; // symbols declared in it (parameters and nested procedures' included)
+    source_position start_pos, body_pos, end_pos; // main's JMP, the INC, the return
+} ast_block;
+
+// bump allocator: blocks are carved out of chunks that are only released
+// all at once (arena_reset keeps them for the next compilation)
+#define ARENA_CHUNK (64 * 1024)
+
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size, used;
+    max_align_t data[];
+} arena_chunk;
+
+typedef struct {
+    arena_chunk *first, *current;
+} arena;
+
+// --object: the unit is written as a relocatable object for the linker.
+// accesses to globals and calls to extern procedures are recorded as they
+// are emitted; JMP/JPC/CAL within the unit are found when it is written
+enum relocation_kind {
+    RELOC_DATA = 1, // global of this unit: M += where the linker puts its globals, less 3
+    RELOC_PROC,     // CAL to an extern procedure
+    RELOC_VAR       // access to an extern variable
+};
+
+typedef struct {
+    int index; // instruction whose M is patched
+    int kind;
+    int sym;   // symbol it refers to
+} relocation;
+
+// Everything one compilation reads and writes. Nothing else is modified
+// while compiling, so compilers on different threads do not interfere
+// (--batch); make one with new_compiler() and release it with free_compiler()
+typedef struct compiler {
+    // options
+    int bounds_check; // emit CHK before indexed accesses (--no-bounds-check)
+    int dead_code_elimination; // drop procedures main never calls (--dce)
+    const char *object_path; // --object
+    int debug_info; // --debug: keep the source position of each instruction
+    int memo; // --memo: write elf.memo
+    int fold_constants; // --const-fold
+    int lift; // --lift: globals and lifted variables are addressed with LDA/STA
+    int precompute; // --precompute: evaluate what runs before the first read
+    long long fuel; // --fuel: instructions --precompute may evaluate
+
+    instruction code[MAX_CODE_LENGTH];
+    symbol sym_table[MAX_SYMBOL_TABLE_SIZE];
+    int code_index; // Next available code index
+    int sym_index;  // Next available symbol table index
+    token *token_list; // All tokens, grown as they are read
+    int token_cap;
+    int token_count; // Total tokens read
+    int token_ptr;   // Current token index
+    int current_proc; // symbol of the procedure whose body is being parsed, -1 in main
+
+    relocation relocs[MAX_CODE_LENGTH];
+    int reloc_count;
+    int module_name;     // name id after "module", -1 for a program
+    int global_words;    // words of globals after SL/DL/RA
+    int main_inc_index;  // main's INC, which the linker sizes for all units' globals
+
+    int have_positions; // tokens carry source positions
+    char source_path[4096];
+    source_position code_pos[MAX_CODE_LENGTH];
+    source_position statement_pos; // innermost statement being parsed, line 0 outside one
+
+    // Interned identifier names: each distinct name is stored once in name_pool
+    char *name_pool;
+    int name_pool_used, name_pool_cap;
+    int *name_start; // pool offset of each name id
+    int name_count, name_cap;
+    int *name_hash;  // open addressing table of id + 1 (0 = empty)
+    int name_hash_cap;
+
+    // The current token's ID, name id (identsym), and numeric value (numbersym)
+    int current_token;
+    int current_name;
+    int current_number_val; // For numbersym
+    source_position current_pos;
+
+    // the parsed unit, code generation's input (see node)
+    arena ast;
+    ast_block *ast_root;
+    source_position halt_pos; // the "." ending main
+
+    // the first error stops the compilation: error() jumps back to compile()
+    int error_flag; // error code, 0 while there is none
+    source_position error_pos;
+    jmp_buf failure;
+} compiler;
 
 // Function Prototypes
-void read_token_list();
-void advance_token();
-void emit(int op, int l, int m);
-void error(int code);
-int find_symbol(const char *name, int level);
-int add_symbol(int kind, const char *name, int val, int level, int addr);
-void print_assembly_code();
-void print_symbol_table();
-void unmark_symbols_at_level(int level, int start_index);
-void program();
-void block(int level, int *data_size);
-void const_declaration(int level);
-void var_declaration(int level, int *data_size);
-void procedure_declaration(int level);
-void statement(int level);
-void condition(int level);
-void expression(int level);
-void term(int level);
-void factor(int level);
+int read_token_list(compiler *c);
+void advance_token(compiler *c);
+void emit(compiler *c, int op, int l, int m);
+void error(compiler *c, int code);
+int find_symbol(compiler *c, int name, int level);
+int add_symbol(compiler *c, int kind, int name, int val, int level, int addr);
+void print_assembly_code(compiler *c);
+void print_symbol_table(compiler *c);
+void unmark_symbols_at_level(compiler *c, int level, int start_index);
+void *arena_alloc(arena *a, size_t size);
+void program(compiler *c);
+ast_block *block(compiler *c, int level, int proc_idx, int *data_size);
+void const_declaration(compiler *c, int level);
+void var_declaration(compiler *c, int level, int *data_size);
+ast_block *procedure_declaration(compiler *c, int level);
+void extern_declaration(compiler *c, int level);
+void module_unit(compiler *c);
+int declaration_size(compiler *c, int var_idx);
+void parameter_list(compiler *c, int level, int proc_idx);
+node *call_arguments(compiler *c, int level, int sym_idx);
+node *statement(compiler *c, int level);
+node *condition(compiler *c, int level);
+node *expression(compiler *c, int level);
+node *term(compiler *c, int level);
+node *factor(compiler *c, int level);
+node *array_index(compiler *c, int level);
+void emit_call(compiler *c, int level, int sym_idx);
+void check_frames(compiler *c, ast_block *b, int stack_words);
+void generate_code(compiler *c);
 
 
 // helper to not spam index * 3
@@ -137,69 +346,206 @@ int code_address(int index) {
     return index * 3;
 }
 
-// Load tokens from "tokens.txt" into tokenList
-void read_token_list()
+// grows a dynamic array to hold at least need elements
+void *grow_array(void *array, int *cap, int need, size_t elem_size) {
+    if (need <= *cap) return array;
+    int new_cap = *cap ? *cap : 256;
+    while (new_cap < need) new_cap *= 2;
+    array = realloc(array, new_cap * elem_size);
+    if (!array) {
+        fprintf(stderr, "Error: out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    *cap = new_cap;
+    return array;
+}
+
+// returns size bytes from the current chunk, moving on to the next chunk
+// (or a new one) when it is full
+void *arena_alloc(arena *a, size_t size) {
+    size = (size + _Alignof(max_align_t) - 1) / _Alignof(max_align_t) * _Alignof(max_align_t);
+    arena_chunk *chunk = a->current;
+    while (!chunk || chunk->used + size > chunk->size) {
+        if (chunk && chunk->next) {
+            chunk = chunk->next; // kept by arena_reset
+            chunk->used = 0;
+            continue;
+        }
+        size_t bytes = size > ARENA_CHUNK ? size : ARENA_CHUNK;
+        arena_chunk *fresh = malloc(sizeof *fresh + bytes);
+        if (!fresh) {
+            fprintf(stderr, "Error: out of memory.\n");
+            exit(EXIT_FAILURE);
+        }
+        fresh->next = NULL;
+        fresh->size = bytes;
+        fresh->used = 0;
+        if (chunk) {
+            chunk->next = fresh;
+        } else {
+            a->first = fresh;
+        }
+        chunk = fresh;
+    }
+    a->current = chunk;
+    void *block = (char *)chunk->data + chunk->used;
+    chunk->used += size;
+    return block;
+}
+
+// frees everything allocated, keeping the chunks
+void arena_reset(arena *a) {
+    a->current = a->first;
+    if (a->first) a->first->used = 0;
+}
+
+void arena_free(arena *a) {
+    while (a->first) {
+        arena_chunk *next = a->first->next;
+        free(a->first);
+        a->first = next;
+    }
+    a->current = NULL;
+}
+
+const char *name_text(compiler *c, int id) {
+    return c->name_pool + c->name_start[id];
+}
+
+unsigned hash_name(const char *name) {
+    unsigned h = 2166136261u;
+    for (; *name; name++) h = (h ^ (unsigned char)*name) * 16777619u;
+    return h;
+}
+
+// returns the id of name, adding it to the pool on first use
+int intern_name(compiler *c, const char *name) {
+    if (c->name_count * 2 >= c->name_hash_cap) {
+        // rehash at half load
+        int old_cap = c->name_hash_cap;
+        int *old = c->name_hash;
+        c->name_hash_cap = old_cap ? old_cap * 2 : 256;
+        c->name_hash = calloc(c->name_hash_cap, sizeof(int));
+        if (!c->name_hash) {
+            fprintf(stderr, "Error: out of memory.\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < old_cap; i++) {
+            if (!old[i]) continue;
+            unsigned h = hash_name(name_text(c, old[i] - 1)) & (c->name_hash_cap - 1);
+            while (c->name_hash[h]) h = (h + 1) & (c->name_hash_cap - 1);
+            c->name_hash[h] = old[i];
+        }
+        free(old);
+    }
+    unsigned h = hash_name(name) & (c->name_hash_cap - 1);
+    while (c->name_hash[h]) {
+        if (strcmp(name_text(c, c->name_hash[h] - 1), name) == 0) return c->name_hash[h] - 1;
+        h = (h + 1) & (c->name_hash_cap - 1);
+    }
+    int len = (int)strlen(name);
+    c->name_pool = grow_array(c->name_pool, &c->name_pool_cap, c->name_pool_used + len + 1, 1);
+    c->name_start = grow_array(c->name_start, &c->name_cap, c->name_count + 1, sizeof(int));
+    memcpy(c->name_pool + c->name_pool_used, name, len + 1);
+    c->name_start[c->name_count] = c->name_pool_used;
+    c->name_pool_used += len + 1;
+    c->name_hash[h] = c->name_count + 1;
+    return c->name_count++;
+}
+
+// Load tokens from "tokens.txt" into token_list; returns 0 if it cannot be opened
+int read_token_list(compiler *c)
 {
     FILE *fp = fopen(TOKEN_FILENAME, "r");
     if (!fp) {
         fprintf(stderr, "Error: Could not open input file '%s'. Ensure 'lex.c' was run successfully.\n", TOKEN_FILENAME);
-        exit(EXIT_FAILURE);
+        return 0;
     }
-    token_count = 0;
+    c->token_count = 0;
 
     // Loop until we can't read another token ID
-    while (fscanf(fp, "%d", &token_list[token_count]) == 1) {
-        int token_id = token_list[token_count];
-        token_lexeme[token_count][0] = '\0'; // initialize
+    int token_id;
+    while (fscanf(fp, "%d", &token_id) == 1) {
+        c->token_list = grow_array(c->token_list, &c->token_cap, c->token_count + 1, sizeof(token));
+        c->token_list[c->token_count].type = token_id;
+        c->token_list[c->token_count].value = 0;
         if (token_id == identsym) {
-            if (fscanf(fp, "%s", token_lexeme[token_count]) != 1) {
-                fprintf(stderr, "Error: Expected identifier after identsym at token %d\n", token_count);
+            char name[64];
+            if (fscanf(fp, "%63s", name) != 1) {
+                fprintf(stderr, "Error: Expected identifier after identsym at token %d\n", c->token_count);
                 break;
             }
+            name[MAX_IDENT_LEN - 1] = '\0';
+            c->token_list[c->token_count].value = intern_name(c, name);
         }
         else if (token_id == numbersym) {
-            int num_val;
-            if (fscanf(fp, "%d", &num_val) != 1) {
-                fprintf(stderr, "Error: Expected number after numbersym at token %d\n", token_count);
+            if (fscanf(fp, "%d", &c->token_list[c->token_count].value) != 1) {
+                fprintf(stderr, "Error: Expected number after numbersym at token %d\n", c->token_count);
                 break;
             }
-            snprintf(token_lexeme[token_count], MAX_IDENT_LEN, "%d", num_val);
         }
-        token_count++;
-        if (token_count >= MAX_TOKENS) break;
+        c->token_count++;
+    }
+    fclose(fp);
+    return 1;
+}
+
+// --debug: attaches the positions in tokens.pos to the tokens just read.
+// a missing file or one written for a different token list is ignored
+void read_token_positions(compiler *c) {
+    FILE *fp = fopen(POSITION_FILENAME, "r");
+    if (!fp) {
+        fprintf(stderr, "Warning: '%s' not found (run lex --debug); no source positions.\n", POSITION_FILENAME);
+        return;
+    }
+    int count;
+    if (fscanf(fp, "source %4095[^\n] tokens %d", c->source_path, &count) != 2 || count != c->token_count) {
+        fprintf(stderr, "Warning: '%s' does not match '%s'; no source positions.\n", POSITION_FILENAME, TOKEN_FILENAME);
+        strcpy(c->source_path, "-");
+        fclose(fp);
+        return;
+    }
+    for (int i = 0; i < c->token_count; i++) {
+        if (fscanf(fp, "%d %d", &c->token_list[i].line, &c->token_list[i].col) != 2) {
+            fprintf(stderr, "Warning: '%s' is truncated; no source positions.\n", POSITION_FILENAME);
+            for (int j = 0; j < c->token_count; j++) c->token_list[j].line = c->token_list[j].col = 0;
+            fclose(fp);
+            return;
+        }
     }
     fclose(fp);
+    c->have_positions = 1;
 }
 
 // Advance to the next token in the token list
-void advance_token() {
-    if (error_flag) return;
-    if (token_ptr < token_count) {
-        current_token = token_list[token_ptr];
-        if (current_token == skipsym) {
-            error(1);
+void advance_token(compiler *c) {
+    if (c->error_flag) return;
+    if (c->token_ptr < c->token_count) {
+        c->current_token = c->token_list[c->token_ptr].type;
+        if (c->current_token == skipsym) {
+            error(c, 1);
             return;
         }
-        strncpy(current_lexeme, token_lexeme[token_ptr], MAX_IDENT_LEN);
-        current_lexeme[MAX_IDENT_LEN-1] = '\0';
-        if (current_token == numbersym) {
-            current_number_val = atoi(current_lexeme);
-        } else {
-            current_number_val = 0;
+        c->current_name = -1;
+        c->current_number_val = 0;
+        c->current_pos.line = c->token_list[c->token_ptr].line;
+        c->current_pos.col = c->token_list[c->token_ptr].col;
+        if (c->current_token == identsym) {
+            c->current_name = c->token_list[c->token_ptr].value;
+        } else if (c->current_token == numbersym) {
+            c->current_number_val = c->token_list[c->token_ptr].value;
         }
-        token_ptr++;
+        c->token_ptr++;
     } else {
-        current_token = skipsym;
-        strcpy(current_lexeme, "");
-        current_number_val = 0;
+        c->current_token = skipsym;
+        c->current_name = -1;
+        c->current_number_val = 0;
     }
 }
 
-// Error handling function
-void error(int code) {
-    if (error_flag) return;
-    error_flag = 1;
-    char *msg;
+// text of an error code
+const char *error_message(int code) {
+    const char *msg;
     switch (code) {
         case 1: msg = "Error: Scanning error detected by lexer (skipsym present)"; break;
         case 2: msg = "Error: const, var, read, procedure, and call keywords must be followed by identifier"; break;
@@ -221,442 +567,2640 @@ void error(int code) {
         case 18: msg = "Error: call statement may only target procedures"; break;
         case 19: msg = "Error: procedure declaration must be followed by a semicolon"; break;
         case 20: msg = "Error: program must end with period"; break;
+        case 21: msg = "Error: cobegin may only contain call statements"; break;
+        case 22: msg = "Error: cobegin must be followed by coend"; break;
+        case 23: msg = "Error: array size must be a positive integer"; break;
+        case 24: msg = "Error: right bracket must follow left bracket"; break;
+        case 25: msg = "Error: array variables must be indexed"; break;
+        case 26: msg = "Error: only array variables may be indexed"; break;
+        case 27: msg = "Error: return may only appear in a procedure with a parameter list"; break;
+        case 28: msg = "Error: call must pass one argument per parameter, in parentheses"; break;
+        case 29: msg = "Error: only procedures with a parameter list return a value"; break;
+        case 30: msg = "Error: cobegin may only call procedures without a parameter list"; break;
+        case 31: msg = "Error: extern must be followed by var or procedure"; break;
+        case 32: msg = "Error: modules and extern declarations must be compiled with --object"; break;
+        case 33: msg = "Error: module name must be followed by a semicolon"; break;
+        case 34: msg = "Error: Code array overflow"; break;
+        case 35: msg = "Error: Symbol table overflow"; break;
+        case 36: msg = "Error: variables do not fit in the stack left by the code"; break;
         default: msg = "Error: Unknown error occurred"; break;
     }
-    fprintf(stderr, "%s\n", msg);
-    fprintf(code_file, "%s\n", msg);
-    fclose(code_file);
-    exit(EXIT_SUCCESS);
+    return msg;
+}
+
+// Error handling function: records the error at the current token and
+// abandons the compilation, returning from compile()
+void error(compiler *c, int code) {
+    if (!c->error_flag) {
+        c->error_flag = code;
+        c->error_pos = c->current_pos;
+    }
+    longjmp(c->failure, 1);
 }
 
 // function to emit instructions
-void emit(int op, int l, int m) {
-    if (code_index >= MAX_CODE_LENGTH) {
-        fprintf(stderr, "Error: Code array overflow.\n");
-        exit(EXIT_FAILURE);
+void emit(compiler *c, int op, int l, int m) {
+    if (c->code_index >= MAX_CODE_LENGTH) {
+        error(c, 34);
     }
 
     // Add instruction to code array
-    code[code_index].op = op;
-    code[code_index].l  = l;
-    code[code_index].m  = m;
-    code_index++; // increment code index
+    c->code[c->code_index].op = op;
+    c->code[c->code_index].l  = l;
+    c->code[c->code_index].m  = m;
+    // code belongs to the statement being parsed, or to the current token
+    // (INC, RTN, the main JMP and the halt) outside statements
+    c->code_pos[c->code_index] = c->statement_pos.line ? c->statement_pos : c->current_pos;
+    c->code_index++; // increment code index
 }
 
 // function to print assembly code
-void print_assembly_code() {
+void print_assembly_code(compiler *c) {
     // mnemonic def for opcodes
-    char *opname[] = {"", "LIT", "OPR", "LOD", "STO", "CAL", "INC", "JMP", "JPC", "SYS"};
+    char *opname[] = {"", "LIT", "OPR", "LOD", "STO", "CAL", "INC", "JMP", "JPC", "SYS", "COB",
+                      "LDX", "STX", "CHK", "LDA", "STA"};
     // Print assembly code header
     printf("\nAssembly Code:\n");
     printf("Line\tOP\tL\tM\n");
     // loop through code array and print instructions
-    for (int i = 0; i < code_index; i++) {
-        printf("%d\t%s\t%d\t%d\n", i, opname[code[i].op], code[i].l, code[i].m);
+    for (int i = 0; i < c->code_index; i++) {
+        printf("%d\t%s\t%d\t%d\n", i, opname[c->code[i].op], c->code[i].l, c->code[i].m);
     }
 }
 
 // function to print symbol table
-void print_symbol_table() {
+void print_symbol_table(compiler *c) {
     // symbol table header
     printf("\nSymbol Table:\n");
     printf("Kind | Name        | Value | Level | Address | Mark\n");
     printf("--------------------------------------------------\n");
     //loop through symbol table and print entries
-    for (int i = 0; i < sym_index; i++) {
+    for (int i = 0; i < c->sym_index; i++) {
         printf("%d    | %-11s | %5d | %5d | %7d | %4d\n",
-               sym_table[i].kind, sym_table[i].name, sym_table[i].val,
-               sym_table[i].level, sym_table[i].addr, sym_table[i].mark);
+               c->sym_table[i].kind, name_text(c, c->sym_table[i].name), c->sym_table[i].val,
+               c->sym_table[i].level, c->sym_table[i].addr, c->sym_table[i].mark);
     }
 }
 
 // function to mark symbols from a specific level as out-of-scope
-void unmark_symbols_at_level(int level, int start_index) {
-    for (int i = start_index; i < sym_index; i++) {
-        if (sym_table[i].level == level) {
-            sym_table[i].mark = 1; // Mark as out of scope
+void unmark_symbols_at_level(compiler *c, int level, int start_index) {
+    for (int i = start_index; i < c->sym_index; i++) {
+        if (c->sym_table[i].level == level) {
+            c->sym_table[i].mark = 1; // Mark as out of scope
         }
     }
 }
 
 // writes to elf.txt
-void write_code_to_file() {
+void write_code_to_file(compiler *c, FILE *code_file) {
     // loop through code array and write instructions elf.txt
-    for (int i = 0; i < code_index; i++) {
-        fprintf(code_file, "%d %d %d\n", code[i].op, code[i].l, code[i].m);
+    for (int i = 0; i < c->code_index; i++) {
+        fprintf(code_file, "%d %d %d\n", c->code[i].op, c->code[i].l, c->code[i].m);
     }
 }
 
-// function to find symbol in symbol table, respecting scope
-int find_symbol(const char *name, int level) {
-    (void)level; // level currently unused, but kept for signature compatibility
-    for (int i = sym_index - 1; i >= 0; i--) {
-        if (strcmp(sym_table[i].name, name) == 0 && sym_table[i].mark == 0) {
-            return i;
-        }
+// the relocation recorded for an instruction, -1 if none
+int relocation_at(compiler *c, int index) {
+    for (int i = 0; i < c->reloc_count; i++) {
+        if (c->relocs[i].index == index) return i;
     }
-    return -1; // not found
+    return -1;
 }
 
-// function to add symbol to symbol table
-int add_symbol(int kind, const char *name, int val, int level, int addr) {
-    // overflow
-    if (sym_index >= MAX_SYMBOL_TABLE_SIZE) {
-        fprintf(stderr, "Error: Symbol table overflow.\n");
-        return -1;
+// --object: writes the unit in place of elf.txt, for the linker:
+//     pm0-object 1
+//     unit program | unit module <name>
+//     code <n>                        then n lines "op l m", addresses
+//                                     relative to the unit's first instruction
+//     data <words>                    globals after SL/DL/RA
+//     exports <k>                     then k of
+//         proc <name> <index> <params>    (params -1: no parameter list)
+//         var <name> <offset> <size>      (offset from 3, size 0: scalar)
+//     relocs <r>                      then r of
+//         <index> code                M += 3 * unit's first instruction
+//         <index> data                M += unit's first global - 3
+//         <index> frame               main's INC: M = 3 + all units' globals
+//         <index> proc <name> <params>    M = address of the procedure
+//         <index> var <name> <size>       M += address of the variable
+void write_object(compiler *c, FILE *code_file) {
+    int exports = 0, code_relocs = 0;
+    for (int i = 0; i < c->sym_index; i++) {
+        if (c->sym_table[i].level == 0 && !c->sym_table[i].external && c->sym_table[i].kind != CONSTANT) exports++;
+    }
+    for (int i = 0; i < c->code_index; i++) {
+        int op = c->code[i].op;
+        if ((op == JMP || op == JPC || op == CAL) && relocation_at(c, i) < 0) code_relocs++;
     }
 
-    // check for duplicate in current scope
-    for (int i = sym_index - 1; i >= 0; i--) {
-        if (sym_table[i].level < level) break; // Exited current scope
-        if (strcmp(sym_table[i].name, name) == 0 && sym_table[i].mark == 0) {
-            error(3); // duplicate symbol
-            return -1;
+    fprintf(code_file, "pm0-object 1\n");
+    if (c->module_name >= 0) {
+        fprintf(code_file, "unit module %s\n", name_text(c, c->module_name));
+    } else {
+        fprintf(code_file, "unit program\n");
+    }
+    fprintf(code_file, "code %d\n", c->code_index);
+    write_code_to_file(c, code_file);
+    fprintf(code_file, "data %d\n", c->global_words);
+    fprintf(code_file, "exports %d\n", exports);
+    for (int i = 0; i < c->sym_index; i++) {
+        symbol *sym = &c->sym_table[i];
+        if (sym->level != 0 || sym->external) continue;
+        if (sym->kind == PROCEDURE) {
+            fprintf(code_file, "proc %s %d %d\n", name_text(c, sym->name), sym->addr, sym->params);
+        } else if (sym->kind == VARIABLE) {
+            fprintf(code_file, "var %s %d %d\n", name_text(c, sym->name), sym->addr - 3, sym->size);
+        }
+    }
+    fprintf(code_file, "relocs %d\n", c->reloc_count + code_relocs + (c->main_inc_index >= 0));
+    for (int i = 0; i < c->code_index; i++) {
+        int r = relocation_at(c, i);
+        if (r >= 0) {
+            symbol *sym = &c->sym_table[c->relocs[r].sym];
+            if (c->relocs[r].kind == RELOC_DATA) {
+                fprintf(code_file, "%d data\n", i);
+            } else if (c->relocs[r].kind == RELOC_PROC) {
+                fprintf(code_file, "%d proc %s %d\n", i, name_text(c, sym->name), sym->params);
+            } else {
+                fprintf(code_file, "%d var %s %d\n", i, name_text(c, sym->name), sym->size);
+            }
+        } else if (c->code[i].op == JMP || c->code[i].op == JPC || c->code[i].op == CAL) {
+            fprintf(code_file, "%d code\n", i);
+        } else if (i == c->main_inc_index) {
+            fprintf(code_file, "%d frame\n", i);
         }
     }
-
-    // add symbol to table
-    sym_table[sym_index].kind = kind;
-    strncpy(sym_table[sym_index].name, name, MAX_IDENT_LEN);
-    sym_table[sym_index].name[MAX_IDENT_LEN - 1] = '\0';
-    sym_table[sym_index].val   = val;
-    sym_table[sym_index].level = level;
-    sym_table[sym_index].addr  = addr; // note: for procedures this is a *code index*
-    sym_table[sym_index].mark  = 0;    // Mark as valid (in scope)
-    return sym_index++; // increment symbol index upon return
 }
 
+// code index an instruction transfers control to, or -1 if it is not a valid instruction address
+int jump_target_index(compiler *c, int m) {
+    if (m < 0 || m % 3 != 0 || m / 3 > c->code_index) return -1;
+    return m / 3;
+}
 
-// GRAMMAR DEFINITIONS AND PARSING FUNCTIONS
-
-void program() {
-    int data_size; // initialize data size
-    block(0, &data_size); // parse main block at level 0
-    // ensure program ends with period
-    if (current_token != periodsym) {
-        error(20);
+// index of the return closing the body that starts at index start
+// (main's body runs to the end of the code)
+int body_end_index(compiler *c, int start) {
+    for (int i = 0; i < c->sym_index; i++) {
+        if (c->sym_table[i].kind == PROCEDURE && c->sym_table[i].addr == start) return c->sym_table[i].end;
     }
-    emit(SYS, 0, 3); // halt instruction
+    return c->code_index - 1;
 }
 
-void block(int level, int *data_size) {
-    *data_size = 3; // reserve space for static link, dynamic link, return address
-    int start_sym_index = sym_index;
-    int jmp_addr = code_index;
+// drops procedure bodies that no CAL reachable from main can get to (see --dce)
+// the call graph is walked from main's JMP target; every surviving JMP, JPC
+// and CAL is rewritten to its new code address. returns instructions removed
+int eliminate_dead_procedures(compiler *c) {
+    int proc_sym[MAX_CODE_LENGTH]; // procedure symbol starting at an index, or -1
+    int keep[MAX_CODE_LENGTH];
+    int new_index[MAX_CODE_LENGTH + 1];
+    int worklist[MAX_CODE_LENGTH + 1]; // one entry per CAL at most
+    int pending = 0, old_length = c->code_index;
 
-    if (level == 0) {
-        emit(JMP, 0, 0); // Placeholder for main
+    for (int i = 0; i < c->code_index; i++) {
+        proc_sym[i] = -1;
+        keep[i] = 0;
+    }
+    for (int i = 0; i < c->sym_index; i++) {
+        if (c->sym_table[i].kind == PROCEDURE && c->sym_table[i].addr >= 0) proc_sym[c->sym_table[i].addr] = i;
     }
 
-    const_declaration(level);
-    var_declaration(level, data_size);
-    procedure_declaration(level);
+    // the main JMP and main's body are always live
+    keep[0] = 1;
+    worklist[pending++] = jump_target_index(c, c->code[0].m);
+    while (pending > 0) {
+        int start = worklist[--pending];
+        if (start < 0 || start >= c->code_index || keep[start]) continue;
+        int end = body_end_index(c, start);
+        for (int i = start; i <= end; i++) {
+            keep[i] = 1;
+            if (c->code[i].op == CAL) {
+                int target = jump_target_index(c, c->code[i].m);
+                if (target >= 0 && target < c->code_index && !keep[target]) worklist[pending++] = target;
+            }
+        }
+    }
 
-    if (level == 0) {
-        // patch main JMP with VM code address
-        code[jmp_addr].m = code_address(code_index); // start of main
+    // compact the kept instructions and remap addresses
+    int length = 0;
+    for (int i = 0; i < c->code_index; i++) {
+        new_index[i] = length;
+        if (keep[i]) {
+            c->code_pos[length] = c->code_pos[i];
+            c->code[length++] = c->code[i];
+        }
+    }
+    new_index[c->code_index] = length;
+    for (int i = 0; i < length; i++) {
+        if (c->code[i].op == JMP || c->code[i].op == JPC || c->code[i].op == CAL) {
+            c->code[i].m = code_address(new_index[jump_target_index(c, c->code[i].m)]);
+        }
+    }
+    for (int i = 0; i < c->code_index; i++) {
+        if (proc_sym[i] >= 0) {
+            symbol *proc = &c->sym_table[proc_sym[i]];
+            proc->addr = keep[i] ? new_index[i] : -1;
+            proc->end = keep[i] ? new_index[proc->end] : -1;
+        }
     }
+    c->code_index = length;
+    return old_length - length;
+}
 
-    emit(INC, 0, *data_size); // allocate space for variables
-    statement(level);
+// --precompute: runs the program at compile time and replaces the part of
+// the run that reads no input with code that recreates its effect. The
+// evaluator below follows vm's execute over a PAS laid out as vm lays it
+// out for this code, and stops at the first read (SYS 0 2) or COB, at a
+// runtime error, at the halt, or when its fuel (--fuel instructions) runs
+// out. A program that halts is replaced by its outputs and final frame;
+// otherwise the last point at which main's frame was running, before the
+// read, becomes the resume point: code appended after the halt writes the
+// outputs so far, stores the words of main's frame and the stack left
+// below it (the leftovers that uninitialized locals read), and jumps
+// there. Errors and fuel exhaustion leave the code as it was. The report
+// names what stopped the evaluation, so --precompute can say so
+#define PRECOMPUTE_FUEL 10000000 // default --fuel
 
-    unmark_symbols_at_level(level, start_sym_index);
+enum evaluation_stop {
+    EVAL_HALT = 1, // SYS 0 3
+    EVAL_INPUT,    // the next instruction is a read or a COB
+    EVAL_FUEL,     // the instruction limit was reached
+    EVAL_ERROR     // a runtime error (or an access vm would not make)
+};
 
-    if (level > 0) {
-        emit(OPR, 0, 0); // RTN (Return from procedure)
+typedef struct {
+    int pas[PAS_SIZE];
+    char link[PAS_SIZE]; // the word is a stack address (a static or dynamic link, or a copy)
+    int floor;           // first word of the code; the stack is below it
+    int pc, bp, sp;      // pc is a code index
+    int outputs[MAX_CODE_LENGTH];
+    int output_count;    // may exceed MAX_CODE_LENGTH, then outputs holds the first ones
+    long long steps;     // instructions run
+    long long main_step; // steps before the last instruction fetched in main's frame
+} evaluation;
+
+enum precompute_outcome {
+    FOLD_PROGRAM = 1, // halted: the code is replaced by the outputs and final frame
+    FOLD_PREFIX,      // stopped before input: main starts from the state reached
+    FOLD_NOTHING,     // the first read or COB comes before any work worth folding
+    FOLD_FUEL,
+    FOLD_ERROR,
+    FOLD_TOO_LARGE    // the folded code would not fit in the PAS with its stack
+};
+
+typedef struct {
+    int outcome;
+    long long steps; // instructions evaluated (and saved at run time)
+    int outputs;
+    int resume;      // code index the folded run continues at (FOLD_PREFIX)
+    int added;       // instructions the folded code adds (or removes, if negative)
+    const char *input; // "read" or "COB": the instruction evaluation stopped at, if any
+    long long input_step; // instructions run before it
+} precompute_report;
+
+int in_stack(evaluation *e, int addr) {
+    return addr >= 0 && addr < e->floor;
+}
+
+// address l static links down from bp, or -1 if a link leaves the stack
+int evaluation_base(evaluation *e, int bp, int l) {
+    while (l-- > 0) {
+        if (!in_stack(e, bp)) return -1;
+        bp = e->pas[bp];
     }
+    return in_stack(e, bp) ? bp : -1;
 }
 
-void const_declaration(int level) {
-    if (current_token == constsym) {
-        advance_token();
-        // process constant declarations
-        do {
-            if (current_token != identsym) {
-                error(2);
+// runs c's code from the start for at most limit instructions
+int evaluate(compiler *c, evaluation *e, long long limit) {
+    memset(e, 0, sizeof *e);
+    e->floor = PAS_SIZE - 3 * c->code_index;
+    e->bp = e->floor - 1;
+    e->sp = e->floor;
+    int main_bp = e->bp;
+    int *pas = e->pas;
+    char *link = e->link;
+    for (; e->steps < limit; e->steps++) {
+        if (e->pc < 0 || e->pc >= c->code_index) return EVAL_ERROR;
+        instruction ins = c->code[e->pc];
+        if (e->bp == main_bp) e->main_step = e->steps;
+        if ((ins.op == SYS && ins.m == 2) || ins.op == COB) return EVAL_INPUT;
+        e->pc++;
+        int sp = e->sp, frame, addr, value;
+        if (ins.op != LIT && ins.op != INC && ins.op != JMP && ins.op != CAL && !in_stack(e, sp)) return EVAL_ERROR;
+        switch (ins.op) {
+        case LIT:
+            if (!in_stack(e, sp - 1)) return EVAL_ERROR;
+            pas[--e->sp] = ins.m;
+            link[e->sp] = 0;
+            break;
+        case OPR:
+            if (ins.m == RTN || ins.m == RTV) {
+                int bp = e->bp, ra;
+                if (!in_stack(e, bp - 2)) return EVAL_ERROR;
+                value = pas[sp];
+                char value_link = link[sp];
+                ra = TOP - pas[bp - 2];
+                if (ra < 0 || ra % 3 != 0) return EVAL_ERROR;
+                e->pc = ra / 3;
+                e->bp = pas[bp - 1];
+                if (ins.m == RTN) {
+                    e->sp = bp + 1 + ins.l;
+                } else {
+                    e->sp = bp + ins.l;
+                    if (!in_stack(e, e->sp)) return EVAL_ERROR;
+                    pas[e->sp] = value;
+                    link[e->sp] = value_link;
+                }
+                break;
+            }
+            if (ins.m == 11) { // EVEN
+                pas[sp] = pas[sp] % 2 == 0;
+                link[sp] = 0;
+                break;
             }
-            char ident_name[MAX_IDENT_LEN];
-            strcpy(ident_name, current_lexeme);
-            advance_token();
-            if (current_token != eqlsym) {
-                error(4);
+            if (ins.m < 1 || ins.m > 10 || !in_stack(e, sp + 1)) return EVAL_ERROR;
+            {
+                // vm's int arithmetic, wrapping as it does
+                unsigned a = (unsigned)pas[sp + 1], b = (unsigned)pas[sp];
+                int x = pas[sp + 1], y = pas[sp];
+                switch (ins.m) {
+                case 1: value = (int)(a + b); break;
+                case 2: value = (int)(a - b); break;
+                case 3: value = (int)(a * b); break;
+                case 4:
+                    if (y == 0 || (x == -2147483647 - 1 && y == -1)) return EVAL_ERROR; // a runtime error in the vm
+                    value = x / y;
+                    break;
+                case 5: value = x == y; break;
+                case 6: value = x != y; break;
+                case 7: value = x < y; break;
+                case 8: value = x <= y; break;
+                case 9: value = x > y; break;
+                default: value = x >= y; break;
+                }
             }
-            advance_token();
-            if (current_token != numbersym) {
-                error(5);
+            pas[++e->sp] = value;
+            link[e->sp] = 0;
+            break;
+        case LOD:
+            frame = evaluation_base(e, e->bp, ins.l);
+            addr = frame - ins.m;
+            if (frame < 0 || !in_stack(e, addr) || !in_stack(e, sp - 1)) return EVAL_ERROR;
+            pas[--e->sp] = pas[addr];
+            link[e->sp] = link[addr];
+            break;
+        case STO:
+            frame = evaluation_base(e, e->bp, ins.l);
+            addr = frame - ins.m;
+            if (frame < 0 || !in_stack(e, addr)) return EVAL_ERROR;
+            pas[addr] = pas[sp];
+            link[addr] = link[sp];
+            e->sp++;
+            break;
+        case CAL:
+            frame = evaluation_base(e, e->bp, ins.l);
+            if (frame < 0 || !in_stack(e, sp - 3) || jump_target_index(c, ins.m) < 0) return EVAL_ERROR;
+            pas[sp - 1] = frame;  // SL
+            pas[sp - 2] = e->bp;  // DL
+            pas[sp - 3] = TOP - 3 * e->pc; // RA, as vm writes it
+            link[sp - 1] = link[sp - 2] = 1;
+            link[sp - 3] = 0;
+            e->bp = sp - 1;
+            e->pc = jump_target_index(c, ins.m);
+            break;
+        case INC:
+            e->sp -= ins.m;
+            if (!in_stack(e, e->sp) && e->sp != e->floor) return EVAL_ERROR;
+            break;
+        case JMP:
+            e->pc = jump_target_index(c, ins.m);
+            break;
+        case JPC:
+            if (pas[sp] == 0) e->pc = jump_target_index(c, ins.m);
+            e->sp++;
+            break;
+        case SYS:
+            if (ins.m == 3) {
+                e->steps++;
+                return EVAL_HALT;
             }
-            int val = current_number_val;
-            add_symbol(CONSTANT, ident_name, val, level, 0);
-            advance_token();
-        } while (current_token == commasym && (advance_token(), 1));
-        if (current_token != semicolonsym) {
-            error(6);
+            if (ins.m != 1) return EVAL_ERROR;
+            if (e->output_count < MAX_CODE_LENGTH) e->outputs[e->output_count] = pas[sp];
+            e->output_count++;
+            e->sp++;
+            break;
+        case LDX:
+            frame = evaluation_base(e, e->bp, ins.l);
+            addr = frame - ins.m - pas[sp];
+            if (frame < 0 || !in_stack(e, addr)) return EVAL_ERROR;
+            pas[sp] = pas[addr];
+            link[sp] = link[addr];
+            break;
+        case STX:
+            if (!in_stack(e, sp + 1)) return EVAL_ERROR;
+            frame = evaluation_base(e, e->bp, ins.l);
+            addr = frame - ins.m - pas[sp + 1];
+            if (frame < 0 || !in_stack(e, addr)) return EVAL_ERROR;
+            pas[addr] = pas[sp];
+            link[addr] = link[sp];
+            e->sp += 2;
+            break;
+        case CHK:
+            if (pas[sp] < 0 || pas[sp] >= ins.m) return EVAL_ERROR;
+            break;
+        case LDA:
+            addr = e->floor - 1 - ins.m;
+            if (!in_stack(e, addr) || !in_stack(e, sp - 1)) return EVAL_ERROR;
+            pas[--e->sp] = pas[addr];
+            link[e->sp] = link[addr];
+            break;
+        case STA:
+            addr = e->floor - 1 - ins.m;
+            if (!in_stack(e, addr)) return EVAL_ERROR;
+            pas[addr] = pas[sp];
+            link[addr] = link[sp];
+            e->sp++;
+            break;
+        default:
+            return EVAL_ERROR;
         }
-        advance_token();
     }
+    return EVAL_FUEL;
 }
 
-void var_declaration(int level, int *data_size) {
-    // Handle variable declarations
-    if (current_token == varsym) {
-        advance_token();
-        do {
-            if (current_token != identsym) {
-                error(2);
+// appends an instruction made by the fold, which has no source position
+void fold_emit(compiler *c, int op, int l, int m) {
+    c->code[c->code_index] = (instruction){op, l, m};
+    c->code_pos[c->code_index].line = c->code_pos[c->code_index].col = 0;
+    c->code_index++;
+}
+
+// a stack word the fold has to recreate (a link is moved even if it is 0)
+int word_is_set(evaluation *e, int addr) {
+    return e->pas[addr] != 0 || e->link[addr];
+}
+
+// the value of a stack word once the code floor has moved by shift words
+int shifted_word(evaluation *e, int addr, int shift) {
+    return e->link[addr] ? e->pas[addr] + shift : e->pas[addr];
+}
+
+// evaluates c's program and folds what ran before its first read (see
+// above). fuel is the instruction limit; the outcome goes to report
+void precompute(compiler *c, long long fuel, precompute_report *report) {
+    memset(report, 0, sizeof *report);
+    if (3 * c->code_index >= PAS_SIZE) {
+        report->outcome = FOLD_TOO_LARGE;
+        return;
+    }
+    evaluation *e = malloc(sizeof *e);
+    if (!e) {
+        fprintf(stderr, "Error: out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    int stop = evaluate(c, e, fuel);
+    report->steps = e->steps;
+    if (stop == EVAL_FUEL || stop == EVAL_ERROR) {
+        report->outcome = stop == EVAL_FUEL ? FOLD_FUEL : FOLD_ERROR;
+        free(e);
+        return;
+    }
+    if (stop == EVAL_INPUT) {
+        report->input = c->code[e->pc].op == COB ? "COB" : "read";
+        report->input_step = e->steps;
+        // run again up to the point main last had control, where only
+        // main's frame is live
+        long long resume_step = e->main_step;
+        evaluate(c, e, resume_step);
+        report->steps = e->steps;
+    }
+    report->outputs = e->output_count;
+    int main_bp = e->floor - 1;
+    if (e->bp != main_bp) { // a halt outside main, which the compiler does not emit
+        report->outcome = FOLD_NOTHING;
+        free(e);
+        return;
+    }
+
+    // the words to store: main's frame (temporaries included) and, for a
+    // prefix, the leftovers below it down to the lowest one that is set
+    int low = e->sp;
+    for (int addr = 0; stop == EVAL_INPUT && addr < e->sp; addr++) {
+        if (word_is_set(e, addr)) {
+            low = addr;
+            break;
+        }
+    }
+    int stores = 0;
+    for (int addr = e->sp; addr <= main_bp; addr++) stores += word_is_set(e, addr);
+    int folded = 2 + 2 * e->output_count + 2 * stores; // JMP main and INC first
+    if (stop == EVAL_INPUT) {
+        folded += e->sp - low + (e->sp > low) + 1; // leftovers, INC back up, JMP to resume
+    } else {
+        folded += 1; // the halt
+    }
+    int length = stop == EVAL_HALT ? folded : c->code_index + folded - 1; // code[0] is reused
+    report->added = length - c->code_index;
+    // the stack the evaluated part used, and a word for the LITs, must still fit
+    if (e->output_count > MAX_CODE_LENGTH || 3 * length + (e->floor - low) + 1 > PAS_SIZE) {
+        report->outcome = FOLD_TOO_LARGE;
+        free(e);
+        return;
+    }
+    if (stop == EVAL_INPUT && report->steps <= folded) {
+        report->outcome = FOLD_NOTHING;
+        free(e);
+        return;
+    }
+
+    // main's frame moves with the code floor, and with it every link
+    int shift = -3 * report->added;
+    if (stop == EVAL_HALT) {
+        c->code_index = 1;
+        c->code[0].m = code_address(1);
+        for (int i = 0; i < c->sym_index; i++) {
+            if (c->sym_table[i].kind == PROCEDURE && !c->sym_table[i].external) {
+                c->sym_table[i].addr = c->sym_table[i].end = -1;
             }
-            add_symbol(VARIABLE, current_lexeme, 0, level, *data_size);
-            (*data_size)++;
-            advance_token();
-        } while (current_token == commasym && (advance_token(), 1));
-        if (current_token != semicolonsym) {
-            error(6);
         }
-        advance_token();
+    } else {
+        report->resume = e->pc;
+        c->code[0].m = code_address(c->code_index);
+    }
+    c->main_inc_index = c->code_index;
+    fold_emit(c, INC, 0, main_bp + 1 - e->sp);
+    for (int i = 0; i < e->output_count; i++) {
+        fold_emit(c, LIT, 0, e->outputs[i]);
+        fold_emit(c, SYS, 0, 1);
+    }
+    for (int addr = main_bp; addr >= e->sp; addr--) {
+        if (!word_is_set(e, addr)) continue;
+        fold_emit(c, LIT, 0, shifted_word(e, addr, shift));
+        fold_emit(c, STO, 0, main_bp - addr);
+    }
+    if (stop == EVAL_HALT) {
+        fold_emit(c, SYS, 0, 3);
+        report->outcome = FOLD_PROGRAM;
+    } else {
+        // pushed and popped again, which leaves them below SP
+        for (int addr = e->sp - 1; addr >= low; addr--) fold_emit(c, LIT, 0, shifted_word(e, addr, shift));
+        if (e->sp > low) fold_emit(c, INC, 0, low - e->sp);
+        fold_emit(c, JMP, 0, code_address(e->pc));
+        report->outcome = FOLD_PREFIX;
     }
+    free(e);
 }
 
-void procedure_declaration(int level) {
-    while (current_token == procsym) {
-        advance_token();
-        if (current_token != identsym) {
-            error(2);
+// --debug: writes elf.dbg, the source position of every instruction in
+// elf.txt and the instruction range of each procedure body:
+//     pm0-debug 1
+//     source <path of the PL/0 source, or ->
+//     code <n>
+//     <line> <col>            (n lines, one per instruction, 0 0 if unknown)
+//     procs <k>
+//     <name> <first> <last>   (k lines; main, listed last, spans all the code,
+//                              so an instruction belongs to the first range
+//                              that contains it)
+int write_debug_info(compiler *c) {
+    FILE *fp = fopen(DEBUG_FILENAME, "w");
+    if (!fp) {
+        fprintf(stderr, "Error: Could not open output file '%s'.\n", DEBUG_FILENAME);
+        return 1;
+    }
+    fprintf(fp, "pm0-debug 1\nsource %s\ncode %d\n", c->source_path, c->code_index);
+    for (int i = 0; i < c->code_index; i++) {
+        fprintf(fp, "%d %d\n", c->code_pos[i].line, c->code_pos[i].col);
+    }
+    int procs = 1;
+    for (int i = 0; i < c->sym_index; i++) {
+        if (c->sym_table[i].kind == PROCEDURE && c->sym_table[i].addr >= 0) procs++;
+    }
+    fprintf(fp, "procs %d\n", procs);
+    for (int i = 0; i < c->sym_index; i++) {
+        if (c->sym_table[i].kind == PROCEDURE && c->sym_table[i].addr >= 0) {
+            fprintf(fp, "%s %d %d\n", name_text(c, c->sym_table[i].name), c->sym_table[i].addr,
+                    body_end_index(c, c->sym_table[i].addr));
         }
-        char proc_name[MAX_IDENT_LEN];
-        strcpy(proc_name, current_lexeme);
+    }
+    fprintf(fp, "main 0 %d\n", c->code_index - 1);
+    fclose(fp);
+    return 0;
+}
 
-        // Add procedure to symbol table, addr is its starting code index
-        add_symbol(PROCEDURE, proc_name, 0, level, code_index);
-        advance_token();
+// --memo: finds the procedures whose effect is a function of the values
+// they read, for vm --memo to cache. A location is a variable as an
+// instruction addresses it, (declaring level, offset), LDA/STA addressing
+// level 0; seen from a body at level n, locations below level n are outer
+// ones, in the frames of the enclosing procedures or main. For every
+// procedure the analysis computes
+//     exposed  outer locations it (or a procedure it calls) may read
+//              before writing them
+//     may      outer locations it may write
+//     must     outer locations it writes on every path to a return
+// by dataflow over its code, the set of locations written so far being
+// intersected where paths meet, and iterates over all procedures until
+// nothing changes (must starts out full, so recursion assumes the best
+// and is refined). A procedure is memoizable when it does no I/O, no COB,
+// never reads a local it has not written and touches no array except its
+// own (written only); its inputs are its arguments, its exposed locations
+// and the outer locations it only writes on some paths (whose old values
+// then survive), its outputs are may and its result
+#define MEMO_FILENAME "elf.memo"
+#define MEMO_MAX_LOCATIONS 512 // distinct (level, offset) pairs the analysis can track
+#define MEMO_MAX_KEY 8         // arguments + inputs of a memoized procedure (must match vm.c)
+#define MEMO_MAX_OUTPUTS 8     // outer locations it writes (must match vm.c)
 
-        if (current_token != semicolonsym) {
-            error(19);
-        }
-        advance_token();
+typedef struct {
+    unsigned long long bits[MEMO_MAX_LOCATIONS / 64];
+} location_set;
 
-        int proc_data_size;
-        block(level + 1, &proc_data_size);
+typedef struct {
+    int sym;               // the procedure's symbol
+    int level;             // level of its body
+    location_set exposed, may, must;
+    const char *unsafe;    // why it cannot be memoized, NULL if it can
+    int repeats;           // has a CAL or a backward jump, so a hit saves something
+} memo_summary;
 
-        if (current_token != semicolonsym) {
-            error(19);
-        }
-        advance_token();
+typedef struct {
+    int level[MEMO_MAX_LOCATIONS], offset[MEMO_MAX_LOCATIONS];
+    int count;
+    int location[MAX_CODE_LENGTH]; // location each LOD/STO/LDA/STA addresses, -1 if the table is full
+    int summary_at[MAX_CODE_LENGTH]; // summary of the body starting at an index, or -1
+    memo_summary *procs;
+    int proc_count;
+    location_set state[MAX_CODE_LENGTH]; // locations written before an instruction
+    char reached[MAX_CODE_LENGTH], queued[MAX_CODE_LENGTH];
+} memo_analysis;
+
+int set_has(const location_set *s, int id) {
+    return (s->bits[id / 64] >> (id % 64)) & 1;
+}
+
+void set_add(location_set *s, int id) {
+    s->bits[id / 64] |= 1ULL << (id % 64);
+}
+
+int set_count(const location_set *s) {
+    int count = 0;
+    for (int i = 0; i < MEMO_MAX_LOCATIONS / 64; i++) count += __builtin_popcountll(s->bits[i]);
+    return count;
+}
+
+// the locations declared below level, outer ones for a body at that level
+location_set outer_locations(memo_analysis *a, int level) {
+    location_set outer;
+    memset(&outer, 0, sizeof outer);
+    for (int id = 0; id < a->count; id++) {
+        if (a->level[id] < level) set_add(&outer, id);
     }
+    return outer;
 }
 
-void statement(int level) {
-    int sym_idx;
-    int cx1, cx2;
+int memo_location(memo_analysis *a, int level, int offset) {
+    for (int id = 0; id < a->count; id++) {
+        if (a->level[id] == level && a->offset[id] == offset) return id;
+    }
+    if (a->count == MEMO_MAX_LOCATIONS) return -1;
+    a->level[a->count] = level;
+    a->offset[a->count] = offset;
+    return a->count++;
+}
 
-    // Handle different statement types
-    if (current_token == identsym) {
-        char ident_name[MAX_IDENT_LEN];
-        strcpy(ident_name, current_lexeme);
-        sym_idx = find_symbol(ident_name, level);
-        if (sym_idx == -1) {
-            error(7);
-        }
-        if (sym_table[sym_idx].kind != VARIABLE) {
-            error(8);
-        }
-        advance_token();
-        if (current_token != becomessym) {
-            error(9);
-        }
-        advance_token();
-        expression(level);
-        emit(STO, level - sym_table[sym_idx].level, sym_table[sym_idx].addr);
-    } else if (current_token == callsym) {
-        advance_token();
-        if (current_token != identsym) {
-            error(2);
-        }
-        sym_idx = find_symbol(current_lexeme, level);
-        if (sym_idx == -1) {
-            error(7);
+// a read of location id by the body of p where written holds the locations
+// written so far: an outer one becomes an input, a local one is uninitialized
+void memo_read(memo_analysis *a, memo_summary *p, const location_set *written, location_set *exposed, int id) {
+    if (id < 0) {
+        p->unsafe = "uses too many variables";
+    } else if (!set_has(written, id)) {
+        if (a->level[id] < p->level) set_add(exposed, id);
+        else p->unsafe = "reads a variable before writing it";
+    }
+}
+
+// one pass of the dataflow over p's body with the current summaries of the
+// procedures it calls. returns 1 if p's summary changed
+int analyze_procedure(compiler *c, memo_analysis *a, memo_summary *p) {
+    symbol *sym = &c->sym_table[p->sym];
+    int start = sym->addr, end = sym->end;
+    int worklist[MAX_CODE_LENGTH], pending = 0;
+    location_set exposed, may, must, outer = outer_locations(a, p->level);
+    memset(&exposed, 0, sizeof exposed);
+    memset(&may, 0, sizeof may);
+    memset(&must, 0xff, sizeof must);
+    const char *unsafe = p->unsafe;
+
+    // on entry only the arguments are written
+    for (int i = start; i <= end; i++) a->reached[i] = a->queued[i] = 0;
+    memset(&a->state[start], 0, sizeof a->state[start]);
+    for (int id = 0; id < a->count; id++) {
+        if (a->level[id] == p->level && a->offset[id] < 0) set_add(&a->state[start], id);
+    }
+    a->reached[start] = a->queued[start] = 1;
+    worklist[pending++] = start;
+
+    while (pending > 0) {
+        int i = worklist[--pending];
+        a->queued[i] = 0;
+        location_set written = a->state[i];
+        instruction *ins = &c->code[i];
+        int next[2] = {i + 1, -1};
+        switch (ins->op) {
+        case LOD:
+        case LDA:
+            memo_read(a, p, &written, &exposed, a->location[i]);
+            break;
+        case STO:
+        case STA:
+            if (a->location[i] < 0) {
+                p->unsafe = "uses too many variables";
+                break;
+            }
+            set_add(&written, a->location[i]);
+            if (a->level[a->location[i]] < p->level) set_add(&may, a->location[i]);
+            break;
+        case LDX:
+            p->unsafe = "reads an array";
+            break;
+        case STX:
+            if (ins->l > 0) p->unsafe = "writes an outer array";
+            break;
+        case SYS:
+            p->unsafe = "does input or output";
+            break;
+        case COB:
+            p->unsafe = "starts concurrent calls";
+            break;
+        case CAL: {
+            int target = jump_target_index(c, ins->m);
+            memo_summary *q = target >= 0 && target < c->code_index && a->summary_at[target] >= 0
+                ? &a->procs[a->summary_at[target]] : NULL;
+            p->repeats = 1;
+            if (!q) {
+                p->unsafe = "calls code outside a procedure";
+                break;
+            }
+            if (q->unsafe) {
+                p->unsafe = "calls a procedure that cannot be memoized";
+                break;
+            }
+            location_set q_outer = outer_locations(a, q->level);
+            for (int id = 0; id < a->count; id++) {
+                if (set_has(&q->exposed, id)) memo_read(a, p, &written, &exposed, id);
+            }
+            for (int w = 0; w < MEMO_MAX_LOCATIONS / 64; w++) {
+                written.bits[w] |= q->must.bits[w] & q_outer.bits[w];
+                may.bits[w] |= q->may.bits[w] & outer.bits[w];
+            }
+            break;
         }
-        if (sym_table[sym_idx].kind != PROCEDURE) {
-            error(18);
+        case JMP:
+            next[0] = jump_target_index(c, ins->m);
+            if (next[0] <= i) p->repeats = 1;
+            break;
+        case JPC:
+            next[1] = jump_target_index(c, ins->m);
+            if (next[1] <= i) p->repeats = 1;
+            break;
+        case OPR:
+            if (ins->m == RTN || ins->m == RTV) {
+                for (int w = 0; w < MEMO_MAX_LOCATIONS / 64; w++) must.bits[w] &= written.bits[w];
+                next[0] = -1;
+            }
+            break;
         }
-        // patch procedure call with VM code address
-        emit(CAL, level - sym_table[sym_idx].level, code_address(sym_table[sym_idx].addr));
-        advance_token();
-    } else if (current_token == readsym) {// read statement
-        advance_token();
-        if (current_token != identsym) {
-            error(2);
+        for (int n = 0; n < 2; n++) {
+            int t = next[n];
+            if (t < 0) continue;
+            if (t < start || t > end) {
+                p->unsafe = "jumps out of its body";
+                continue;
+            }
+            int changed = !a->reached[t];
+            if (a->reached[t]) {
+                for (int w = 0; w < MEMO_MAX_LOCATIONS / 64; w++) {
+                    unsigned long long meet = a->state[t].bits[w] & written.bits[w];
+                    if (meet != a->state[t].bits[w]) changed = 1;
+                    a->state[t].bits[w] = meet;
+                }
+            } else {
+                a->state[t] = written;
+                a->reached[t] = 1;
+            }
+            if (changed && !a->queued[t]) {
+                a->queued[t] = 1;
+                worklist[pending++] = t;
+            }
         }
-        sym_idx = find_symbol(current_lexeme, level);
-        if (sym_idx == -1) {
-            error(7);
-        }
-        if (sym_table[sym_idx].kind != VARIABLE) {
-            error(8);
-        }
-        emit(SYS, 0, 2);
-        emit(STO, level - sym_table[sym_idx].level, sym_table[sym_idx].addr);
-        advance_token();
-    } else if (current_token == writesym) {// write statement
-        advance_token();
-        expression(level);
-        emit(SYS, 0, 1);
-    } else if (current_token == beginsym) {// begin...end block
-        advance_token();
-        statement(level);
-        while (current_token == semicolonsym) {
-            advance_token();
-            statement(level);
-        }
-        if (current_token != endsym) {
-            error(10);
-        }
-        advance_token();
-    } else if (current_token == ifsym) {// if...then...else...fi statement
-        advance_token();
-        condition(level);
-        if (current_token != thensym) {
-            error(11);
-        }
-        advance_token();
-        cx1 = code_index;
-        emit(JPC, 0, 0); // to be patched
-        statement(level);
-
-        cx2 = code_index;
-        emit(JMP, 0, 0); // to be patched
-        // patch JPC to ELSE-part address
-        code[cx1].m = code_address(code_index);
+    }
 
-        if (current_token != elsesym) {
-            error(13);
-        }
-        advance_token();
-        statement(level);
+    for (int w = 0; w < MEMO_MAX_LOCATIONS / 64; w++) must.bits[w] &= outer.bits[w];
+    int changed = unsafe != p->unsafe || memcmp(&exposed, &p->exposed, sizeof exposed) != 0
+                  || memcmp(&may, &p->may, sizeof may) != 0 || memcmp(&must, &p->must, sizeof must) != 0;
+    p->exposed = exposed;
+    p->may = may;
+    p->must = must;
+    return changed;
+}
 
-        // patch JMP to FI (after else) address
-        code[cx2].m = code_address(code_index);
-
-        if (current_token != fisym) {
-            error(12);
-        }
-        advance_token();
-    } else if (current_token == whilesym) {// while...do statement
-        advance_token();
-        cx1 = code_index; // loop start
-        condition(level);
-        if (current_token != dosym) {
-            error(14);
-        }
-        advance_token();
-        cx2 = code_index;
-        emit(JPC, 0, 0); // exit test, to patch
-        statement(level);
-        // back-edge jump to start of loop
-        emit(JMP, 0, code_address(cx1));
-        // patch JPC to jump to instruction after loop body
-        code[cx2].m = code_address(code_index);
+// writes the locations of set as "<count> <d> <m> ...", d being the number
+// of static links from the procedure's frame to the one holding it
+void write_locations(FILE *fp, memo_analysis *a, memo_summary *p, const location_set *set) {
+    fprintf(fp, " %d", set_count(set));
+    for (int id = 0; id < a->count; id++) {
+        if (set_has(set, id)) fprintf(fp, " %d %d", p->level - a->level[id], a->offset[id]);
     }
 }
 
-void condition(int level) {
-    if (current_token == evensym) {
-        advance_token();
-        expression(level);
-        emit(OPR, 0, 11); // EVEN per ISA
-    } else {
-        expression(level); // left-hand side
-        int rel_op = current_token;
-        if (rel_op < eqlsym || rel_op > geqsym) {
-            error(15);
+// --memo: analyzes the procedures (see above) and writes elf.memo for
+// vm --memo, one line per memoizable procedure:
+//     pm0-memo 1
+//     code <n>
+//     procs <k>
+//     <name> <first> <last> <args> <result> in <count> <d> <m>... out <count> <d> <m>...
+// where first and last bound its body, args is its parameter count and
+// result is 1 if it returns with RTV. Each procedure's verdict goes to stderr
+int write_memo_info(compiler *c) {
+    memo_analysis *a = calloc(1, sizeof *a);
+    if (!a) {
+        fprintf(stderr, "Error: out of memory.\n");
+        return 1;
+    }
+    a->procs = calloc(c->sym_index + 1, sizeof *a->procs);
+    for (int i = 0; i < c->code_index; i++) {
+        a->summary_at[i] = -1;
+        a->location[i] = -1;
+    }
+    for (int i = 0; i < c->sym_index; i++) {
+        symbol *sym = &c->sym_table[i];
+        if (sym->kind != PROCEDURE || sym->addr < 0 || sym->external) continue;
+        memo_summary *p = &a->procs[a->proc_count];
+        p->sym = i;
+        p->level = sym->level + 1;
+        memset(&p->must, 0xff, sizeof p->must);
+        a->summary_at[sym->addr] = a->proc_count++;
+        for (int k = sym->addr; k <= sym->end; k++) {
+            if (c->code[k].op == LOD || c->code[k].op == STO) {
+                a->location[k] = memo_location(a, p->level - c->code[k].l, c->code[k].m);
+            } else if (c->code[k].op == LDA || c->code[k].op == STA) {
+                a->location[k] = memo_location(a, 0, c->code[k].m);
+            }
         }
-        advance_token(); // consume relational operator
-        expression(level); // right-hand side
-        // Emit appropriate OPR instruction based on relational operator
-        // Per ISA Table 2: EQL=5, NEQ=6, LSS=7, LEQ=8, GTR=9, GEQ=10
-        switch (rel_op) {
-            case eqlsym: emit(OPR, 0, 5); break; // EQL
-            case neqsym: emit(OPR, 0, 6); break; // NEQ
-            case lessym: emit(OPR, 0, 7); break; // LSS
-            case leqsym: emit(OPR, 0, 8); break; // LEQ
-            case gtrsym: emit(OPR, 0, 9); break; // GTR
-            case geqsym: emit(OPR, 0, 10); break; // GEQ
+    }
+    int changed;
+    do {
+        changed = 0;
+        for (int i = 0; i < a->proc_count; i++) changed |= analyze_procedure(c, a, &a->procs[i]);
+    } while (changed);
+
+    FILE *fp = fopen(MEMO_FILENAME, "w");
+    if (!fp) {
+        fprintf(stderr, "Error: Could not open output file '%s'.\n", MEMO_FILENAME);
+        free(a->procs);
+        free(a);
+        return 1;
+    }
+    int memoized = 0;
+    for (int i = 0; i < a->proc_count; i++) {
+        memo_summary *p = &a->procs[i];
+        symbol *sym = &c->sym_table[p->sym];
+        int args = sym->params > 0 ? sym->params : 0;
+        location_set inputs = p->exposed;
+        for (int w = 0; w < MEMO_MAX_LOCATIONS / 64; w++) inputs.bits[w] |= p->may.bits[w] & ~p->must.bits[w];
+        if (!p->unsafe && !p->repeats) p->unsafe = "has no call or loop to save";
+        if (!p->unsafe && args + set_count(&inputs) > MEMO_MAX_KEY) p->unsafe = "has too many inputs";
+        if (!p->unsafe && set_count(&p->may) > MEMO_MAX_OUTPUTS) p->unsafe = "has too many outputs";
+        if (p->unsafe) {
+            fprintf(stderr, "memo: %s not memoized: %s\n", name_text(c, sym->name), p->unsafe);
+            continue;
         }
+        p->exposed = inputs;
+        memoized++;
+        fprintf(stderr, "memo: %s memoized: %d arguments, %d inputs, %d outputs\n", name_text(c, sym->name),
+                args, set_count(&inputs), set_count(&p->may));
+    }
+    fprintf(fp, "pm0-memo 1\ncode %d\nprocs %d\n", c->code_index, memoized);
+    for (int i = 0; i < a->proc_count; i++) {
+        memo_summary *p = &a->procs[i];
+        symbol *sym = &c->sym_table[p->sym];
+        if (p->unsafe) continue;
+        fprintf(fp, "%s %d %d %d %d in", name_text(c, sym->name), sym->addr, sym->end,
+                sym->params > 0 ? sym->params : 0, sym->params >= 0);
+        write_locations(fp, a, p, &p->exposed);
+        fprintf(fp, " out");
+        write_locations(fp, a, p, &p->may);
+        fprintf(fp, "\n");
     }
+    fclose(fp);
+    free(a->procs);
+    free(a);
+    return 0;
 }
 
-void expression(int level) {
-    int op;
-    term(level);
-    // Handle addition and subtraction
-    while (current_token == plussym || current_token == minussym) {
-        op = current_token;
-        advance_token();
-        term(level);
-        if (op == plussym) {
-            emit(OPR, 0, 1); // ADD
-        } else {
-            emit(OPR, 0, 2); // SUB
+// writes the code array as a standalone C translation unit (see --emit-c)
+// each instruction becomes straight-line C, jumps become gotos, and RTN
+// dispatches on the return address through a switch over the call sites.
+// compiled with -DPM0_TRACE the program prints the same trace as vm
+int write_c_translation(compiler *c, const char *path) {
+    static const char *opr_names[] = {"RTN", "ADD", "SUB", "MUL", "DIV", "EQL",
+                                      "NEQ", "LSS", "LEQ", "GTR", "GEQ", "EVEN"};
+    static const char *op_names[] = {"", "LIT", "OPR", "LOD", "STO", "CAL",
+                                     "INC", "JMP", "JPC", "SYS", "COB",
+                                     "LDX", "STX", "CHK", "LDA", "STA"};
+    static const char *opr_c[] = {"", "+", "-", "*", "/", "==", "!=", "<", "<=", ">", ">="};
+    char is_label[MAX_CODE_LENGTH + 1] = {0};
+    is_label[0] = 1; // entry point
+
+    // mark jump targets and return points so only those get labels
+    for (int i = 0; i < c->code_index; i++) {
+        int op = c->code[i].op;
+        if (op == JMP || op == JPC || op == CAL) {
+            int t = jump_target_index(c, c->code[i].m);
+            if (t < 0) {
+                fprintf(stderr, "Error: cannot translate line %d, jump target %d is not an instruction\n",
+                        i, c->code[i].m);
+                return -1;
+            }
+            is_label[t] = 1;
+            if (op == CAL) is_label[i + 1] = 1;
         }
     }
-}
 
-void term(int level) {
-    int op;
-    factor(level);
-    // Handle multiplication and division
-    while (current_token == multsym || current_token == slashsym) {
-        op = current_token;
-        advance_token();
-        factor(level);
-        if (op == multsym) {
-            emit(OPR, 0, 3); // MUL
-        } else {
-            emit(OPR, 0, 4); // DIV
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "Error: Could not open output file '%s'.\n", path);
+        return -1;
+    }
+
+    fprintf(out, "/* PM/0 program translated by parsercodegen_complete --emit-c (%d instructions) */\n", c->code_index);
+    fprintf(out, "#include <stdio.h>\n#include <string.h>\n#include <limits.h>\n\n");
+    fprintf(out, "#define PAS_SIZE %d\n", PAS_SIZE);
+    fprintf(out, "#define TOP (PAS_SIZE - 1)\n");
+    fprintf(out, "#define CODE_FLOOR (PAS_SIZE - %d)\n\n", code_address(c->code_index));
+    // code is still loaded into the PAS so the memory image matches the VM
+    fprintf(out, "static const int code_image[] = {");
+    for (int i = c->code_index - 1; i >= 0; i--) {
+        fprintf(out, "%s%d, %d, %d", (i == c->code_index - 1) ? "" : ", ", c->code[i].m, c->code[i].l, c->code[i].op);
+    }
+    fprintf(out, "};\n\n");
+    fprintf(out, "static int base(const int *pas, int bp, int l) {\n");
+    fprintf(out, "    while (l-- > 0) bp = pas[bp];\n");
+    fprintf(out, "    return bp;\n}\n\n");
+    fprintf(out, "#ifdef PM0_TRACE\n");
+    fprintf(out, "static void print_state(const int *pas, int pc, int bp, int sp) {\n");
+    fprintf(out, "    int i, arb = bp;\n");
+    fprintf(out, "    printf(\"%%d %%d %%d \", pc, bp, sp);\n");
+    fprintf(out, "    for (i = CODE_FLOOR - 1; i >= sp; i--) {\n");
+    fprintf(out, "        if (i == arb) { printf(\"| \"); arb = pas[arb - 1]; }\n");
+    fprintf(out, "        printf(\"%%d \", pas[i]);\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    printf(\"\\n\");\n}\n");
+    fprintf(out, "#define TRACE(name, l, m) (printf(\"%%s %%d %%d \", name, l, m), print_state(pas, pc, bp, sp))\n");
+    fprintf(out, "#else\n");
+    fprintf(out, "#define TRACE(name, l, m) ((void)0)\n");
+    fprintf(out, "#endif\n\n");
+    fprintf(out, "int main(void) {\n");
+    fprintf(out, "    int pas[PAS_SIZE] = {0};\n");
+    fprintf(out, "    int pc = TOP, sp = CODE_FLOOR, bp = CODE_FLOOR - 1;\n");
+    fprintf(out, "    memcpy(&pas[CODE_FLOOR], code_image, sizeof code_image);\n");
+    fprintf(out, "#ifdef PM0_TRACE\n");
+    fprintf(out, "    printf(\"Initial values: %%d %%d %%d\\n\", pc, bp, sp);\n");
+    fprintf(out, "#endif\n");
+    fprintf(out, "    goto L0;\n\n");
+
+    // return address dispatch, only reached from RTN
+    fprintf(out, "dispatch:\n");
+    fprintf(out, "    switch (pc) {\n");
+    for (int i = 0; i < c->code_index; i++) {
+        if (c->code[i].op == CAL) {
+            fprintf(out, "        case %d: goto L%d;\n", TOP - code_address(i + 1), i + 1);
         }
     }
-}
+    fprintf(out, "        default:\n");
+    fprintf(out, "            fprintf(stderr, \"runtime error: return to unknown address %%d\\n\", pc);\n");
+    fprintf(out, "            return 1;\n");
+    fprintf(out, "    }\n\n");
 
-void factor(int level) {
-    int sym_idx;
-    // Handle identifier, number, or parenthesized expression
-    if (current_token == identsym) {
-        sym_idx = find_symbol(current_lexeme, level);
-        if (sym_idx == -1) {
-            error(7);
-        }
-        // Load constant or variable value
-        if (sym_table[sym_idx].kind == CONSTANT) {
-            emit(LIT, 0, sym_table[sym_idx].val);
-        } else if (sym_table[sym_idx].kind == VARIABLE) {
-            emit(LOD, level - sym_table[sym_idx].level, sym_table[sym_idx].addr);
-        }
-        advance_token();
-    } else if (current_token == numbersym) {
-        emit(LIT, 0, current_number_val);
-        advance_token();
-    } else if (current_token == lparentsym) {
-        advance_token();
-        expression(level);
-        if (current_token != rparentsym) {
-            error(16);
-        }
-        advance_token();
-    } else {
-        error(17);
+    for (int i = 0; i < c->code_index; i++) {
+        int op = c->code[i].op, l = c->code[i].l, m = c->code[i].m;
+        int next = TOP - code_address(i + 1);
+        const char *name = (op >= LIT && op <= STA) ? op_names[op] : "OP";
+
+        if (is_label[i]) fprintf(out, "L%d:\n", i);
+        fprintf(out, "    /* %d: %s %d %d */\n", i, name, l, m);
+
+        // static link walk is only needed for non-local accesses
+        char frame[64];
+        if (l == 0) snprintf(frame, sizeof frame, "bp");
+        else snprintf(frame, sizeof frame, "base(pas, bp, %d)", l);
+
+        switch (op) {
+            case LIT:
+                fprintf(out, "    pas[--sp] = %d; pc = %d; TRACE(\"LIT\", %d, %d);\n", m, next, l, m);
+                break;
+            case OPR:
+                if (m == RTN) {
+                    fprintf(out, "    pc = pas[bp - 2]; sp = bp + 1 + %d; bp = pas[bp - 1]; TRACE(\"RTN\", %d, %d);\n", l, l, m);
+                    fprintf(out, "    goto dispatch;\n");
+                } else if (m == RTV) {
+                    fprintf(out, "    { int value = pas[sp]; pc = pas[bp - 2]; sp = bp + 1 + %d; bp = pas[bp - 1];\n", l);
+                    fprintf(out, "      pas[--sp] = value; } TRACE(\"RTV\", %d, %d);\n", l, m);
+                    fprintf(out, "    goto dispatch;\n");
+                } else if (m >= 1 && m <= 10) {
+                    if (m == 4) {
+                        // DIV fails like it does in the vm
+                        fprintf(out, "    if (pas[sp] == 0 || (pas[sp] == -1 && pas[sp + 1] == INT_MIN)) {\n");
+                        fprintf(out, "        fprintf(stderr, \"runtime error: division %%s\\n\", pas[sp] ? \"overflow\" : \"by zero\");\n");
+                        fprintf(out, "        return 1;\n    }\n");
+                    }
+                    if (m <= 4) {
+                        fprintf(out, "    pas[sp + 1] %s= pas[sp]; sp++;", opr_c[m]);
+                    } else {
+                        fprintf(out, "    pas[sp + 1] = (pas[sp + 1] %s pas[sp]); sp++;", opr_c[m]);
+                    }
+                    fprintf(out, " pc = %d; TRACE(\"%s\", %d, %d);\n", next, opr_names[m], l, m);
+                } else if (m == 11) {
+                    fprintf(out, "    pas[sp] = (pas[sp] %% 2 == 0); pc = %d; TRACE(\"EVEN\", %d, %d);\n", next, l, m);
+                } else {
+                    fprintf(out, "    pc = %d; TRACE(\"OPR\", %d, %d);\n", next, l, m);
+                }
+                break;
+            case LOD:
+                fprintf(out, "    sp--; pas[sp] = pas[%s - %d]; pc = %d; TRACE(\"LOD\", %d, %d);\n", frame, m, next, l, m);
+                break;
+            case STO:
+                fprintf(out, "    pas[%s - %d] = pas[sp]; sp++; pc = %d; TRACE(\"STO\", %d, %d);\n", frame, m, next, l, m);
+                break;
+            case CAL:
+                fprintf(out, "    pas[sp - 1] = %s; pas[sp - 2] = bp; pas[sp - 3] = %d; bp = sp - 1;\n", frame, next);
+                fprintf(out, "    pc = %d; TRACE(\"CAL\", %d, %d);\n", TOP - m, l, m);
+                fprintf(out, "    goto L%d;\n", jump_target_index(c, m));
+                break;
+            case INC:
+                fprintf(out, "    sp -= %d; pc = %d; TRACE(\"INC\", %d, %d);\n", m, next, l, m);
+                break;
+            case JMP:
+                fprintf(out, "    pc = %d; TRACE(\"JMP\", %d, %d);\n", TOP - m, l, m);
+                fprintf(out, "    goto L%d;\n", jump_target_index(c, m));
+                break;
+            case JPC:
+                fprintf(out, "    if (pas[sp++] == 0) { pc = %d; TRACE(\"JPC\", %d, %d); goto L%d; }\n",
+                        TOP - m, l, m, jump_target_index(c, m));
+                fprintf(out, "    pc = %d; TRACE(\"JPC\", %d, %d);\n", next, l, m);
+                break;
+            case SYS:
+                if (m == 1) {
+                    fprintf(out, "    printf(\"Output result is: %%d\\n\", pas[sp]); sp++;");
+                } else if (m == 2) {
+                    fprintf(out, "    printf(\"Please Enter an Integer: \"); sp--;\n");
+                    fprintf(out, "    if (scanf(\"%%d\", &pas[sp]) != 1) { fprintf(stderr, \"failure to read integer\\n\"); return 1; }\n");
+                } else if (m == 3) {
+                    fprintf(out, "    pc = %d; TRACE(\"SYS\", %d, %d);\n", next, l, m);
+                    fprintf(out, "    return 0;\n");
+                    break;
+                } else {
+                    fprintf(out, "    fprintf(stderr, \"runtime error: invalid SYS m=%d\\n\");\n", m);
+                    fprintf(out, "    return 1;\n");
+                    break;
+                }
+                fprintf(out, " pc = %d; TRACE(\"SYS\", %d, %d);\n", next, l, m);
+                break;
+            case LDX:
+                fprintf(out, "    pas[sp] = pas[%s - %d - pas[sp]]; pc = %d; TRACE(\"LDX\", %d, %d);\n", frame, m, next, l, m);
+                break;
+            case STX:
+                fprintf(out, "    pas[%s - %d - pas[sp + 1]] = pas[sp]; sp += 2; pc = %d; TRACE(\"STX\", %d, %d);\n", frame, m, next, l, m);
+                break;
+            case CHK:
+                fprintf(out, "    if (pas[sp] < 0 || pas[sp] >= %d) {\n", m);
+                fprintf(out, "        fprintf(stderr, \"runtime error: array index %%d out of bounds [0, %d)\\n\", pas[sp]);\n", m);
+                fprintf(out, "        return 1;\n    }\n");
+                fprintf(out, "    pc = %d; TRACE(\"CHK\", %d, %d);\n", next, l, m);
+                break;
+            case LDA:
+                fprintf(out, "    sp--; pas[sp] = pas[CODE_FLOOR - 1 - %d]; pc = %d; TRACE(\"LDA\", %d, %d);\n", m, next, l, m);
+                break;
+            case STA:
+                fprintf(out, "    pas[CODE_FLOOR - 1 - %d] = pas[sp]; sp++; pc = %d; TRACE(\"STA\", %d, %d);\n", m, next, l, m);
+                break;
+            case COB:
+                // native code runs the calls that follow in order, like vm with one thread
+                fprintf(out, "    pc = %d; TRACE(\"COB\", %d, %d);\n", next, l, m);
+                break;
+            default:
+                fprintf(out, "    pc = %d; TRACE(\"OP%d\", %d, %d);\n", next, op, l, m);
+                break;
+        }
     }
+
+    // running past the last instruction leaves the code segment
+    fprintf(out, "L%d:\n", c->code_index);
+    fprintf(out, "    fprintf(stderr, \"runtime error: execution ran past the end of the code\\n\");\n");
+    fprintf(out, "    return 1;\n");
+    fprintf(out, "}\n");
+    fclose(out);
+    return 0;
 }
 
-// --- MAIN FUNCTION ---
-int main(void) {
-    code_file = fopen(CODE_FILENAME, "w"); // Open output file
-    if (!code_file) { // Check for file open error
-        fprintf(stderr, "Error: Could not open output file '%s'.\n",
-                CODE_FILENAME);
-        return EXIT_FAILURE;
+#define MAX_CC_ARGS 32 // words of $CC
+
+// translates to C and builds a native executable with the system C compiler
+// ($CC, default cc)
+int build_native(compiler *c, const char *exe_path) {
+    char c_path[PATH_MAX];
+    if (snprintf(c_path, sizeof c_path, "%s.c", exe_path) >= (int)sizeof c_path) {
+        fprintf(stderr, "Error: native build failed: %s.c is too long a path\n", exe_path);
+        return -1;
     }
-    read_token_list(); // Load tokens from file
+    if (write_c_translation(c, c_path) != 0) return -1;
 
-    // Check if any tokens were read
-    if (token_count == 0) {
+    // $CC may hold a command with options ("ccache gcc"); it is split at
+    // blanks and the paths are passed as arguments of their own, so no shell
+    // sees them and any character in them is safe
+    const char *cc = getenv("CC");
+    if (!cc || !*cc) cc = "cc";
+    char cc_words[1024];
+    char *args[MAX_CC_ARGS + 6];
+    int n = 0;
+    snprintf(cc_words, sizeof cc_words, "%s", cc);
+    for (char *word = strtok(cc_words, " \t"); word && n < MAX_CC_ARGS; word = strtok(NULL, " \t")) args[n++] = word;
+    if (n == 0) args[n++] = "cc";
+    args[n++] = "-O2";
+    args[n++] = "-o";
+    args[n++] = (char *)exe_path;
+    args[n++] = c_path;
+    args[n] = NULL;
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        execvp(args[0], args);
+        _exit(127);
+    }
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Error: native build failed: %s -O2 -o %s %s\n", cc, exe_path, c_path);
+        return -1;
+    }
+    return 0;
+}
+
+// function to find symbol in symbol table, respecting scope
+int find_symbol(compiler *c, int name, int level) {
+    (void)level; // level currently unused, but kept for signature compatibility
+    for (int i = c->sym_index - 1; i >= 0; i--) {
+        if (c->sym_table[i].name == name && c->sym_table[i].mark == 0) {
+            return i;
+        }
+    }
+    return -1; // not found
+}
+
+// function to add symbol to symbol table
+int add_symbol(compiler *c, int kind, int name, int val, int level, int addr) {
+    // overflow
+    if (c->sym_index >= MAX_SYMBOL_TABLE_SIZE) {
+        error(c, 35);
+    }
+
+    // check for duplicate in current scope
+    for (int i = c->sym_index - 1; i >= 0; i--) {
+        if (c->sym_table[i].level < level) break; // Exited current scope
+        if (c->sym_table[i].name == name && c->sym_table[i].mark == 0) {
+            error(c, 3); // duplicate symbol
+            return -1;
+        }
+    }
+
+    // add symbol to table
+    c->sym_table[c->sym_index].kind = kind;
+    c->sym_table[c->sym_index].name  = name;
+    c->sym_table[c->sym_index].val   = val;
+    c->sym_table[c->sym_index].level = level;
+    c->sym_table[c->sym_index].addr  = addr; // note: for procedures this is a *code index*
+    c->sym_table[c->sym_index].mark  = 0;    // Mark as valid (in scope)
+    c->sym_table[c->sym_index].size  = 0;
+    c->sym_table[c->sym_index].params = -1;
+    c->sym_table[c->sym_index].end   = -1;
+    c->sym_table[c->sym_index].external = 0;
+    c->sym_table[c->sym_index].lifted = 0;
+    return c->sym_index++; // increment symbol index upon return
+}
+
+
+// records that the instruction about to be emitted needs the linker
+void add_relocation(compiler *c, int kind, int sym_idx) {
+    c->relocs[c->reloc_count].index = c->code_index;
+    c->relocs[c->reloc_count].kind = kind;
+    c->relocs[c->reloc_count].sym = sym_idx;
+    c->reloc_count++;
+}
+
+// emits CAL to a procedure. A procedure whose body has not started yet
+// (called from a procedure nested in it) gets the placeholder -(sym_idx + 1),
+// patched by generate_block() when the body's address is known. Extern procedures
+// get 0 and a relocation
+void emit_call(compiler *c, int level, int sym_idx) {
+    int addr = c->sym_table[sym_idx].addr;
+    if (c->sym_table[sym_idx].external) {
+        add_relocation(c, RELOC_PROC, sym_idx);
+        emit(c, CAL, level - c->sym_table[sym_idx].level, 0);
+        return;
+    }
+    emit(c, CAL, level - c->sym_table[sym_idx].level, addr < 0 ? -(sym_idx + 1) : code_address(addr));
+}
+
+// emits LOD, STO, LDX or STX for a variable; with --object, accesses to
+// globals are relocated since the linker gathers every unit's globals in
+// main's frame. With --lift a scalar that lives in main's frame takes
+// LDA/STA when a procedure uses it, so no static link is followed
+void emit_variable(compiler *c, int op, int level, int sym_idx) {
+    symbol *sym = &c->sym_table[sym_idx];
+    if (c->object_path && sym->level == 0) {
+        add_relocation(c, sym->external ? RELOC_VAR : RELOC_DATA, sym_idx);
+    }
+    if (c->lift && (op == LOD || op == STO) && (sym->lifted || (sym->level == 0 && level > 0))) {
+        emit(c, op == LOD ? LDA : STA, 0, sym->addr);
+    } else {
+        emit(c, op, level - sym->level, sym->addr);
+    }
+}
+
+// GRAMMAR DEFINITIONS AND PARSING FUNCTIONS
+// The parser builds the AST in c->ast and emits nothing. It still resolves
+// every name as it reads it: PL/0 declares before use, and a name's kind
+// decides how it parses (an array takes an index, a function arguments).
+// Declarations fill in the symbol table and the frame layout as before
+
+// value is the node's sym or value, depending on its kind
+node *new_node(compiler *c, int kind, int value) {
+    node *n = arena_alloc(&c->ast, sizeof *n);
+    n->kind = kind;
+    n->value = value;
+    n->left = n->right = n->alt = n->next = NULL;
+    n->pos = c->current_pos;
+    return n;
+}
+
+// parses "[ expression ]" after an array name, returning the index
+node *array_index(compiler *c, int level) {
+    if (c->current_token != lbracketsym) {
+        error(c, 25);
+    }
+    advance_token(c);
+    node *index = expression(c, level);
+    if (c->current_token != rbracketsym) {
+        error(c, 24);
+    }
+    advance_token(c);
+    return index;
+}
+
+void program(compiler *c) {
+    int data_size; // initialize data size
+    if (c->current_token == modulesym) {
+        module_unit(c);
+        return;
+    }
+    c->ast_root = block(c, 0, -1, &data_size); // parse main block at level 0
+    // ensure program ends with period
+    if (c->current_token != periodsym) {
+        error(c, 20);
+    }
+    c->halt_pos = c->current_pos;
+    c->global_words = data_size - 3;
+}
+
+// module name; followed only by declarations: separately compiled globals
+// and procedures for other units (see --object). Its code is the
+// procedure bodies, with no main to jump to
+void module_unit(compiler *c) {
+    if (!c->object_path) {
+        error(c, 32);
+    }
+    advance_token(c);
+    if (c->current_token != identsym) {
+        error(c, 2);
+    }
+    c->module_name = c->current_name;
+    advance_token(c);
+    if (c->current_token != semicolonsym) {
+        error(c, 33);
+    }
+    advance_token(c);
+    int data_size = 3;
+    extern_declaration(c, 0);
+    const_declaration(c, 0);
+    var_declaration(c, 0, &data_size);
+    c->ast_root = arena_alloc(&c->ast, sizeof *c->ast_root);
+    memset(c->ast_root, 0, sizeof *c->ast_root);
+    c->ast_root->proc = -1;
+    c->ast_root->procs = procedure_declaration(c, 0);
+    c->ast_root->sym_end = c->sym_index;
+    if (c->current_token != periodsym) {
+        error(c, 20);
+    }
+    c->global_words = data_size - 3;
+}
+
+// proc_idx is the procedure whose body this is (-1 for main); its
+// parameters, already in the symbol table, belong to this scope
+ast_block *block(compiler *c, int level, int proc_idx, int *data_size) {
+    ast_block *b = arena_alloc(&c->ast, sizeof *b);
+    *data_size = 3; // reserve space for static link, dynamic link, return address
+    int start_sym_index = proc_idx < 0 ? c->sym_index : proc_idx + 1;
+    int outer_proc = c->current_proc;
+    b->proc = proc_idx;
+    b->level = level;
+    b->next = NULL;
+    b->start_pos = c->current_pos;
+
+    if (level == 0) {
+        extern_declaration(c, level);
+    }
+
+    const_declaration(c, level);
+    var_declaration(c, level, data_size);
+    b->procs = procedure_declaration(c, level);
+
+    b->data_size = *data_size;
+    b->body_pos = c->current_pos;
+    c->current_proc = proc_idx;
+    b->body = statement(c, level);
+    c->current_proc = outer_proc;
+    b->end_pos = c->current_pos;
+    b->syms = start_sym_index;
+    b->sym_end = c->sym_index;
+
+    unmark_symbols_at_level(c, level, start_sym_index);
+    return b;
+}
+
+void const_declaration(compiler *c, int level) {
+    if (c->current_token == constsym) {
+        advance_token(c);
+        // process constant declarations
+        do {
+            if (c->current_token != identsym) {
+                error(c, 2);
+            }
+            int ident_name = c->current_name;
+            advance_token(c);
+            if (c->current_token != eqlsym) {
+                error(c, 4);
+            }
+            advance_token(c);
+            if (c->current_token != numbersym) {
+                error(c, 5);
+            }
+            int val = c->current_number_val;
+            add_symbol(c, CONSTANT, ident_name, val, level, 0);
+            advance_token(c);
+        } while (c->current_token == commasym && (advance_token(c), 1));
+        if (c->current_token != semicolonsym) {
+            error(c, 6);
+        }
+        advance_token(c);
+    }
+}
+
+void var_declaration(compiler *c, int level, int *data_size) {
+    // Handle variable declarations
+    if (c->current_token == varsym) {
+        advance_token(c);
+        do {
+            if (c->current_token != identsym) {
+                error(c, 2);
+            }
+            int var_idx = add_symbol(c, VARIABLE, c->current_name, 0, level, *data_size);
+            advance_token(c);
+            *data_size += declaration_size(c, var_idx);
+            if (*data_size > PAS_SIZE) {
+                error(c, 36); // no code can leave room for it
+            }
+        } while (c->current_token == commasym && (advance_token(c), 1));
+        if (c->current_token != semicolonsym) {
+            error(c, 6);
+        }
+        advance_token(c);
+    }
+}
+
+// parses an optional "[ n ]" after a variable name, making it an array of n
+// elements (element i lives at addr + i); returns the words it takes
+int declaration_size(compiler *c, int var_idx) {
+    if (c->current_token != lbracketsym) {
+        return 1;
+    }
+    advance_token(c);
+    if (c->current_token != numbersym || c->current_number_val <= 0) {
+        error(c, 23);
+    }
+    c->sym_table[var_idx].size = c->current_number_val;
+    advance_token(c);
+    if (c->current_token != rbracketsym) {
+        error(c, 24);
+    }
+    advance_token(c);
+    return c->sym_table[var_idx].size;
+}
+
+// extern var a, b[n]; and extern procedure f(a, b); declare globals and
+// procedures defined by another unit. Only allowed with --object; the
+// linker fills in their addresses
+void extern_declaration(compiler *c, int level) {
+    while (c->current_token == externsym) {
+        if (!c->object_path) {
+            error(c, 32);
+        }
+        advance_token(c);
+        if (c->current_token == varsym) {
+            advance_token(c);
+            do {
+                if (c->current_token != identsym) {
+                    error(c, 2);
+                }
+                int var_idx = add_symbol(c, VARIABLE, c->current_name, 0, level, 0);
+                c->sym_table[var_idx].external = 1;
+                advance_token(c);
+                declaration_size(c, var_idx);
+            } while (c->current_token == commasym && (advance_token(c), 1));
+        } else if (c->current_token == procsym) {
+            advance_token(c);
+            if (c->current_token != identsym) {
+                error(c, 2);
+            }
+            int proc_idx = add_symbol(c, PROCEDURE, c->current_name, 0, level, -1);
+            c->sym_table[proc_idx].external = 1;
+            advance_token(c);
+            if (c->current_token == lparentsym) {
+                parameter_list(c, level + 1, proc_idx);
+                unmark_symbols_at_level(c, level + 1, proc_idx + 1); // the names are only a signature
+            }
+        } else {
+            error(c, 31);
+        }
+        if (c->current_token != semicolonsym) {
+            error(c, 6);
+        }
+        advance_token(c);
+    }
+}
+
+// parses the procedures declared at level, returning their blocks in order
+ast_block *procedure_declaration(compiler *c, int level) {
+    ast_block *first = NULL, **tail = &first;
+    while (c->current_token == procsym) {
+        advance_token(c);
+        if (c->current_token != identsym) {
+            error(c, 2);
+        }
+        int proc_name = c->current_name;
+
+        // Add procedure to symbol table; code generation sets addr to the
+        // code index where its body starts, after any nested procedures
+        int proc_idx = add_symbol(c, PROCEDURE, proc_name, 0, level, -1);
+        advance_token(c);
+        if (c->current_token == lparentsym) {
+            parameter_list(c, level + 1, proc_idx);
+        }
+
+        if (c->current_token != semicolonsym) {
+            error(c, 19);
+        }
+        advance_token(c);
+
+        int proc_data_size;
+        *tail = block(c, level + 1, proc_idx, &proc_data_size);
+        tail = &(*tail)->next;
+
+        if (c->current_token != semicolonsym) {
+            error(c, 19);
+        }
+        advance_token(c);
+    }
+    return first;
+}
+
+// parses "( a, b, ... )" after a procedure name. The caller pushes the
+// arguments in order and CAL builds the frame right below them, so they
+// need no copying: of n parameters, parameter i (from 0) is the word at
+// BP + n - i, addressed as LOD/STO with M = i - n. RTN/RTV pop them
+void parameter_list(compiler *c, int level, int proc_idx) {
+    int first = c->sym_index;
+    c->sym_table[proc_idx].params = 0;
+    advance_token(c);
+    if (c->current_token != rparentsym) {
+        do {
+            if (c->current_token != identsym) {
+                error(c, 2);
+            }
+            add_symbol(c, VARIABLE, c->current_name, 0, level, 0);
+            c->sym_table[proc_idx].params++;
+            advance_token(c);
+        } while (c->current_token == commasym && (advance_token(c), 1));
+    }
+    if (c->current_token != rparentsym) {
+        error(c, 16);
+    }
+    advance_token(c);
+    int params = c->sym_table[proc_idx].params;
+    for (int i = 0; i < params; i++) {
+        c->sym_table[first + i].addr = i - params;
+    }
+}
+
+// parses the "( expression, ... )" of a call to a procedure with a
+// parameter list, returning the arguments (linked by next) the caller
+// pushes for the callee to address in place
+node *call_arguments(compiler *c, int level, int sym_idx) {
+    int params = c->sym_table[sym_idx].params;
+    if (params < 0) {
+        if (c->current_token == lparentsym) {
+            error(c, 28);
+        }
+        return NULL;
+    }
+    if (c->current_token != lparentsym) {
+        error(c, 28);
+    }
+    advance_token(c);
+    node *first = NULL, **tail = &first;
+    int count = 0;
+    if (c->current_token != rparentsym) {
+        do {
+            *tail = expression(c, level);
+            tail = &(*tail)->next;
+            count++;
+        } while (c->current_token == commasym && (advance_token(c), 1));
+    }
+    if (c->current_token != rparentsym) {
+        error(c, 16);
+    }
+    if (count != params) {
+        error(c, 28);
+    }
+    advance_token(c);
+    return first;
+}
+
+// returns the statement's node, NULL for an empty statement
+node *statement(compiler *c, int level) {
+    int sym_idx;
+    node *n = NULL;
+
+    // Handle different statement types
+    if (c->current_token == identsym) {
+        sym_idx = find_symbol(c, c->current_name, level);
+        if (sym_idx == -1) {
+            error(c, 7);
+        }
+        if (c->sym_table[sym_idx].kind != VARIABLE) {
+            error(c, 8);
+        }
+        n = new_node(c, NODE_ASSIGN, sym_idx);
+        advance_token(c);
+        if (c->sym_table[sym_idx].size > 0) {
+            n->left = array_index(c, level);
+        } else if (c->current_token == lbracketsym) {
+            error(c, 26);
+        }
+        if (c->current_token != becomessym) {
+            error(c, 9);
+        }
+        advance_token(c);
+        n->right = expression(c, level);
+    } else if (c->current_token == callsym) {
+        n = new_node(c, NODE_CALL, 0);
+        advance_token(c);
+        if (c->current_token != identsym) {
+            error(c, 2);
+        }
+        sym_idx = find_symbol(c, c->current_name, level);
+        if (sym_idx == -1) {
+            error(c, 7);
+        }
+        if (c->sym_table[sym_idx].kind != PROCEDURE) {
+            error(c, 18);
+        }
+        n->sym = sym_idx;
+        advance_token(c);
+        n->left = call_arguments(c, level, sym_idx);
+    } else if (c->current_token == returnsym) {// return expression
+        if (c->current_proc < 0 || c->sym_table[c->current_proc].params < 0) {
+            error(c, 27);
+        }
+        n = new_node(c, NODE_RETURN, c->sym_table[c->current_proc].params);
+        advance_token(c);
+        n->left = expression(c, level);
+    } else if (c->current_token == readsym) {// read statement
+        n = new_node(c, NODE_READ, 0);
+        advance_token(c);
+        if (c->current_token != identsym) {
+            error(c, 2);
+        }
+        sym_idx = find_symbol(c, c->current_name, level);
+        if (sym_idx == -1) {
+            error(c, 7);
+        }
+        if (c->sym_table[sym_idx].kind != VARIABLE) {
+            error(c, 8);
+        }
+        n->sym = sym_idx;
+        advance_token(c);
+        if (c->sym_table[sym_idx].size > 0) {
+            n->left = array_index(c, level);
+        } else if (c->current_token == lbracketsym) {
+            error(c, 26);
+        }
+    } else if (c->current_token == writesym) {// write statement
+        n = new_node(c, NODE_WRITE, 0);
+        advance_token(c);
+        n->left = expression(c, level);
+    } else if (c->current_token == beginsym) {// begin...end block
+        n = new_node(c, NODE_BEGIN, 0);
+        node **tail = &n->left;
+        do {
+            advance_token(c);
+            node *s = statement(c, level);
+            if (s) {
+                *tail = s;
+                tail = &s->next;
+            }
+        } while (c->current_token == semicolonsym);
+        if (c->current_token != endsym) {
+            error(c, 10);
+        }
+        advance_token(c);
+    } else if (c->current_token == ifsym) {// if...then...else...fi statement
+        n = new_node(c, NODE_IF, 0);
+        advance_token(c);
+        n->left = condition(c, level);
+        if (c->current_token != thensym) {
+            error(c, 11);
+        }
+        advance_token(c);
+        n->right = statement(c, level);
+        if (c->current_token != elsesym) {
+            error(c, 13);
+        }
+        advance_token(c);
+        n->alt = statement(c, level);
+        if (c->current_token != fisym) {
+            error(c, 12);
+        }
+        advance_token(c);
+    } else if (c->current_token == cobeginsym) {// cobegin call p; call q coend
+        n = new_node(c, NODE_COBEGIN, 0);
+        node **tail = &n->left;
+        advance_token(c);
+        do {
+            if (c->current_token != callsym) {
+                error(c, 21);
+            }
+            advance_token(c);
+            if (c->current_token != identsym) {
+                error(c, 2);
+            }
+            sym_idx = find_symbol(c, c->current_name, level);
+            if (sym_idx == -1) {
+                error(c, 7);
+            }
+            if (c->sym_table[sym_idx].kind != PROCEDURE) {
+                error(c, 18);
+            }
+            if (c->sym_table[sym_idx].params >= 0) {
+                error(c, 30);
+            }
+            *tail = new_node(c, NODE_CALL, sym_idx);
+            tail = &(*tail)->next;
+            advance_token(c);
+        } while (c->current_token == semicolonsym && (advance_token(c), 1));
+        if (c->current_token != coendsym) {
+            error(c, 22);
+        }
+        advance_token(c);
+    } else if (c->current_token == whilesym) {// while...do statement
+        n = new_node(c, NODE_WHILE, 0);
+        advance_token(c);
+        n->left = condition(c, level);
+        if (c->current_token != dosym) {
+            error(c, 14);
+        }
+        advance_token(c);
+        n->right = statement(c, level);
+    }
+    return n;
+}
+
+node *condition(compiler *c, int level) {
+    if (c->current_token == evensym) {
+        node *n = new_node(c, NODE_EVEN, 11); // EVEN per ISA
+        advance_token(c);
+        n->left = expression(c, level);
+        return n;
+    }
+    node *left = expression(c, level); // left-hand side
+    int rel_op = c->current_token;
+    if (rel_op < eqlsym || rel_op > geqsym) {
+        error(c, 15);
+    }
+    // OPR M of the relational operator
+    // Per ISA Table 2: EQL=5, NEQ=6, LSS=7, LEQ=8, GTR=9, GEQ=10
+    int m = 0;
+    switch (rel_op) {
+        case eqlsym: m = 5; break; // EQL
+        case neqsym: m = 6; break; // NEQ
+        case lessym: m = 7; break; // LSS
+        case leqsym: m = 8; break; // LEQ
+        case gtrsym: m = 9; break; // GTR
+        case geqsym: m = 10; break; // GEQ
+    }
+    node *n = new_node(c, NODE_BINARY, m);
+    advance_token(c); // consume relational operator
+    n->left = left;
+    n->right = expression(c, level); // right-hand side
+    return n;
+}
+
+node *expression(compiler *c, int level) {
+    node *left = term(c, level);
+    // Handle addition and subtraction
+    while (c->current_token == plussym || c->current_token == minussym) {
+        node *n = new_node(c, NODE_BINARY, c->current_token == plussym ? 1 : 2); // ADD, SUB
+        advance_token(c);
+        n->left = left;
+        n->right = term(c, level);
+        left = n;
+    }
+    return left;
+}
+
+node *term(compiler *c, int level) {
+    node *left = factor(c, level);
+    // Handle multiplication and division
+    while (c->current_token == multsym || c->current_token == slashsym) {
+        node *n = new_node(c, NODE_BINARY, c->current_token == multsym ? 3 : 4); // MUL, DIV
+        advance_token(c);
+        n->left = left;
+        n->right = factor(c, level);
+        left = n;
+    }
+    return left;
+}
+
+node *factor(compiler *c, int level) {
+    int sym_idx;
+    node *n = NULL;
+    // Handle identifier, number, or parenthesized expression
+    if (c->current_token == identsym) {
+        sym_idx = find_symbol(c, c->current_name, level);
+        if (sym_idx == -1) {
+            error(c, 7);
+        }
+        // constant value, variable, array element or function call
+        if (c->sym_table[sym_idx].kind == CONSTANT) {
+            n = new_node(c, NODE_NUMBER, c->sym_table[sym_idx].val);
+        } else if (c->sym_table[sym_idx].kind == VARIABLE && c->sym_table[sym_idx].size > 0) {
+            n = new_node(c, NODE_ELEMENT, sym_idx);
+            advance_token(c);
+            n->left = array_index(c, level);
+            return n;
+        } else if (c->sym_table[sym_idx].kind == VARIABLE) {
+            n = new_node(c, NODE_VARIABLE, sym_idx);
+        } else if (c->sym_table[sym_idx].kind == PROCEDURE) {
+            // function call: the result is left on the stack
+            if (c->sym_table[sym_idx].params < 0) {
+                error(c, 29);
+            }
+            n = new_node(c, NODE_FUNCTION, sym_idx);
+            advance_token(c);
+            n->left = call_arguments(c, level, sym_idx);
+            return n;
+        }
+        advance_token(c);
+        if (c->current_token == lbracketsym) {
+            error(c, 26);
+        }
+    } else if (c->current_token == numbersym) {
+        n = new_node(c, NODE_NUMBER, c->current_number_val);
+        advance_token(c);
+    } else if (c->current_token == lparentsym) {
+        advance_token(c);
+        n = expression(c, level);
+        if (c->current_token != rparentsym) {
+            error(c, 16);
+        }
+        advance_token(c);
+    } else {
+        error(c, 17);
+    }
+    return n;
+}
+
+// --const-fold: replaces each operation on two numbers (and even of a
+// number) with its result, computed as vm computes it, wrapping on
+// overflow. A division by zero is left in place for vm to report
+void fold_constants(node *n) {
+    for (; n; n = n->next) {
+        fold_constants(n->left);
+        fold_constants(n->right);
+        fold_constants(n->alt);
+        if (n->kind == NODE_EVEN && n->left->kind == NODE_NUMBER) {
+            n->value = n->left->value % 2 == 0;
+        } else if (n->kind == NODE_BINARY && n->left->kind == NODE_NUMBER && n->right->kind == NODE_NUMBER) {
+            unsigned a = (unsigned)n->left->value, b = (unsigned)n->right->value;
+            int x = n->left->value, y = n->right->value;
+            switch (n->value) {
+            case 1: n->value = (int)(a + b); break;
+            case 2: n->value = (int)(a - b); break;
+            case 3: n->value = (int)(a * b); break;
+            case 4:
+                if (y == 0 || (x == -2147483647 - 1 && y == -1)) continue; // a runtime error in the vm
+                n->value = x / y;
+                break;
+            case 5: n->value = x == y; break;
+            case 6: n->value = x != y; break;
+            case 7: n->value = x < y; break;
+            case 8: n->value = x <= y; break;
+            case 9: n->value = x > y; break;
+            case 10: n->value = x >= y; break;
+            }
+        } else {
+            continue;
+        }
+        n->kind = NODE_NUMBER;
+        n->left = n->right = NULL;
+    }
+}
+
+void fold_block(ast_block *b) {
+    for (ast_block *p = b->procs; p; p = p->next) fold_block(p);
+    fold_constants(b->body);
+}
+
+// --lift: procedures reach main's variables with LDA/STA (see emit_variable)
+// instead of following static links, and a procedure that is never active
+// twice at once (not recursive, and not reached from a COB call) has its
+// scalar variables that nested procedures use moved into main's frame, so
+// those nested procedures reach them with LDA/STA too. A moved variable
+// keeps its value from one call to the next where it used to start out as
+// whatever the stack held, so a variable only moves if the procedure sets
+// it before anything can read it: the first statement of the body that
+// names it or calls a procedure nested in the procedure assigns or reads
+// it and uses nothing of the kind otherwise. The locals of a separately
+// compiled unit stay put, since other units may call back into it
+
+typedef struct call_edge {
+    int callee;
+    struct call_edge *next;
+} call_edge;
+
+typedef struct {
+    ast_block **block; // the body of each procedure symbol, NULL for other symbols
+    call_edge **calls; // procedures each body calls; main's are in the last slot
+    char *shared;      // procedures a COB call reaches
+    int *seen;         // visit stamps of calls_reach
+    int stamp;
+} lift_analysis;
+
+void index_blocks(lift_analysis *a, ast_block *b) {
+    for (; b; b = b->next) {
+        a->block[b->proc] = b;
+        index_blocks(a, b->procs);
+    }
+}
+
+// records the calls made by the statements from n on; the calls of a
+// cobegin start shared procedures
+void collect_calls(compiler *c, lift_analysis *a, node *n, int caller, int in_cobegin) {
+    for (; n; n = n->next) {
+        if ((n->kind == NODE_CALL || n->kind == NODE_FUNCTION) && a->block[n->sym]) {
+            call_edge *e = arena_alloc(&c->ast, sizeof *e);
+            e->callee = n->sym;
+            e->next = a->calls[caller];
+            a->calls[caller] = e;
+            if (in_cobegin) a->shared[n->sym] = 1;
+        }
+        collect_calls(c, a, n->left, caller, n->kind == NODE_COBEGIN);
+        collect_calls(c, a, n->right, caller, 0);
+        collect_calls(c, a, n->alt, caller, 0);
+    }
+}
+
+void collect_block_calls(compiler *c, lift_analysis *a, ast_block *b) {
+    for (; b; b = b->next) {
+        collect_calls(c, a, b->body, b->proc, 0);
+        collect_block_calls(c, a, b->procs);
+    }
+}
+
+void mark_shared(lift_analysis *a, int proc) {
+    for (call_edge *e = a->calls[proc]; e; e = e->next) {
+        if (!a->shared[e->callee]) {
+            a->shared[e->callee] = 1;
+            mark_shared(a, e->callee);
+        }
+    }
+}
+
+// whether a chain of calls starting with proc's leads to target
+int calls_reach(lift_analysis *a, int proc, int target) {
+    for (call_edge *e = a->calls[proc]; e; e = e->next) {
+        if (e->callee == target) return 1;
+        if (a->seen[e->callee] == a->stamp) continue;
+        a->seen[e->callee] = a->stamp;
+        if (calls_reach(a, e->callee, target)) return 1;
+    }
+    return 0;
+}
+
+int touches(node *n, int var, int first, int end);
+
+// whether the nodes from n on name var or call a procedure among the
+// symbols [first, end)
+int mentions(node *n, int var, int first, int end) {
+    for (; n; n = n->next) {
+        if (touches(n, var, first, end)) return 1;
+    }
+    return 0;
+}
+
+// the same for n and what is below it, but not the nodes after it
+int touches(node *n, int var, int first, int end) {
+    switch (n->kind) {
+    case NODE_ASSIGN: case NODE_READ: case NODE_VARIABLE: case NODE_ELEMENT:
+        if (n->sym == var) return 1;
+        break;
+    case NODE_CALL: case NODE_FUNCTION:
+        if (n->sym >= first && n->sym < end) return 1;
+        break;
+    }
+    return mentions(n->left, var, first, end) || mentions(n->right, var, first, end)
+           || mentions(n->alt, var, first, end);
+}
+
+// whether a procedure nested in the list of blocks names var
+int used_by_nested(ast_block *b, int var) {
+    for (; b; b = b->next) {
+        if (mentions(b->body, var, 0, 0) || used_by_nested(b->procs, var)) return 1;
+    }
+    return 0;
+}
+
+// whether b's body sets var before anything can read it (see above)
+int set_before_use(ast_block *b, int var) {
+    node *s = b->body && b->body->kind == NODE_BEGIN ? b->body->left : b->body;
+    for (; s; s = s->next) {
+        if (!touches(s, var, b->syms, b->sym_end)) continue;
+        return (s->kind == NODE_ASSIGN || s->kind == NODE_READ) && s->sym == var
+               && !mentions(s->left, var, b->syms, b->sym_end) && !mentions(s->right, var, b->syms, b->sym_end);
+    }
+    return 0;
+}
+
+// moves var out of b's frame to the end of main's
+void lift_variable(compiler *c, ast_block *b, int var) {
+    symbol *sym = &c->sym_table[var];
+    for (int i = b->syms; i < b->sym_end; i++) {
+        symbol *other = &c->sym_table[i];
+        if (other->kind == VARIABLE && other->level == b->level && !other->lifted && other->addr > sym->addr) {
+            other->addr--;
+        }
+    }
+    b->data_size--;
+    sym->addr = c->ast_root->data_size++;
+    sym->lifted = 1;
+    c->global_words++;
+}
+
+int lift_blocks(compiler *c, lift_analysis *a, ast_block *b) {
+    int lifted = 0;
+    for (; b; b = b->next) {
+        lifted += lift_blocks(c, a, b->procs);
+        if (!b->procs || a->shared[b->proc]) continue;
+        a->stamp++;
+        if (calls_reach(a, b->proc, b->proc)) continue;
+        for (int i = b->syms; i < b->sym_end; i++) {
+            symbol *sym = &c->sym_table[i];
+            if (sym->kind != VARIABLE || sym->level != b->level || sym->size > 0 || sym->addr < 3) continue;
+            if (used_by_nested(b->procs, i) && set_before_use(b, i)) {
+                lift_variable(c, b, i);
+                lifted++;
+            }
+        }
+    }
+    return lifted;
+}
+
+// returns the number of variables moved into main's frame
+int lift_variables(compiler *c) {
+    if (c->object_path) return 0;
+    int slots = c->sym_index + 1;
+    lift_analysis a;
+    a.block = arena_alloc(&c->ast, slots * sizeof *a.block);
+    a.calls = arena_alloc(&c->ast, slots * sizeof *a.calls);
+    a.shared = arena_alloc(&c->ast, slots);
+    a.seen = arena_alloc(&c->ast, slots * sizeof *a.seen);
+    memset(a.block, 0, slots * sizeof *a.block);
+    memset(a.calls, 0, slots * sizeof *a.calls);
+    memset(a.shared, 0, slots);
+    memset(a.seen, 0, slots * sizeof *a.seen);
+    a.stamp = 0;
+
+    index_blocks(&a, c->ast_root->procs);
+    collect_calls(c, &a, c->ast_root->body, c->sym_index, 0);
+    collect_block_calls(c, &a, c->ast_root->procs);
+    for (int p = 0; p < c->sym_index; p++) {
+        if (a.shared[p]) mark_shared(&a, p);
+    }
+    return lift_blocks(c, &a, c->ast_root->procs);
+}
+
+// CODE GENERATION
+// One walk over the AST, emitting procedures before the body that encloses
+// them. An instruction takes the source position of the innermost
+// statement it belongs to; the JMP to main, INC, return and halt take the
+// position of the block part the parser was at
+
+void generate_expression(compiler *c, node *n, int level);
+
+// evaluates an array index, checked against the array's size
+void generate_index(compiler *c, node *index, int level, int sym_idx) {
+    generate_expression(c, index, level);
+    if (c->bounds_check) {
+        emit(c, CHK, 0, c->sym_table[sym_idx].size);
+    }
+}
+
+void generate_expression(compiler *c, node *n, int level) {
+    switch (n->kind) {
+    case NODE_NUMBER:
+        emit(c, LIT, 0, n->value);
+        break;
+    case NODE_VARIABLE:
+        emit_variable(c, LOD, level, n->sym);
+        break;
+    case NODE_ELEMENT:
+        generate_index(c, n->left, level, n->sym);
+        emit_variable(c, LDX, level, n->sym);
+        break;
+    case NODE_FUNCTION:
+        for (node *arg = n->left; arg; arg = arg->next) generate_expression(c, arg, level);
+        emit_call(c, level, n->sym);
+        break;
+    case NODE_BINARY:
+        generate_expression(c, n->left, level);
+        generate_expression(c, n->right, level);
+        emit(c, OPR, 0, n->value);
+        break;
+    case NODE_EVEN:
+        generate_expression(c, n->left, level);
+        emit(c, OPR, 0, n->value);
+        break;
+    }
+}
+
+void generate_statement(compiler *c, node *n, int level) {
+    int cx1, cx2;
+    if (!n) {
+        return;
+    }
+    source_position outer_pos = c->statement_pos; // enclosing statement, restored at the end
+    c->statement_pos = c->current_pos = n->pos;
+
+    switch (n->kind) {
+    case NODE_ASSIGN:
+        if (n->left) {
+            generate_index(c, n->left, level, n->sym);
+        }
+        generate_expression(c, n->right, level);
+        emit_variable(c, n->left ? STX : STO, level, n->sym);
+        break;
+    case NODE_CALL:
+        for (node *arg = n->left; arg; arg = arg->next) generate_expression(c, arg, level);
+        emit_call(c, level, n->sym);
+        if (c->sym_table[n->sym].params >= 0) {
+            emit(c, INC, 0, -1); // discard the result
+        }
+        break;
+    case NODE_RETURN:
+        generate_expression(c, n->left, level);
+        emit(c, OPR, n->value, RTV);
+        break;
+    case NODE_READ:
+        if (n->left) {
+            generate_index(c, n->left, level, n->sym);
+            emit(c, SYS, 0, 2);
+            emit_variable(c, STX, level, n->sym);
+        } else {
+            emit(c, SYS, 0, 2);
+            emit_variable(c, STO, level, n->sym);
+        }
+        break;
+    case NODE_WRITE:
+        generate_expression(c, n->left, level);
+        emit(c, SYS, 0, 1);
+        break;
+    case NODE_BEGIN:
+        for (node *s = n->left; s; s = s->next) generate_statement(c, s, level);
+        break;
+    case NODE_IF:
+        generate_expression(c, n->left, level);
+        cx1 = c->code_index;
+        emit(c, JPC, 0, 0); // to be patched
+        generate_statement(c, n->right, level);
+        cx2 = c->code_index;
+        emit(c, JMP, 0, 0); // to be patched
+        // patch JPC to ELSE-part address
+        c->code[cx1].m = code_address(c->code_index);
+        generate_statement(c, n->alt, level);
+        // patch JMP to FI (after else) address
+        c->code[cx2].m = code_address(c->code_index);
+        break;
+    case NODE_COBEGIN:
+        cx1 = c->code_index;
+        emit(c, COB, 0, 0); // call count, patched below
+        for (node *call = n->left; call; call = call->next) {
+            emit_call(c, level, call->sym);
+            c->code[cx1].m++;
+        }
+        break;
+    case NODE_WHILE:
+        cx1 = c->code_index; // loop start
+        generate_expression(c, n->left, level);
+        cx2 = c->code_index;
+        emit(c, JPC, 0, 0); // exit test, to patch
+        generate_statement(c, n->right, level);
+        // back-edge jump to start of loop
+        emit(c, JMP, 0, code_address(cx1));
+        // patch JPC to jump to instruction after loop body
+        c->code[cx2].m = code_address(c->code_index);
+        break;
+    }
+    c->statement_pos = outer_pos;
+}
+
+void generate_block(compiler *c, ast_block *b) {
+    int level = b->level;
+    int jmp_addr = c->code_index;
+
+    if (level == 0) {
+        c->current_pos = b->start_pos;
+        emit(c, JMP, 0, 0); // Placeholder for main
+    }
+    for (ast_block *p = b->procs; p; p = p->next) {
+        generate_block(c, p);
+    }
+
+    if (level == 0) {
+        // patch main JMP with VM code address
+        c->code[jmp_addr].m = code_address(c->code_index); // start of main
+        c->main_inc_index = c->code_index;
+    } else {
+        // the procedure's body starts here; patch calls made to it from
+        // the procedures nested inside it
+        c->sym_table[b->proc].addr = c->code_index;
+        for (int i = jmp_addr; i < c->code_index; i++) {
+            if (c->code[i].op == CAL && c->code[i].m == -(b->proc + 1)) {
+                c->code[i].m = code_address(c->code_index);
+            }
+        }
+    }
+
+    c->current_pos = b->body_pos;
+    emit(c, INC, 0, b->data_size); // allocate space for variables
+    generate_statement(c, b->body, level);
+
+    if (level > 0) {
+        c->current_pos = b->end_pos;
+        int params = c->sym_table[b->proc].params;
+        if (params < 0) {
+            emit(c, OPR, 0, RTN); // RTN (Return from procedure)
+        } else {
+            // falling off the end of a procedure with parameters returns 0
+            emit(c, LIT, 0, 0);
+            emit(c, OPR, params, RTV);
+        }
+        c->sym_table[b->proc].end = c->code_index - 1;
+    }
+}
+
+// fails if the frame of b or of a procedure inside it is larger than the
+// stack words the code leaves in the PAS; the VM would run it into the code
+void check_frames(compiler *c, ast_block *b, int stack_words) {
+    if (b->data_size > stack_words) {
+        c->current_pos = b->start_pos;
+        error(c, 36);
+    }
+    for (ast_block *p = b->procs; p; p = p->next) {
+        check_frames(c, p, stack_words);
+    }
+}
+
+// generates the code of the parsed unit: main's JMP, the procedures, main
+// and the halt, or for a module only its procedures
+void generate_code(compiler *c) {
+    if (c->module_name >= 0) {
+        for (ast_block *p = c->ast_root->procs; p; p = p->next) {
+            generate_block(c, p);
+        }
+        return;
+    }
+    generate_block(c, c->ast_root);
+    c->current_pos = c->halt_pos;
+    emit(c, SYS, 0, 3); // halt instruction
+    check_frames(c, c->ast_root, PAS_SIZE - code_address(c->code_index));
+}
+
+// --- MAIN FUNCTION ---
+// sets up c for a new compilation, keeping its options and the memory
+// of earlier ones
+void reset_compiler(compiler *c) {
+    c->code_index = 0;
+    c->sym_index = 0;
+    c->token_count = 0;
+    c->token_ptr = 0;
+    c->current_proc = -1;
+    c->reloc_count = 0;
+    c->module_name = -1;
+    c->global_words = 0;
+    c->main_inc_index = -1;
+    c->have_positions = 0;
+    strcpy(c->source_path, "-");
+    c->statement_pos.line = c->statement_pos.col = 0;
+    c->current_pos = c->statement_pos;
+    c->name_pool_used = 0;
+    c->name_count = 0;
+    if (c->name_hash) memset(c->name_hash, 0, c->name_hash_cap * sizeof(int));
+    c->error_flag = 0;
+    arena_reset(&c->ast);
+    c->ast_root = NULL;
+}
+
+// a compiler with the default options
+compiler *new_compiler() {
+    compiler *c = calloc(1, sizeof *c);
+    if (!c) {
+        fprintf(stderr, "Error: out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    c->bounds_check = 1;
+    c->fuel = PRECOMPUTE_FUEL;
+    reset_compiler(c);
+    return c;
+}
+
+void free_compiler(compiler *c) {
+    free(c->token_list);
+    free(c->name_pool);
+    free(c->name_start);
+    free(c->name_hash);
+    arena_free(&c->ast);
+    free(c);
+}
+
+// parses the token list into c's AST. returns 0, or the code of the
+// first error (see error_message) with its position in c->error_pos
+int parse(compiler *c) {
+    if (setjmp(c->failure)) {
+        return c->error_flag;
+    }
+    advance_token(c); // Initialize first token
+    program(c); // Start parsing
+    return 0;
+}
+
+// generates the code of the parsed AST; returns 0 or the error's code like
+// parse() (too much code, or a frame larger than the stack it leaves). An error
+// leaves the position of the statement
+int generate(compiler *c) {
+    if (setjmp(c->failure)) {
+        return c->error_flag;
+    }
+    generate_code(c);
+    return 0;
+}
+
+// the whole pipeline: parse, the --const-fold and --lift passes, code generation
+int compile(compiler *c) {
+    int error_code = parse(c);
+    if (error_code) {
+        return error_code;
+    }
+    if (c->fold_constants) {
+        fold_block(c->ast_root);
+    }
+    if (c->lift) {
+        lift_variables(c);
+    }
+    return generate(c);
+}
+
+// fills the token list from a scan of source; positions come from the
+// lexeme offsets
+void load_tokens(compiler *c, const tokenStream *ts, const char *source) {
+    int line = 1, line_start = 0, scanned = 0;
+    c->token_count = 0;
+    for (int i = 0; i < ts->count; i++) {
+        const lexeme *entry = &ts->table[i];
+        if (entry->token <= 0) continue;
+        c->token_list = grow_array(c->token_list, &c->token_cap, c->token_count + 1, sizeof(token));
+        token *t = &c->token_list[c->token_count++];
+        t->type = entry->token;
+        t->value = 0;
+        if (entry->token == identsym) {
+            t->value = intern_name(c, nameText(ts, entry->value));
+        } else if (entry->token == numbersym) {
+            t->value = entry->value;
+        }
+        // offsets only grow, so one sweep over the source finds every line
+        while (scanned < entry->offset) {
+            if (source[scanned] == '\n') {
+                line++;
+                line_start = scanned + 1;
+            }
+            scanned++;
+        }
+        t->line = line;
+        t->col = entry->offset - line_start + 1;
+    }
+    c->have_positions = 1;
+}
+
+// --batch: what compiling one source file gave
+typedef struct {
+    char name[256];
+    int error; // 0, an error code, or -1 if the file could not be read or written
+    source_position pos;
+    int instructions;
+} batch_result;
+
+typedef struct {
+    const char *dir, *out_dir;
+    batch_result *results;
+    int count;
+    atomic_int next; // next file to take
+    int bounds_check, fold_constants, lift, dead_code_elimination, precompute;
+    long long fuel;
+} batch_job;
+
+// reads a whole file, null-terminated; NULL if it cannot be read
+char *read_file(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    char *text = NULL;
+    int cap = 0, length = 0;
+    size_t bytes_read;
+    do {
+        text = grow_array(text, &cap, length + 65536, 1);
+        bytes_read = fread(text + length, 1, cap - length - 1, fp);
+        length += (int)bytes_read;
+    } while (bytes_read > 0);
+    text[length] = '\0';
+    fclose(fp);
+    return text;
+}
+
+// lexes and compiles one file with c, writing <out_dir>/<name>.elf like
+// elf.txt (the code, or the error message) if out_dir is set
+void batch_compile(compiler *c, batch_job *job, batch_result *result) {
+    char path[4096];
+    snprintf(path, sizeof path, "%s/%s", job->dir, result->name);
+    char *source = read_file(path);
+    if (!source) {
+        result->error = -1;
+        return;
+    }
+    tokenStream ts;
+    memset(&ts, 0, sizeof ts);
+    lexRange(&ts, source, 0, (int)strlen(source), 0);
+    reset_compiler(c);
+    load_tokens(c, &ts, source);
+    freeStream(&ts);
+    free(source);
+    snprintf(c->source_path, sizeof c->source_path, "%s", path);
+
+    result->error = compile(c);
+    result->pos = c->error_pos;
+    if (!result->error && c->dead_code_elimination) {
+        eliminate_dead_procedures(c);
+    }
+    if (!result->error && c->precompute) {
+        precompute_report report;
+        precompute(c, c->fuel, &report);
+    }
+    result->instructions = result->error ? 0 : c->code_index;
+    if (job->out_dir) {
+        snprintf(path, sizeof path, "%s/%s.elf", job->out_dir, result->name);
+        FILE *out = fopen(path, "w");
+        if (!out) {
+            result->error = -1;
+            return;
+        }
+        if (result->error) {
+            fprintf(out, "%s\n", error_message(result->error));
+        } else {
+            write_code_to_file(c, out);
+        }
+        fclose(out);
+    }
+}
+
+// a batch worker: takes files until none are left, reusing one compiler
+void *batch_worker(void *arg) {
+    batch_job *job = arg;
+    compiler *c = new_compiler();
+    c->bounds_check = job->bounds_check;
+    c->fold_constants = job->fold_constants;
+    c->lift = job->lift;
+    c->dead_code_elimination = job->dead_code_elimination;
+    c->precompute = job->precompute;
+    c->fuel = job->fuel;
+    int i;
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->count) {
+        batch_compile(c, job, &job->results[i]);
+    }
+    free_compiler(c);
+    return NULL;
+}
+
+int compare_results(const void *a, const void *b) {
+    return strcmp(((const batch_result *)a)->name, ((const batch_result *)b)->name);
+}
+
+#define MAX_BATCH_JOBS 1024 // upper bound for --jobs
+
+// --batch <dir>: compiles every *.pl0 file in dir on a pool of threads and
+// prints one line per file, in name order, then a summary. returns the exit
+// status: 0 if every file compiled
+int run_batch(batch_job *job, int threads) {
+    DIR *dir = opendir(job->dir);
+    if (!dir) {
+        perror(job->dir);
+        return EXIT_FAILURE;
+    }
+    int cap = 0;
+    struct dirent *entry;
+    job->count = 0;
+    job->results = NULL;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (len <= 4 || len >= sizeof job->results[0].name || strcmp(entry->d_name + len - 4, ".pl0") != 0) continue;
+        job->results = grow_array(job->results, &cap, job->count + 1, sizeof(batch_result));
+        memset(&job->results[job->count], 0, sizeof(batch_result));
+        strcpy(job->results[job->count].name, entry->d_name);
+        job->count++;
+    }
+    closedir(dir);
+    qsort(job->results, job->count, sizeof(batch_result), compare_results);
+    if (job->out_dir) mkdir(job->out_dir, 0755);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (threads < 1) threads = 1;
+    if (threads > job->count) threads = job->count > 0 ? job->count : 1;
+    pthread_t *workers = malloc(threads * sizeof(pthread_t));
+    atomic_init(&job->next, 0);
+    for (int t = 1; t < threads; t++) {
+        pthread_create(&workers[t], NULL, batch_worker, job);
+    }
+    batch_worker(job);
+    for (int t = 1; t < threads; t++) {
+        pthread_join(workers[t], NULL);
+    }
+    free(workers);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    int failed = 0;
+    for (int i = 0; i < job->count; i++) {
+        batch_result *r = &job->results[i];
+        if (r->error == 0) {
+            printf("%s: %d instructions\n", r->name, r->instructions);
+        } else if (r->error < 0) {
+            printf("%s: Error: could not read the file or write its output\n", r->name);
+            failed++;
+        } else {
+            printf("%s:%d:%d: %s\n", r->name, r->pos.line, r->pos.col, error_message(r->error));
+            failed++;
+        }
+    }
+    printf("batch: %d files, %d compiled, %d failed, %d threads, %.3f s (%.0f files/s)\n",
+           job->count, job->count - failed, failed, threads, seconds, seconds > 0 ? job->count / seconds : 0.0);
+    free(job->results);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [--emit-c <file.c>] [--native <executable>] [--no-bounds-check] [--const-fold] [--lift] [--dce] [--precompute [--fuel N]] [--debug] [--memo] [--object <file>] [--stats]\n"
+                    "       %s --batch <dir> [--jobs N] [--out <dir>] [--no-bounds-check] [--const-fold] [--lift] [--dce] [--precompute [--fuel N]]\n", name, name);
+}
+
+// the value of a numeric option: a whole decimal number in [low, high];
+// anything else prints the usage and exits
+long long option_count(const char *name, const char *option, const char *word, long long low, long long high) {
+    char *end;
+    errno = 0;
+    long long value = strtoll(word, &end, 10);
+    if (end == word || *end != '\0' || errno == ERANGE || value < low || value > high) {
+        fprintf(stderr, "Error: %s needs a whole number from %lld to %lld, not \"%s\".\n", option, low, high, word);
+        usage(name);
+        exit(EXIT_FAILURE);
+    }
+    return value;
+}
+
+int main(int argc, char *argv[]) {
+    const char *emit_c_path = NULL;  // --emit-c <file.c>
+    const char *native_path = NULL;  // --native <executable>
+    const char *batch_dir = NULL;    // --batch <dir>
+    const char *batch_out = NULL;    // --out <dir>
+    int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN); // --jobs
+    compiler *c = new_compiler();
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--emit-c") == 0 && i + 1 < argc) {
+            emit_c_path = argv[++i];
+        } else if (strcmp(argv[i], "--native") == 0 && i + 1 < argc) {
+            native_path = argv[++i];
+        } else if (strcmp(argv[i], "--no-bounds-check") == 0) {
+            c->bounds_check = 0;
+        } else if (strcmp(argv[i], "--dce") == 0) {
+            c->dead_code_elimination = 1;
+        } else if (strcmp(argv[i], "--const-fold") == 0) {
+            c->fold_constants = 1;
+        } else if (strcmp(argv[i], "--lift") == 0) {
+            c->lift = 1;
+        } else if (strcmp(argv[i], "--object") == 0 && i + 1 < argc) {
+            c->object_path = argv[++i];
+        } else if (strcmp(argv[i], "--debug") == 0) {
+            c->debug_info = 1;
+        } else if (strcmp(argv[i], "--memo") == 0) {
+            c->memo = 1;
+        } else if (strcmp(argv[i], "--precompute") == 0) {
+            c->precompute = 1;
+        } else if (strcmp(argv[i], "--fuel") == 0 && i + 1 < argc) {
+            c->fuel = option_count(argv[0], argv[i], argv[i + 1], 1, LLONG_MAX);
+            i++;
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch_dir = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            batch_out = argv[++i];
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = (int)option_count(argv[0], argv[i], argv[i + 1], 1, MAX_BATCH_JOBS);
+            i++;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats_init();
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    // an object's addresses are only final once linked
+    if (c->object_path && (emit_c_path || native_path || c->dead_code_elimination || c->precompute || c->debug_info
+                           || c->memo)) {
+        fprintf(stderr, "Error: --object cannot be combined with --emit-c, --native, --dce, --precompute, --debug or --memo.\n");
+        return EXIT_FAILURE;
+    }
+    if (batch_dir) {
+        if (emit_c_path || native_path || c->object_path || c->debug_info || c->memo) {
+            fprintf(stderr, "Error: --batch cannot be combined with --emit-c, --native, --object, --debug or --memo.\n");
+            return EXIT_FAILURE;
+        }
+        batch_job job = {0};
+        job.dir = batch_dir;
+        job.out_dir = batch_out;
+        job.bounds_check = c->bounds_check;
+        job.fold_constants = c->fold_constants;
+        job.lift = c->lift;
+        job.dead_code_elimination = c->dead_code_elimination;
+        job.precompute = c->precompute;
+        job.fuel = c->fuel;
+        free_compiler(c);
+        stats_begin("batch");
+        int status = run_batch(&job, jobs);
+        stats_end();
+        stats_report("parsercodegen_complete");
+        return status;
+    }
+
+    const char *output_path = c->object_path ? c->object_path : CODE_FILENAME;
+    FILE *code_file = fopen(output_path, "w"); // Open output file
+    if (!code_file) { // Check for file open error
+        fprintf(stderr, "Error: Could not open output file '%s'.\n",
+                output_path);
+        return EXIT_FAILURE;
+    }
+    stats_begin("read_token_list");
+    if (!read_token_list(c)) { // Load tokens from file
+        fclose(code_file);
+        return EXIT_FAILURE;
+    }
+    if (c->debug_info) read_token_positions(c);
+    stats_end();
+
+    // Check if any tokens were read
+    if (c->token_count == 0) {
         fprintf(stderr, "Error: Token input file '%s' is empty or invalid.\n",
                 TOKEN_FILENAME);
         fprintf(code_file, "Error: Token input file '%s' is empty or invalid.\n",
@@ -664,16 +3208,114 @@ int main(void) {
         fclose(code_file);
         return EXIT_SUCCESS;
     }
-    advance_token(); // Initialize first token
-    if (current_token == skipsym) {
-        error(1);
+    // compile(), one phase at a time
+    stats_begin("parse");
+    int error_code = parse(c);
+    stats_end();
+    if (!error_code && c->fold_constants) {
+        stats_begin("const_fold");
+        fold_block(c->ast_root);
+        stats_end();
+    }
+    if (!error_code && c->lift) {
+        stats_begin("lift");
+        int lifted = lift_variables(c);
+        stats_end();
+        fprintf(stderr, "lift: moved %d procedure variables into main's frame\n", lifted);
+    }
+    if (!error_code) {
+        stats_begin("codegen");
+        error_code = generate(c);
+        stats_end();
+    }
+    if (error_code) {
+        const char *msg = error_message(error_code);
+        if (c->have_positions) {
+            fprintf(stderr, "%s (line %d, column %d)\n", msg, c->error_pos.line, c->error_pos.col);
+        } else {
+            fprintf(stderr, "%s\n", msg);
+        }
+        fprintf(code_file, "%s\n", msg);
+        fclose(code_file);
+        return EXIT_SUCCESS;
+    }
+    if (c->dead_code_elimination) {
+        stats_begin("dead_code_elimination");
+        int total = c->code_index;
+        int removed = eliminate_dead_procedures(c);
+        stats_end();
+        fprintf(stderr, "dce: removed %d of %d instructions\n", removed, total);
+    }
+    if (c->precompute) {
+        stats_begin("precompute");
+        int total = c->code_index;
+        precompute_report report;
+        precompute(c, c->fuel, &report);
+        stats_end();
+        switch (report.outcome) {
+        case FOLD_PROGRAM:
+            fprintf(stderr, "precompute: evaluated the whole program (%lld instructions, %d outputs), %d of %d instructions left\n",
+                    report.steps, report.outputs, c->code_index, total);
+            break;
+        case FOLD_PREFIX:
+            fprintf(stderr, "precompute: stopped at the first %s after %lld instructions, folded the first %lld (%d outputs), resuming at %d with %d instructions added\n",
+                    report.input, report.input_step, report.steps, report.outputs, code_address(report.resume), report.added);
+            break;
+        case FOLD_NOTHING:
+            if (report.input) {
+                fprintf(stderr, "precompute: not folded, the first %s comes after %lld instructions\n", report.input, report.input_step);
+            } else {
+                fprintf(stderr, "precompute: not folded, halted outside main after %lld instructions\n", report.steps);
+            }
+            break;
+        case FOLD_FUEL:
+            fprintf(stderr, "precompute: not folded, still running after %lld instructions (see --fuel)\n", report.steps);
+            break;
+        case FOLD_ERROR:
+            fprintf(stderr, "precompute: not folded, runtime error after %lld instructions\n", report.steps);
+            break;
+        case FOLD_TOO_LARGE:
+            fprintf(stderr, "precompute: not folded, the folded code would not fit in the PAS\n");
+            break;
+        }
+    }
+    print_assembly_code(c);
+    print_symbol_table(c);
+    stats_begin("write_code_to_file");
+    if (c->object_path) {
+        write_object(c, code_file);
+    } else {
+        write_code_to_file(c, code_file);
+    }
+    fflush(code_file);
+    stats_end();
+    if (c->debug_info && write_debug_info(c) != 0) {
+        fclose(code_file);
+        return EXIT_FAILURE;
     }
-    program(); // Start parsing
-    if (!error_flag) {
-        print_assembly_code();
-        print_symbol_table();
-        write_code_to_file();
+    if (c->memo) {
+        stats_begin("memo_analysis");
+        int failed = write_memo_info(c) != 0;
+        stats_end();
+        if (failed) {
+            fclose(code_file);
+            return EXIT_FAILURE;
+        }
     }
     fclose(code_file); //Finished wooooo
+    if (emit_c_path) {
+        stats_begin("write_c_translation");
+        int failed = write_c_translation(c, emit_c_path) != 0;
+        stats_end();
+        if (failed) return EXIT_FAILURE;
+    }
+    if (native_path) {
+        stats_begin("build_native");
+        int failed = build_native(c, native_path) != 0;
+        stats_end();
+        if (failed) return EXIT_FAILURE;
+    }
+    free_compiler(c);
+    stats_report("parsercodegen_complete");
     return EXIT_SUCCESS;
 }
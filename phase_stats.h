@@ -0,0 +1,134 @@
+/*
+Phase timing shared by lex.c, parsercodegen_complete.c and vm.c (--stats).
+
+Each tool brackets its phases with stats_begin()/stats_end() and calls
+stats_report() at exit, which writes one JSON object to stderr:
+
+    {"tool": "vm", "perf": true, "phases": [
+      {"name": "execute", "wall_ms": 1.234, "cpu_ms": 1.200,
+       "cycles": 123, "instructions": 456, "branch_misses": 7, "cache_misses": 8}]}
+
+Wall time uses CLOCK_MONOTONIC and CPU time CLOCK_PROCESS_CPUTIME_ID.
+Hardware counters come from perf_event_open (user space only, inherited by
+threads) when the kernel allows it; otherwise "perf" is false and the
+counter fields are omitted.
+*/
+#ifndef PHASE_STATS_H
+#define PHASE_STATS_H
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define STATS_MAX_PHASES 16
+#define STATS_COUNTERS 4
+
+typedef struct phase_record {
+    const char *name;
+    double wall_ms;
+    double cpu_ms;
+    long long counters[STATS_COUNTERS];
+} phase_record;
+
+static int stats_enabled = 0;
+static int stats_counter_fd[STATS_COUNTERS] = {-1, -1, -1, -1};
+static int stats_have_counters = 0;
+static phase_record stats_phases[STATS_MAX_PHASES];
+static int stats_phase_count = 0;
+static double stats_wall_start, stats_cpu_start;
+static long long stats_counter_start[STATS_COUNTERS];
+static const char *stats_counter_names[STATS_COUNTERS] = {
+    "cycles", "instructions", "branch_misses", "cache_misses"
+};
+
+static double stats_clock_ms(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+static void stats_read_counters(long long *values) {
+    for (int i = 0; i < STATS_COUNTERS; i++) {
+        values[i] = 0;
+#ifdef __linux__
+        if (stats_counter_fd[i] >= 0 && read(stats_counter_fd[i], &values[i], sizeof values[i]) != sizeof values[i]) {
+            values[i] = 0;
+        }
+#endif
+    }
+}
+
+// turns stats collection on and opens the hardware counters if possible
+static void stats_init(void) {
+    stats_enabled = 1;
+#ifdef __linux__
+    static const unsigned long long configs[STATS_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES
+    };
+    stats_have_counters = 1;
+    for (int i = 0; i < STATS_COUNTERS; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof attr);
+        attr.size = sizeof attr;
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = 1;
+        stats_counter_fd[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (stats_counter_fd[i] < 0) stats_have_counters = 0;
+    }
+    if (!stats_have_counters) {
+        for (int i = 0; i < STATS_COUNTERS; i++) {
+            if (stats_counter_fd[i] >= 0) close(stats_counter_fd[i]);
+            stats_counter_fd[i] = -1;
+        }
+    }
+#endif
+}
+
+static void stats_begin(const char *name) {
+    if (!stats_enabled || stats_phase_count >= STATS_MAX_PHASES) return;
+    stats_phases[stats_phase_count].name = name;
+    if (stats_have_counters) stats_read_counters(stats_counter_start);
+    stats_cpu_start = stats_clock_ms(CLOCK_PROCESS_CPUTIME_ID);
+    stats_wall_start = stats_clock_ms(CLOCK_MONOTONIC);
+}
+
+static void stats_end(void) {
+    if (!stats_enabled || stats_phase_count >= STATS_MAX_PHASES) return;
+    phase_record *phase = &stats_phases[stats_phase_count++];
+    phase->wall_ms = stats_clock_ms(CLOCK_MONOTONIC) - stats_wall_start;
+    phase->cpu_ms = stats_clock_ms(CLOCK_PROCESS_CPUTIME_ID) - stats_cpu_start;
+    if (stats_have_counters) {
+        stats_read_counters(phase->counters);
+        for (int i = 0; i < STATS_COUNTERS; i++) phase->counters[i] -= stats_counter_start[i];
+    }
+}
+
+static void stats_report(const char *tool) {
+    if (!stats_enabled) return;
+    fprintf(stderr, "{\"tool\": \"%s\", \"perf\": %s, \"phases\": [", tool,
+            stats_have_counters ? "true" : "false");
+    for (int i = 0; i < stats_phase_count; i++) {
+        phase_record *phase = &stats_phases[i];
+        fprintf(stderr, "%s\n  {\"name\": \"%s\", \"wall_ms\": %.6f, \"cpu_ms\": %.6f",
+                i ? "," : "", phase->name, phase->wall_ms, phase->cpu_ms);
+        if (stats_have_counters) {
+            for (int c = 0; c < STATS_COUNTERS; c++) {
+                fprintf(stderr, ", \"%s\": %lld", stats_counter_names[c], phase->counters[c]);
+            }
+        }
+        fprintf(stderr, "}");
+    }
+    fprintf(stderr, "]}\n");
+}
+
+#endif
@@ -9,26 +9,127 @@ Language: C (only)
 
 To Compile:
     Scanner:
-        gcc -O2 -std=c11 -o lex lex.c
+        gcc -O2 -std=c11 -pthread -o lex lex.c
     Parser/Code Generator:
-        gcc -O2 -std=c11 -o parsercodegen_complete parsercodegen_complete.c
+        gcc -O2 -std=c11 -pthread -o parsercodegen_complete parsercodegen_complete.c
     Virtual Machine:
-        gcc -O2 -std=c11 -o vm vm.c
+        gcc -O2 -std=c11 -pthread -o vm vm.c -lrt
+    Metrics viewer:
+        gcc -O2 -std=c11 -o vmstat vmstat.c -lrt
 
 To Execute (on Eustis):
-    ./lex <input_file.txt>
+    ./lex [--stats] [--debug] [--threads N | --scale N] <input_file.txt>
     ./parsercodegen_complete
-    ./vm elf.txt
+    ./vm [--threads N] [--tos] [--stats] [--record log | --replay log]
+         [--debug elf.dbg] [--profile] [--no-trace] [--max-instructions N]
+         [--timeout s] [--memo elf.memo] [--no-metrics] elf.txt
+    ./vm --batch inputs.txt [--tos] [--max-instructions N] [--timeout s] elf.txt
+    ./vm --serve <socket> [--workers N] [--tos] [--max-instructions N] [--timeout s]
+         [--no-metrics] name=elf.txt [name2=other.txt ...]
+    ./vm --sessions <socket> [--max-instructions N] [--timeout s]
+         [--no-metrics] name=elf.txt [name2=other.txt ...]
+    ./vmstat [--interval s] [--count N] [pid]
 where:
     <input_file.txt> is the path to the PL/0 source program
 Notes:
     - lex.c accepts ONE command-line argument (input PL/0 source file)
-    - parsercodegen_complete.c accepts NO command-line arguments
+    - parsercodegen_complete.c reads tokens.txt and takes no file arguments
     - Input filename is hard-coded in parsercodegen_complete.c
     - Implements recursive-descent parser for extended PL/0 grammar
     - Supports procedures, call statements, and if-then-else
     - Generates PM/0 assembly code (see Appendix A for ISA)
     - VM must support EVEN instruction (OPR 0 11)
+    - LDX/STX L M access element pas[base(BP, L) - M - index], CHK 0 n
+      rejects indexes outside [0, n)
+    - LDA/STA 0 M load/store word M of main's frame, pas[F - M] where F
+      is the BP main starts with, without following static links (from
+      parsercodegen_complete --lift); M is resolved to the address at load
+    - OPR n 0 (RTN) also pops the n argument words the caller pushed above
+      the frame; OPR n 12 (RTV) does the same and leaves the value on top
+      of the stack on the caller's stack
+    - the fetch-execute loops sit in a section of their own (.text.loops,
+      see LOOP_SECTION) that starts on a 64-byte boundary, so their offset
+      within a cache line does not move with the size of unrelated code
+    - instructions are packed into 32-bit words in a code array kept apart
+      from the stack (PC is an instruction index internally; traces and
+      return addresses still use PM/0 addresses); jumps must target an
+      instruction and running past the last one is a runtime error
+    - --tos runs the interpreter variant that keeps the top of the stack in
+      a local variable (same trace and results, fewer stack loads/stores;
+      traced and profiled runs use the plain loop)
+    - --stats reports load/execute timings (and hardware counters where
+      perf_event_open is available) as JSON on stderr
+    - --debug elf.dbg (from parsercodegen_complete --debug) adds the source
+      line to traces ("-- line N (proc): text") and runtime errors;
+      --profile reports instructions executed per procedure and source
+      line (per instruction without --debug) on stderr
+    - --record log saves every input, output, the instruction count and
+      the exit status; --replay log reruns untraced with those inputs and
+      checks the rest (a failed run's last read fails again on replay)
+    - --no-trace runs untraced like a replay, printing only the prompts and
+      outputs; with --tos the run then uses the cached loop, which traced
+      and profiled runs leave for the plain one
+    - --max-instructions N and --timeout s (seconds) stop a run that goes
+      past them: the outputs so far stay on stdout, stderr says which limit
+      was reached and where, and the exit code is 3. They are checked only
+      at backward JMP/JPC, CAL, RTN and RTV, so a run may go past N by the
+      straight-line code before the next check (with --threads, N counts
+      tasks that are still running only approximately). A value that is
+      not a whole number (N) or a number of seconds (s) is an error, as is
+      any other malformed numeric option
+    - --memo elf.memo (from parsercodegen_complete --memo) caches the calls
+      of the procedures the compiler found to depend only on their
+      arguments and the outer variables they read: a call with inputs seen
+      before writes the recorded outer variables and result instead of
+      running. Calls, hits and the instructions they skipped are reported
+      per procedure on stderr; skipped instructions count in --record and
+      --replay but not in --max-instructions. A hit leaves the dead stack
+      below SP as it was, so only a program that reads a variable it never
+      wrote can tell. Not with --threads, --serve, --sessions or --batch
+    - --serve keeps the named programs loaded and answers requests on a
+      Unix socket: "<name> <input>...\n" -> "ok <outputs>...\n", or
+      "stopped instructions|timeout <outputs so far>...\n" when a limit
+      stops the request, or "error <reason>: <outputs so far>...\n" when
+      it fails. A request with an input that is not an integer gets
+      "error bad input:\n" and does not run
+    - --sessions serves interactive runs of the named programs on a Unix
+      socket, any number of them from one thread. A client sends a program
+      name, then input values as it goes; it gets "output <value>" lines,
+      "input" whenever the program waits for a value, and a last line
+      "halt", "stopped instructions|timeout" or "error <reason>" ("error
+      bad input" for a value that is not an integer). A run waiting for
+      input is suspended (registers and its own stack) rather than
+      blocking, and a long run gives up the thread every 65536
+      instructions; epoll wakes the sessions whose input arrives. The
+      limits apply per session, and --timeout counts the time it runs,
+      not the time it waits. Sessions always use the --tos loop
+    - every VM (and every --serve worker) publishes live metrics in the
+      shared-memory segment /pm0vm.<pid>, described in vm_metrics.h, and
+      removes it when it exits (also on a fatal signal);
+      vmstat without a pid lists the running VMs, with one it prints
+      instructions, calls and I/O per second, call depth, stack use and
+      the current PC/procedure every interval. The VM only does the work
+      while vmstat watches, at the same checkpoints as the limits above
+      (with --threads, COB tasks count in once they finish, and the calls
+      COB starts are not counted); --no-metrics leaves the segment out
+    - --batch runs the program once per line of inputs.txt (the values
+      SYS 0 2 reads) and prints a line per run as --serve replies do.
+      A line with a word that is not an integer is not run: "error bad input:".
+      Eight runs at a time execute in lockstep with one vector lane each;
+      runs that branch apart are split into separate groups, and a group
+      down to one run finishes in the scalar loop. Build with -mavx2 or
+      -march=native to have a lane group fit one AVX2 register. Batches
+      are not traced and have no metrics segment
+    - COB 0 n runs the n CAL instructions after it concurrently when the
+      VM is started with --threads N (N > 1); with one thread they run in order.
+      Each call gets an equal share of the free stack below the COB (a COB
+      inside a task splits that task's share)
+    - a run that could push below the bottom of the stack, or of a COB
+      task's share of it, stops with "runtime error: stack overflow". The
+      check is made at CAL, INC and jumps back, with room for the most the
+      code can push before the next one (found at load). An INC that
+      would move the stack pointer above the stack, into the code, is a
+      runtime error too
     - All development and testing performed on Eustis
 
 Class: COP3402 - System Software - Fall 2025
@@ -39,16 +140,57 @@ Due Date: Friday, November 21, 2025 at 11:59 PM ET
 */
 
 // libraries
+#define _GNU_SOURCE // sockets, fork and getline under -std=c11
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#include "phase_stats.h"
+#include "vm_metrics.h"
 
 // variables 
 #define PAS_SIZE 500 // as defined by section 3 (instructions file)
 #define TOP (PAS_SIZE - 1) // tracks top of code segment
+#define MAX_WORKERS 64 // upper bound for --threads
+#define MAX_TASKS 256  // pending tasks per worker deque
+#define MAX_PROGRAMS 64 // programs kept loaded by --serve
+#define MAX_SERVERS 256 // pre-forked --serve workers
+#define MAX_CODE (PAS_SIZE / 3) // instructions that fit in the PAS
 int CODE_FLOOR = PAS_SIZE; // tracks bottom of code segment
-int pas[PAS_SIZE] = {0}; // global program address space
-const char* op_mnemonics[] = {"LIT", "OPR", "LOD", "STO", "CAL", "INC", "JMP", "JPC", "SYS"};
+int pas_image[PAS_SIZE] = {0}; // program address space of the program given on the command line
+int *pas = pas_image; // program address space being executed
+const char* op_mnemonics[] = {"LIT", "OPR", "LOD", "STO", "CAL", "INC", "JMP", "JPC", "SYS", "COB",
+                              "LDX", "STX", "CHK", "LDA", "STA"};
+
+// execute() trace flags
+#define TRACE_PRINT 1   // print each instruction and the state after it
+#define TRACE_PROFILE 2 // count how often each instruction runs (--profile)
+
+// execute() results
+enum exec_status {
+    EXEC_HALT = 0,   // SYS 0 3 reached
+    EXEC_ERROR = 1,  // runtime error, already reported
+    EXEC_RETURN = 2, // task frame returned to its caller
+    EXEC_LIMIT = 3,  // --max-instructions or --timeout reached
+    EXEC_SUSPEND = 4 // --sessions: SYS 0 2 found no input yet; continue at suspended
+};
 
 
 // Instruction Register (IR)
@@ -58,6 +200,209 @@ typedef struct instruction {
     int m;
 } instruction;
 
+// packed instruction word: op in bits 0-4, L in bits 6-11 and a signed M
+// in bits 12-31. Instructions that do not fit set CODE_WIDE and are kept
+// whole in the wide table. JMP/JPC/CAL hold the target instruction index
+// instead of the PM/0 address TOP - m, and LDA/STA the PAS address of the
+// word (main's frame starts at CODE_FLOOR - 1) instead of its offset m
+#define CODE_OP_MASK 31
+#define CODE_WIDE 32
+#define CODE_L_SHIFT 6
+#define CODE_L_MASK 63
+#define CODE_M_SHIFT 12
+#define CODE_M_LIMIT (1 << 19)
+
+// code kept apart from the stack; PC is an index into it and becomes a
+// PM/0 address (TOP - 3 * PC) only in traces and return addresses
+typedef struct code_segment {
+    uint32_t words[MAX_CODE + 1];   // one past the end holds a CODE_WIDE sentinel
+    instruction wide[MAX_CODE + 1];
+    int length;
+    int reserve; // words the code can push between two stack checks (see stack_reserve)
+} code_segment;
+
+code_segment code; // code being executed (a global array, so fetch needs no base register)
+
+// --debug elf.dbg (written by parsercodegen_complete --debug): the source
+// position of every instruction and the instruction range of every procedure
+typedef struct proc_range {
+    char name[16];
+    int first, last;
+} proc_range;
+
+typedef struct debug_info {
+    int loaded;
+    int line[MAX_CODE], col[MAX_CODE];
+    proc_range procs[MAX_CODE + 1];
+    int proc_count;
+    char *source;       // PL/0 source text, NULL if it could not be read
+    char **source_line; // start of each line in source (1-based)
+    int source_lines;
+} debug_info;
+
+debug_info debug;
+long long profile_counts[MAX_CODE]; // --profile: executions of each instruction
+int task_trace = 0; // trace flags for COB tasks (only TRACE_PROFILE applies to them)
+_Thread_local int fault_index = -1; // instruction that raised this thread's runtime error
+_Thread_local int stack_floor = 0;  // lowest stack word the running code may push to (its COB segment's)
+
+// one procedure call started by COB, run on its own stack segment
+typedef struct task {
+    int PC, BP, SP;          // registers after the call frame is set up
+    int floor;               // lowest word of its segment
+    int stop_bp;             // BP the task returns to (the COB frame)
+    atomic_int *pending;     // join counter of the spawning COB
+} task;
+
+// work-stealing deque: the owner pushes and pops at the tail,
+// idle workers steal the oldest task from the head
+typedef struct worker {
+    task items[MAX_TASKS];
+    int head, tail;
+    pthread_mutex_t lock;
+    pthread_t thread;
+} worker;
+
+int num_workers = 1;              // --threads
+worker workers[MAX_WORKERS];
+_Thread_local int worker_id = 0;  // index of the calling thread's deque
+atomic_int pool_shutdown = 0;
+atomic_int program_halted = 0;    // SYS 0 3 executed inside a task
+atomic_int program_failed = 0;    // runtime error inside a task
+atomic_llong instructions_executed = 0; // across all threads
+atomic_int program_limited = 0;   // a limit stopped the run (in any thread)
+pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// a compiled program kept resident by --serve
+typedef struct program {
+    char name[64];
+    int image[PAS_SIZE]; // code loaded at the top, stack below CODE_FLOOR
+    code_segment code;
+    int code_floor;
+} program;
+
+program programs[MAX_PROGRAMS];
+int program_count = 0;
+
+// --max-instructions / --timeout. Only the instructions that can run code
+// again (backward JMP/JPC, CAL, RTN/RTV) check the budget: when a limit is set,
+// mark_limit_checks turns them into CODE_WIDE words at load time, and the
+// wide fetch path compares the loop's instruction count with
+// limit_check_at. Runs without limits keep their packed words and never
+// reach the check. Crossing limit_check_at calls limits_next_check, which
+// reads the clock at most every LIMIT_SLICE instructions; the straight-line
+// code between two checks is at most the program length, which bounds the
+// overshoot
+#define LIMIT_SLICE (1 << 14)
+long long max_instructions = 0;          // 0 = unlimited
+double timeout_seconds = 0;              // 0 = unlimited
+long long limit_first_check = LLONG_MAX; // limit_check_at a loop starts with (0 when limited)
+_Thread_local long long limit_check_at;  // count of the running loop that triggers the next check
+long long limit_start = 0;               // instructions_executed when the run started
+double limit_deadline = 0;
+_Thread_local long long limit_clock_at;  // count of the run at which --timeout reads the clock next
+const char *limit_reached = NULL;        // "instructions" or "timeout" once a limit stopped the run
+int limit_index = -1;                    // instruction that was stopped
+
+// --sessions: a suspended run is its stack plus the registers it continues
+// with. execute_cached fills suspended when SYS 0 2 has no input yet
+// (EXEC_SUSPEND), and limits_next_check does when the session's turn of
+// turn_slice instructions is over or turn_yield asks it to stop early (the
+// loop then returns EXEC_LIMIT with turn_yielded set)
+typedef struct continuation {
+    int PC, BP, SP;
+} continuation;
+
+continuation suspended;
+long long turn_slice = 0;   // 0 outside --sessions
+int turn_yield = 0;         // end the turn at the next checkpoint
+int turn_yielded = 0;
+
+// --memo elf.memo (written by parsercodegen_complete --memo): procedures
+// whose writes and result depend only on their arguments and the outer
+// variables they read (its inputs). Their CALs and returns become CODE_WIDE
+// checkpoints where limits_next_check stops the loop (memo_stopped) for
+// execute_memoized, which answers a CAL from memo_table when the same
+// inputs were seen before and otherwise runs it and records the outcome at
+// its return. A location is d static links up from the callee's frame, at
+// offset m
+#define MEMO_MAX_KEY 8        // arguments + inputs (as in parsercodegen_complete.c)
+#define MEMO_MAX_OUTPUTS 8
+#define MEMO_TABLE_SIZE 4096  // cached calls, direct-mapped: a new call replaces an old one
+
+typedef struct memo_location {
+    int d, m;
+} memo_location;
+
+typedef struct memo_proc {
+    char name[16];
+    int first, last;          // body
+    int args, result;         // parameter count; 1 if it returns with RTV
+    int input_count, output_count;
+    memo_location inputs[MEMO_MAX_KEY], outputs[MEMO_MAX_OUTPUTS];
+    long long calls, hits, skipped;
+} memo_proc;
+
+typedef struct memo_entry {
+    int proc;                 // memo_procs index + 1, 0 while empty
+    int key[MEMO_MAX_KEY];    // arguments, then inputs
+    int outputs[MEMO_MAX_OUTPUTS];
+    int result;
+    long long cost;           // instructions the call ran, CAL to return
+} memo_entry;
+
+// a memoized call that is running, recorded when it returns
+typedef struct memo_call {
+    int BP;                   // its frame
+    int key[MEMO_MAX_KEY];
+    long long start;          // instructions (run and skipped) before its CAL
+} memo_call;
+
+memo_proc *memo_procs = NULL;
+int memo_count = 0;               // 0 without --memo
+int *memo_op = NULL;              // memo_procs index + 1 at memoized CALs and returns
+memo_entry *memo_table = NULL;
+memo_call *memo_calls = NULL;     // PAS_SIZE of them: frames are at least 3 words
+int memo_depth = 0;
+int memo_stopped = 0;             // the loop stopped before a memo_op
+long long memo_skipped = 0;       // instructions that hits did not run
+
+// live metrics (see vm_metrics.h). The segment is created for every run
+// unless --no-metrics is given, but the loops only publish to it while a
+// reader watches: the metrics thread then marks the same checkpoints as a
+// limit does and resets every loop's limit_check_at about every
+// METRICS_POLL_MS (the wide path reads it from memory at every check), and
+// the next checkpoint calls limits_next_check, which writes a snapshot.
+// When the reader goes away the packed words come back. Only the CAL count
+// is kept by the loops all the time
+#define METRICS_POLL_MS 100
+vm_metrics *metrics = NULL;            // NULL with --no-metrics or without shared memory
+char metrics_name[64];
+atomic_int metrics_armed = 0;          // checkpoints marked for the metrics thread
+atomic_int metrics_due = 0;            // a snapshot was asked for and not written yet
+int metrics_stopping = 0;
+pthread_t metrics_thread;
+pthread_mutex_t metrics_wait_lock = PTHREAD_MUTEX_INITIALIZER; // lets metrics_close wake the thread
+pthread_cond_t metrics_wakeup = PTHREAD_COND_INITIALIZER;
+pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER; // one writer of the snapshot at a time
+long long *loop_checks[MAX_WORKERS];   // each worker's limit_check_at
+long long *call_counts[MAX_WORKERS];   // each worker's calls_made
+_Thread_local long long calls_made = 0; // CAL executed by this thread
+int metrics_max_depth = 0, metrics_max_stack = 0;
+
+int execute(int PC, int BP, int SP, int stop_bp, int trace);
+int execute_cached(int PC, int BP, int SP, int stop_bp, int trace);
+int (*execute_loop)(int PC, int BP, int SP, int stop_bp, int trace) = execute; // --tos selects execute_cached
+
+// SYS 0 2 / SYS 0 1 go through these so the VM can run without a console.
+// read_input returns 1 with a value, 0 when there is none (a runtime
+// error) and -1 when the run should suspend until there is (--sessions)
+int console_read(int *value);
+void console_write(int value);
+int (*read_input)(int *value) = console_read;
+void (*write_output)(int value) = console_write;
+const char *debug_proc_name(int k);
+
 
 // this is written by professor
 /* Find base L levels down from the current activation record */
@@ -73,9 +418,9 @@ int base(int BP, int L)
 }
 
 
-// print function
+// print function (PC is an instruction index, printed as its PM/0 address)
 void print_state(int PC, int BP, int SP) {
-    printf("%d %d %d ", PC, BP, SP);
+    printf("%d %d %d ", TOP - 3 * PC, BP, SP);
     int i, arb = BP;
     for (i = CODE_FLOOR - 1; i >= SP; i--) { 
         if (i == arb) { printf("| "); arb = pas[arb - 1]; }
@@ -85,21 +430,327 @@ void print_state(int PC, int BP, int SP) {
 }
 
 
-int main(int argc, char *argv[]) 
+// print an instruction's mnemonic and operands (the state follows on the same line)
+void print_instruction(int op, int l, int m)
 {
+    if (op == 5 || op == 7 || op == 8) m *= 3; // index back to PM/0 address
+    if (op == 14 || op == 15) m = CODE_FLOOR - 1 - m; // address back to the offset in main's frame
 
-    // exactly 1 argument check
-    if (argc != 2) {
-        fprintf(stderr, "ERROR: ONLY USE 1 input.txt\n");
-        return 1;
+    if (op == 2) // OPR (arithmetic operations)
+    {
+        // array for OPR mnemonics
+        static const char* opr_arithmetic[] = 
+        {
+            "RTN",  // 0
+            "ADD",  // 1
+            "SUB",  // 2
+            "MUL",  // 3
+            "DIV",  // 4
+            "EQL",  // 5
+            "NEQ",  // 6
+            "LSS",  // 7
+            "LEQ",  // 8
+            "GTR",  // 9
+            "GEQ",  // 10
+            "EVEN", // 11
+            "RTV"   // 12
+        };
+        const char* name;
+        if (m >= 0 && m <= 12) 
+        {
+            name = opr_arithmetic[m];
+        } 
+        else 
+        {
+            name = "OPR";
+        }
+        printf("%s %d %d ", name, l, m);
+    } 
+    else if (op >= 1 && op <= 15) // other operations
+    {
+        printf("%s %d %d ", op_mnemonics[op - 1], l, m);
+    } 
+    else // invalid opcode (should not occur in valid input)
+    {
+        printf("OP%d %d %d ", op, l, m);
+    }
+}
+
+
+// console I/O used when running a single program
+int console_read(int *value)
+{
+    printf("Please Enter an Integer: ");
+    if (scanf("%d", value) != 1)
+    {
+        fprintf(stderr, "failure to read integer\n");
+        return 0;
+    }
+    return 1;
+}
+
+void console_write(int value)
+{
+    printf("Output result is: %d\n", value);
+}
+
+// --record: console I/O that also logs every value
+// log format, one entry per line: "i <input>", "o <output>", "n <instructions>",
+// "s <exit status>" (0 halt, 1 runtime error or failed read, 3 limit)
+FILE *record_log = NULL;
+
+int record_read(int *value)
+{
+    if (!console_read(value)) return 0;
+    fprintf(record_log, "i %d\n", *value);
+    return 1;
+}
+
+void record_write(int value)
+{
+    console_write(value);
+    fprintf(record_log, "o %d\n", value);
+}
+
+// --replay: inputs come from the log, outputs are checked against it
+int *replay_inputs = NULL, *replay_outputs = NULL;
+int replay_input_count = 0, replay_output_count = 0;
+int replay_input_pos = 0, replay_output_pos = 0;
+long long replay_instructions = -1;
+int replay_status = -1; // recorded exit status, -1 in a log without one
+int replay_mismatch = 0;
+
+int replay_read(int *value)
+{
+    if (replay_input_pos >= replay_input_count)
+    {
+        if (replay_status > 0)
+        {
+            fprintf(stderr, "failure to read integer\n"); // as the recorded run failed
+            return 0;
+        }
+        fprintf(stderr, "replay: program reads more input than was recorded\n");
+        replay_mismatch = 1;
+        return 0;
+    }
+    *value = replay_inputs[replay_input_pos++];
+    return 1;
+}
+
+void replay_write(int value)
+{
+    if (replay_output_pos >= replay_output_count || replay_outputs[replay_output_pos] != value)
+    {
+        if (!replay_mismatch)
+        {
+            fprintf(stderr, "replay: output %d is %d, recorded %s\n", replay_output_pos + 1, value,
+                    replay_output_pos < replay_output_count ? "a different value" : "no more outputs");
+        }
+        replay_mismatch = 1;
+    }
+    replay_output_pos++;
+}
+
+int load_replay_log(const char *path)
+{
+    FILE *log = fopen(path, "r");
+    if (!log)
+    {
+        perror("error w/ replay log");
+        return 0;
+    }
+    char kind;
+    long long value;
+    int input_cap = 0, output_cap = 0;
+    while (fscanf(log, " %c %lld", &kind, &value) == 2)
+    {
+        if (kind == 'i' || kind == 'o')
+        {
+            int **values = (kind == 'i') ? &replay_inputs : &replay_outputs;
+            int *count = (kind == 'i') ? &replay_input_count : &replay_output_count;
+            int *cap = (kind == 'i') ? &input_cap : &output_cap;
+            if (*count == *cap)
+            {
+                *cap = *cap ? *cap * 2 : 64;
+                *values = realloc(*values, *cap * sizeof(int));
+                if (!*values)
+                {
+                    fprintf(stderr, "out of memory\n");
+                    exit(1);
+                }
+            }
+            (*values)[(*count)++] = (int)value;
+        }
+        else if (kind == 'n')
+        {
+            replay_instructions = value;
+        }
+        else if (kind == 's')
+        {
+            replay_status = (int)value;
+        }
+    }
+    fclose(log);
+    return 1;
+}
+
+double seconds_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// starts the --max-instructions / --timeout budget of a run
+void limits_start(void)
+{
+    if (max_instructions <= 0 && timeout_seconds <= 0) return;
+    limit_first_check = 0;
+    limit_start = instructions_executed;
+    limit_deadline = seconds_now() + timeout_seconds;
+    limit_clock_at = 0;
+    limit_reached = NULL;
+    limit_index = -1;
+    atomic_store(&program_limited, 0);
+}
+
+double wall_seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+long long calls_total(void)
+{
+    long long total = 0;
+    for (int i = 0; i < MAX_WORKERS; i++)
+    {
+        if (call_counts[i]) total += *call_counts[i];
+    }
+    return total;
+}
+
+// the seqlock write of a snapshot: begin makes seq odd, end even again
+void metrics_begin(void)
+{
+    pthread_mutex_lock(&metrics_lock);
+    atomic_fetch_add_explicit(&metrics->seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+void metrics_end(void)
+{
+    metrics->updated = wall_seconds();
+    metrics->samples++;
+    atomic_fetch_add_explicit(&metrics->seq, 1, memory_order_release);
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+// publishes the state of a loop at checkpoint k, with executed
+// instructions not yet added to instructions_executed
+void metrics_publish(long long executed, int k, int BP, int SP)
+{
+    int depth = 0;
+    for (int frame = BP; frame != CODE_FLOOR - 1 && frame > 0 && frame < CODE_FLOOR && depth < PAS_SIZE; depth++)
+    {
+        frame = pas[frame - 1]; // dynamic link
+    }
+    if (depth > metrics_max_depth) metrics_max_depth = depth;
+    if (CODE_FLOOR - SP > metrics_max_stack) metrics_max_stack = CODE_FLOOR - SP;
+
+    metrics_begin();
+    metrics->state = METRICS_RUNNING;
+    metrics->instructions = instructions_executed + executed;
+    metrics->calls = calls_total();
+    metrics->depth = depth;
+    metrics->max_depth = metrics_max_depth;
+    metrics->stack_words = CODE_FLOOR - SP;
+    metrics->max_stack_words = metrics_max_stack;
+    metrics->pc = TOP - 3 * k;
+    snprintf(metrics->procedure, sizeof metrics->procedure, "%s", debug.loaded ? debug_proc_name(k) : "");
+    metrics_end();
+}
+
+// publishes a state change (the run started, stopped, or a --serve request
+// finished) with the instruction count so far
+void metrics_state(int state)
+{
+    if (!metrics) return;
+    metrics_begin();
+    metrics->state = state;
+    metrics->instructions = instructions_executed;
+    metrics->calls = calls_total();
+    metrics_end();
+}
+
+// called by a loop whose count passed limit_check_at, at instruction k
+// with registers BP and SP (tasks that finished are already in
+// instructions_executed). Writes a metrics snapshot if one is due.
+// returns the next limit_check_at, or 0 when the run has to stop
+__attribute__((noinline)) long long limits_next_check(long long executed, int k, int BP, int SP)
+{
+    if (atomic_load(&metrics_due) && atomic_exchange(&metrics_due, 0)) metrics_publish(executed, k, BP, SP);
+    long long next = LLONG_MAX; // without limits only the metrics thread resets it
+    if (max_instructions > 0 || timeout_seconds > 0)
+    {
+        long long total = instructions_executed - limit_start + executed;
+        const char *reached = NULL;
+        if (atomic_load(&program_limited)) return 0; // another task already stopped
+        if (max_instructions > 0 && total >= max_instructions) reached = "instructions";
+        else if (timeout_seconds > 0 && total >= limit_clock_at)
+        {
+            limit_clock_at = total + LIMIT_SLICE;
+            if (seconds_now() >= limit_deadline) reached = "timeout";
+        }
+        if (reached)
+        {
+            if (!atomic_exchange(&program_limited, 1))
+            {
+                limit_reached = reached;
+                limit_index = k;
+            }
+            return 0;
+        }
+        next = LIMIT_SLICE;
+        if (max_instructions > 0 && max_instructions - total < next) next = max_instructions - total;
+        next += executed;
+    }
+    if (turn_slice > 0)
+    {
+        // --sessions: the session continues at k in its next turn
+        if (turn_yield || executed >= turn_slice)
+        {
+            suspended = (continuation){k, BP, SP};
+            turn_yielded = 1;
+            return 0;
+        }
+        if (turn_slice < next) next = turn_slice;
+    }
+    if (memo_count > 0)
+    {
+        // --memo: every checkpoint checks, and the loop stops before a
+        // memoized CAL or return for execute_memoized
+        if (memo_op[k])
+        {
+            suspended = (continuation){k, BP, SP};
+            memo_stopped = 1;
+            return 0;
+        }
+        return executed + 1;
     }
+    return next;
+}
 
+// loads "OP L M" lines into the top of image, returns the code floor or -1
+int load_program(const char *path, int *image)
+{
     // open input file
-    FILE *input = fopen(argv[1], "r");
+    FILE *input = fopen(path, "r");
     if (!input) 
     {
         perror("error w/ input file");
-        return 1;
+        return -1;
     }
 
     // variables for reading instructions
@@ -107,143 +758,777 @@ int main(int argc, char *argv[])
     int L;  // level
     int M;  // modifier
     int addr = PAS_SIZE - 1;
-    int instructionCount = 0;
     int lowestUsed = PAS_SIZE;    // last loaded M (track to set SP later)
     
     while (fscanf(input, "%d %d %d", &op, &L, &M) == 3) 
     {
-        pas[addr--] = op;  // OP
-        pas[addr--] = L;   // L
-        pas[addr--] = M;   // M
-        instructionCount++;
+        if (addr < 2)
+        {
+            fprintf(stderr, "error: %s does not fit in the program address space\n", path);
+            fclose(input);
+            return -1;
+        }
+        image[addr--] = op;  // OP
+        image[addr--] = L;   // L
+        image[addr--] = M;   // M
 
         if (addr + 1 < lowestUsed) lowestUsed = addr + 1; // last written M address
     }
     fclose(input);
+    return lowestUsed;
+}
 
-    // init registers per assignment details in section 3:
-    int PC = PAS_SIZE - 1;   
-    int SP = lowestUsed;    
-    int BP = SP - 1;
-    CODE_FLOOR = SP;
+// instruction index of a PM/0 code address, or code.length (the end
+// sentinel) if the address is not the start of an instruction
+int code_index(int address)
+{
+    int offset = TOP - address;
+    if (offset < 0 || offset % 3 != 0 || offset / 3 > code.length) return code.length;
+    return offset / 3;
+}
 
-    // fetch-execute cycle
-    instruction ir;
-    int halt = 0;
+// the packed word of an instruction, CODE_WIDE if it does not fit
+uint32_t pack_instruction(instruction ir)
+{
+    if (ir.op >= 0 && ir.op <= CODE_OP_MASK && ir.l >= 0 && ir.l <= CODE_L_MASK
+        && ir.m > -CODE_M_LIMIT && ir.m < CODE_M_LIMIT)
+    {
+        return (uint32_t)ir.op | ((uint32_t)ir.l << CODE_L_SHIFT) | ((uint32_t)ir.m << CODE_M_SHIFT);
+    }
+    return CODE_WIDE;
+}
 
-    // print initial values
-    printf("Initial values: %d %d %d\n", PC, BP, SP);
-    
-    // main execution loop
-    do {
-        // fetch cycle
-        ir.op = pas[PC];
-        ir.l = pas[PC - 1];
-        ir.m = pas[PC - 2];
-        PC -= 3;
-        
-        // print instruction before execution
-        int delayFlag = (ir.op == 9); // print SYS after we execute it (matches instructions formatting)
-        if (!delayFlag) 
+// the loops check the stack only where it can keep growing: CAL, INC and
+// jumps back. Each check asks for room for the frame or locals and for
+// reserve more words, the most that any run of instructions up to the next
+// check can push (over forward jumps, which cannot loop). A push past the
+// floor of the stack (or of a COB task's share) is then caught before it
+// happens, without testing each LIT and LOD
+int stack_reserve(const code_segment *segment)
+{
+    int most[MAX_CODE + 1]; // pushes from instruction k until the next check
+    int reserve = 0;
+    most[segment->length] = 0; // running off the end is an error
+    for (int k = segment->length - 1; k >= 0; k--)
+    {
+        instruction ir = segment->wide[k];
+        int effect = 0, after = most[k + 1];
+        switch (ir.op)
         {
-            if (ir.op == 2) // OPR (arithmetic operations)
-            {
-                // array for OPR mnemonics
-                static const char* opr_arithmetic[] = 
-                {
-                    "RTN",  // 0
-                    "ADD",  // 1
-                    "SUB",  // 2
-                    "MUL",  // 3
-                    "DIV",  // 4
-                    "EQL",  // 5
-                    "NEQ",  // 6
-                    "LSS",  // 7
-                    "LEQ",  // 8
-                    "GTR",  // 9
-                    "GEQ",  // 10
-                    "EVEN"  // 11
-                };
-                const char* name;
-                if (ir.m >= 0 && ir.m <= 11) 
-                {
-                    name = opr_arithmetic[ir.m];
-                } 
-                else 
-                {
-                    name = "OPR";
-                }
-                printf("%s %d %d ", name, ir.l, ir.m);
-            } 
-            else if (ir.op >= 1 && ir.op <= 9) // other operations
+            case 1: case 3: case 14: effect = 1; break;           // LIT, LOD, LDA
+            case 4: case 15: effect = -1; break;                  // STO, STA
+            case 12: effect = -2; break;                          // STX
+            case 2:                                               // OPR
+                if (ir.m == 0 || ir.m == 12) after = 0;           // RTN, RTV: the caller's CAL checked
+                else if (ir.m >= 1 && ir.m <= 10) effect = -1;
+                break;
+            case 5: case 6: after = 0; break;                     // CAL, INC check
+            case 7: after = ir.m > k ? most[ir.m] : 0; break;     // JMP back checks
+            case 8:                                               // JPC
+                effect = -1;
+                if (ir.m > k && most[ir.m] > after) after = most[ir.m];
+                break;
+            case 9:                                               // SYS
+                if (ir.m == 1) effect = -1;
+                else if (ir.m == 2) effect = 1;
+                else after = 0;
+                break;
+        }
+        most[k] = effect + after > 0 ? effect + after : 0;
+        if (most[k] > reserve) reserve = most[k];
+    }
+    return reserve;
+}
+
+// packs the instructions loaded at the top of image into segment.
+// returns 0 (after reporting) if a jump target is not an instruction
+int encode_program(const int *image, int code_floor, code_segment *segment, const char *path)
+{
+    segment->length = (PAS_SIZE - code_floor) / 3;
+    for (int k = 0; k < segment->length; k++)
+    {
+        instruction ir = {image[TOP - 3 * k], image[TOP - 3 * k - 1], image[TOP - 3 * k - 2]};
+        if (ir.op == 5 || ir.op == 7 || ir.op == 8) // CAL, JMP, JPC
+        {
+            if (ir.m < 0 || ir.m % 3 != 0 || ir.m / 3 >= segment->length)
             {
-                printf("%s %d %d ", op_mnemonics[ir.op - 1], ir.l, ir.m);
-            } 
-            else // invalid opcode (should not occur in valid input)
+                fprintf(stderr, "error: %s instruction %d jumps to %d, which is not an instruction\n", path, k, ir.m);
+                return 0;
+            }
+            ir.m /= 3;
+        }
+        else if (ir.op == 14 || ir.op == 15) // LDA, STA
+        {
+            if (ir.m < 0 || ir.m >= code_floor)
             {
-                printf("OP%d %d %d ", ir.op, ir.l, ir.m);
+                fprintf(stderr, "error: %s instruction %d addresses %d, which is outside main's frame\n", path, k, ir.m);
+                return 0;
             }
+            ir.m = code_floor - 1 - ir.m;
         }
-       
-        // execution
-        switch(ir.op){
-            case 1: // LIT
-                SP--;
-                pas[SP] = ir.m;
-                break;
+        segment->wide[k] = ir;
+        segment->words[k] = pack_instruction(ir);
+    }
+    segment->words[segment->length] = CODE_WIDE;
+    segment->reserve = stack_reserve(segment);
+    if (segment->reserve > code_floor)
+    {
+        fprintf(stderr, "error: %s leaves %d words of stack, and its code pushes up to %d\n", path, code_floor,
+                segment->reserve);
+        return 0;
+    }
+    return 1;
+}
 
-            case 2: // OPR
-                switch(ir.m){
-                    case 0: // RTN
-                        SP = BP + 1;
-                        BP = pas[SP - 2];
-                        PC = pas[SP - 3];
-                        break;
+// instructions that can run code again, where a budget is checked
+int is_checkpoint(instruction ir, int k)
+{
+    return (ir.op == 2 && (ir.m == 0 || ir.m == 12)) || ir.op == 5 || ((ir.op == 7 || ir.op == 8) && ir.m <= k);
+}
 
-                    case 1: // ADD
-                        pas[SP + 1] += pas[SP];
-                        SP++;
-                        break;
+// with --max-instructions or --timeout (or while metrics are watched),
+// sends the checkpoints through the wide fetch path (wide instructions
+// always check). A running loop may fetch from segment meanwhile; the
+// packed and the CODE_WIDE word of an instruction decode the same
+void mark_limit_checks(code_segment *segment)
+{
+    for (int k = 0; k < segment->length; k++)
+    {
+        if (is_checkpoint(segment->wide[k], k)) __atomic_store_n(&segment->words[k], CODE_WIDE, __ATOMIC_RELAXED);
+    }
+}
 
-                    case 2: // SUB
-                        pas[SP + 1] -= pas[SP];
-                        SP++;
-                        break;
+// packs the checkpoints again once metrics are no longer watched
+void unmark_limit_checks(code_segment *segment)
+{
+    for (int k = 0; k < segment->length; k++)
+    {
+        if (is_checkpoint(segment->wide[k], k))
+        {
+            __atomic_store_n(&segment->words[k], pack_instruction(segment->wide[k]), __ATOMIC_RELAXED);
+        }
+    }
+}
 
-                    case 3: // MUL
-                        pas[SP + 1] *= pas[SP];
-                        SP++;
-                        break;
+// SYS 0 2 / SYS 0 1 are counted by wrapping the selected I/O
+int (*metrics_target_read)(int *value);
+void (*metrics_target_write)(int value);
 
-                    case 4: // DIV
-                        pas[SP + 1] /= pas[SP];
-                        SP++;
-                        break;
+int metrics_read(int *value)
+{
+    int status = metrics_target_read(value);
+    if (status > 0) atomic_fetch_add_explicit(&metrics->io_reads, 1, memory_order_relaxed);
+    return status;
+}
 
-                    case 5: // EQL
-                        pas[SP + 1] = (pas[SP + 1] == pas[SP]);
-                        SP++;
-                        break;
+void metrics_write(int value)
+{
+    atomic_fetch_add_explicit(&metrics->io_writes, 1, memory_order_relaxed);
+    metrics_target_write(value);
+}
 
-                    case 6: // NEQ
-                        pas[SP + 1] = (pas[SP + 1] != pas[SP]);
-                        SP++;
-                        break;
+// the loops of this thread can be made to check at their next checkpoint
+void metrics_register_loop(void)
+{
+    loop_checks[worker_id] = &limit_check_at;
+    call_counts[worker_id] = &calls_made;
+}
 
-                    case 7: // LSS
-                        pas[SP + 1] = (pas[SP + 1] < pas[SP]);
-                        SP++;
-                        break;
+// runs beside the VM: marks the checkpoints while a reader keeps
+// watch_until ahead of the clock and asks for a snapshot every poll
+void *metrics_main(void *arg)
+{
+    (void)arg;
+    int limited = max_instructions > 0 || timeout_seconds > 0 || turn_slice > 0 || memo_count > 0; // checkpoints stay marked
+    pthread_mutex_lock(&metrics_wait_lock);
+    while (!metrics_stopping)
+    {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += METRICS_POLL_MS * 1000000L;
+        if (until.tv_nsec >= 1000000000L)
+        {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&metrics_wakeup, &metrics_wait_lock, &until);
+        if (metrics_stopping) break;
+        int watched = atomic_load(&metrics->watch_until) > wall_seconds();
+        if (watched)
+        {
+            if (!atomic_exchange(&metrics_armed, 1) && !limited)
+            {
+                mark_limit_checks(&code);
+                limit_first_check = 0;
+            }
+            atomic_store(&metrics_due, 1);
+            for (int i = 0; i < MAX_WORKERS; i++)
+            {
+                if (loop_checks[i]) __atomic_store_n(loop_checks[i], 0, __ATOMIC_RELAXED);
+            }
+        }
+        else if (atomic_load(&metrics_armed))
+        {
+            atomic_store(&metrics_armed, 0);
+            if (!limited)
+            {
+                unmark_limit_checks(&code);
+                limit_first_check = LLONG_MAX;
+            }
+        }
+    }
+    pthread_mutex_unlock(&metrics_wait_lock);
+    return NULL;
+}
 
-                    case 8: // LEQ
-                        pas[SP + 1] = (pas[SP + 1] <= pas[SP]);
-                        SP++;
-                        break;
+// removes the segment at exit, whatever way the VM leaves; vmstat's list
+// removes the ones of a VM that was killed with SIGKILL
+void metrics_unlink(void)
+{
+    if (metrics) shm_unlink(metrics_name);
+}
 
-                    case 9: // GTR
-                        pas[SP + 1] = (pas[SP + 1] > pas[SP]);
-                        SP++;
-                        break;
+// a signal that ends the VM: the segment goes first
+void metrics_fatal_signal(int sig)
+{
+    metrics_unlink();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+// creates /pm0vm.<pid> for the program being run and starts the metrics
+// thread; without shared memory the VM simply runs unobserved
+void metrics_open(const char *program)
+{
+    metrics_segment_name(metrics_name, sizeof metrics_name, (int)getpid());
+    int fd = shm_open(metrics_name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0) return;
+    void *segment = MAP_FAILED;
+    if (ftruncate(fd, sizeof(vm_metrics)) == 0)
+    {
+        segment = mmap(NULL, sizeof(vm_metrics), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (segment == MAP_FAILED)
+    {
+        shm_unlink(metrics_name);
+        return;
+    }
+    metrics = segment;
+    metrics->version = METRICS_VERSION;
+    metrics->pid = (int)getpid();
+    snprintf(metrics->program, sizeof metrics->program, "%s", program);
+    metrics->started = wall_seconds();
+    metrics->magic = METRICS_MAGIC; // last, so a reader never sees a half-made segment
+    atexit(metrics_unlink);
+    int fatal[] = {SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+    for (size_t i = 0; i < sizeof fatal / sizeof fatal[0]; i++)
+    {
+        // signals the VM handles itself (a server's stop, a session's trap) keep their handler
+        struct sigaction old;
+        if (sigaction(fatal[i], NULL, &old) == 0 && old.sa_handler == SIG_DFL) signal(fatal[i], metrics_fatal_signal);
+    }
+
+    metrics_target_read = read_input;
+    metrics_target_write = write_output;
+    read_input = metrics_read;
+    write_output = metrics_write;
+    metrics_register_loop();
+    if (pthread_create(&metrics_thread, NULL, metrics_main, NULL) != 0) metrics_thread = 0;
+}
+
+void metrics_close(void)
+{
+    if (!metrics) return;
+    pthread_mutex_lock(&metrics_wait_lock);
+    metrics_stopping = 1;
+    pthread_cond_signal(&metrics_wakeup);
+    pthread_mutex_unlock(&metrics_wait_lock);
+    if (metrics_thread) pthread_join(metrics_thread, NULL);
+    shm_unlink(metrics_name);
+}
+
+// a --serve worker is stopped with SIGTERM; its segment goes with it
+void metrics_stop_worker(int sig)
+{
+    (void)sig;
+    metrics_unlink();
+    _exit(0);
+}
+
+// reports running off the end of the code (or returning into nowhere)
+int past_end(int PC)
+{
+    fprintf(stderr, "runtime error: no instruction at PC %d\n", TOP - 3 * PC);
+    return EXEC_ERROR;
+}
+
+// reads the debug section for the program in code. Returns 0 (after
+// reporting) if the file is unreadable or describes a different program
+int load_debug_info(const char *path)
+{
+    FILE *input = fopen(path, "r");
+    if (!input)
+    {
+        perror("error w/ debug file");
+        return 0;
+    }
+    char source_path[4096];
+    int count;
+    if (fscanf(input, "pm0-debug 1 source %4095[^\n] code %d", source_path, &count) != 2 || count != code.length)
+    {
+        fprintf(stderr, "error: %s is not debug info for this program\n", path);
+        fclose(input);
+        return 0;
+    }
+    for (int k = 0; k < count; k++)
+    {
+        if (fscanf(input, "%d %d", &debug.line[k], &debug.col[k]) != 2) count = -1;
+    }
+    if (count < 0 || fscanf(input, " procs %d", &debug.proc_count) != 1
+        || debug.proc_count < 0 || debug.proc_count > MAX_CODE + 1)
+    {
+        fprintf(stderr, "error: %s is truncated\n", path);
+        fclose(input);
+        return 0;
+    }
+    for (int i = 0; i < debug.proc_count; i++)
+    {
+        proc_range *proc = &debug.procs[i];
+        if (fscanf(input, "%15s %d %d", proc->name, &proc->first, &proc->last) != 3)
+        {
+            fprintf(stderr, "error: %s is truncated\n", path);
+            fclose(input);
+            return 0;
+        }
+    }
+    fclose(input);
+    debug.loaded = 1;
+
+    // the source is optional; traces and reports just omit its text
+    FILE *text = strcmp(source_path, "-") ? fopen(source_path, "r") : NULL;
+    if (!text) return 1;
+    size_t cap = 0, length = 0, got;
+    char chunk[4096];
+    while ((got = fread(chunk, 1, sizeof chunk, text)) > 0)
+    {
+        if (length + got + 1 > cap)
+        {
+            cap = (length + got + 1) * 2;
+            char *grown = realloc(debug.source, cap);
+            if (!grown) { fclose(text); return 1; }
+            debug.source = grown;
+        }
+        memcpy(debug.source + length, chunk, got);
+        length += got;
+    }
+    fclose(text);
+    if (!debug.source) return 1;
+    debug.source[length] = '\0';
+    int lines = 1;
+    for (size_t i = 0; i < length; i++) lines += debug.source[i] == '\n';
+    debug.source_line = malloc((lines + 1) * sizeof(char *));
+    if (!debug.source_line) return 1;
+    char *start = debug.source;
+    debug.source_lines = 0;
+    for (char *c = debug.source; ; c++)
+    {
+        if (*c == '\n' || *c == '\0')
+        {
+            debug.source_line[++debug.source_lines] = start;
+            if (*c == '\0') break;
+            *c = '\0';
+            start = c + 1;
+        }
+    }
+    return 1;
+}
+
+// name of the procedure instruction k belongs to
+const char *debug_proc_name(int k)
+{
+    for (int i = 0; i < debug.proc_count; i++)
+    {
+        if (k >= debug.procs[i].first && k <= debug.procs[i].last) return debug.procs[i].name;
+    }
+    return "?";
+}
+
+// source text of a line with leading blanks skipped, "" if unknown
+const char *debug_source_text(int line)
+{
+    if (line < 1 || line > debug.source_lines) return "";
+    const char *text = debug.source_line[line];
+    while (*text == ' ' || *text == '\t') text++;
+    return text;
+}
+
+// follows a runtime error message with where instruction k came from
+// (nothing for k = -1, errors not raised by an instruction)
+void report_position(int k)
+{
+    if (!debug.loaded || k < 0 || k >= code.length) return;
+    fprintf(stderr, "    at line %d, column %d in %s: %s\n", debug.line[k], debug.col[k],
+            debug_proc_name(k), debug_source_text(debug.line[k]));
+}
+
+// the report on stderr when a run was stopped by a limit
+void report_limit(double elapsed)
+{
+    long long total = instructions_executed - limit_start;
+    if (strcmp(limit_reached, "timeout") == 0)
+    {
+        fprintf(stderr, "stopped: timeout of %.3f s reached after %lld instructions (%.3f s)\n",
+                timeout_seconds, total, elapsed);
+    }
+    else
+    {
+        fprintf(stderr, "stopped: instruction limit of %lld reached after %lld instructions (%.3f s)\n",
+                max_instructions, total, elapsed);
+    }
+    if (limit_index >= 0) fprintf(stderr, "    at PC %d\n", TOP - 3 * limit_index);
+    report_position(limit_index);
+}
+
+// traced runs with debug info print "-- line N (proc): text" whenever
+// execution moves to another source line
+void trace_source_line(int k)
+{
+    static int last_line = -1;
+    if (!debug.loaded || debug.line[k] == last_line) return;
+    last_line = debug.line[k];
+    printf("-- line %d (%s): %s\n", last_line, debug_proc_name(k), debug_source_text(last_line));
+}
+
+int compare_counts_desc(const void *a, const void *b)
+{
+    long long x = ((const long long *)a)[1], y = ((const long long *)b)[1];
+    return (x < y) - (x > y);
+}
+
+// --profile report on stderr: executions per procedure and per source line
+// (hottest first), or per instruction when there is no debug info
+void report_profile(void)
+{
+    long long total = 0;
+    for (int k = 0; k < code.length; k++) total += profile_counts[k];
+    fprintf(stderr, "profile: %lld instructions\n", total);
+    if (total == 0) return;
+
+    static long long rows[MAX_CODE + 1][2]; // key, count
+    int count = 0;
+    if (!debug.loaded)
+    {
+        for (int k = 0; k < code.length; k++)
+        {
+            if (profile_counts[k]) { rows[count][0] = k; rows[count][1] = profile_counts[k]; count++; }
+        }
+        qsort(rows, count, sizeof rows[0], compare_counts_desc);
+        fprintf(stderr, "%8s %14s %7s  %s\n", "pc", "instructions", "%", "instruction");
+        for (int i = 0; i < count; i++)
+        {
+            instruction ir = code.wide[rows[i][0]];
+            if (ir.op == 5 || ir.op == 7 || ir.op == 8) ir.m = TOP - 3 * ir.m;
+            fprintf(stderr, "%8d %14lld %7.2f  %s %d %d\n", TOP - 3 * (int)rows[i][0], rows[i][1],
+                    100.0 * rows[i][1] / total, ir.op >= 1 && ir.op <= 15 ? op_mnemonics[ir.op - 1] : "?",
+                    ir.l, ir.m);
+        }
+        return;
+    }
+
+    for (int i = 0; i < debug.proc_count; i++) { rows[i][0] = i; rows[i][1] = 0; }
+    for (int k = 0; k < code.length; k++)
+    {
+        for (int i = 0; i < debug.proc_count; i++)
+        {
+            if (k >= debug.procs[i].first && k <= debug.procs[i].last) { rows[i][1] += profile_counts[k]; break; }
+        }
+    }
+    qsort(rows, debug.proc_count, sizeof rows[0], compare_counts_desc);
+    fprintf(stderr, "%-16s %14s %7s\n", "procedure", "instructions", "%");
+    for (int i = 0; i < debug.proc_count && rows[i][1] > 0; i++)
+    {
+        fprintf(stderr, "%-16s %14lld %7.2f\n", debug.procs[rows[i][0]].name, rows[i][1], 100.0 * rows[i][1] / total);
+    }
+
+    // lines are merged by source line number
+    for (int k = 0; k < code.length; k++)
+    {
+        if (!profile_counts[k]) continue;
+        int i = 0;
+        while (i < count && rows[i][0] != debug.line[k]) i++;
+        if (i == count) { rows[count][0] = debug.line[k]; rows[count][1] = 0; count++; }
+        rows[i][1] += profile_counts[k];
+    }
+    qsort(rows, count, sizeof rows[0], compare_counts_desc);
+    fprintf(stderr, "%8s %14s %7s  %s\n", "line", "instructions", "%", "source");
+    for (int i = 0; i < count; i++)
+    {
+        fprintf(stderr, "%8lld %14lld %7.2f  %s\n", rows[i][0], rows[i][1], 100.0 * rows[i][1] / total,
+                debug_source_text((int)rows[i][0]));
+    }
+}
+
+// push a task onto the calling worker's deque
+int push_task(task t)
+{
+    worker *w = &workers[worker_id];
+    pthread_mutex_lock(&w->lock);
+    if (w->tail - w->head >= MAX_TASKS)
+    {
+        pthread_mutex_unlock(&w->lock);
+        return 0;
+    }
+    w->items[w->tail++ % MAX_TASKS] = t;
+    pthread_mutex_unlock(&w->lock);
+    return 1;
+}
+
+// take the newest task from our own deque, else steal the oldest from another
+int take_task(task *out)
+{
+    worker *w = &workers[worker_id];
+    pthread_mutex_lock(&w->lock);
+    if (w->tail > w->head)
+    {
+        *out = w->items[--w->tail % MAX_TASKS];
+        pthread_mutex_unlock(&w->lock);
+        return 1;
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    for (int i = 1; i < num_workers; i++)
+    {
+        worker *victim = &workers[(worker_id + i) % num_workers];
+        pthread_mutex_lock(&victim->lock);
+        if (victim->tail > victim->head)
+        {
+            *out = victim->items[victim->head++ % MAX_TASKS];
+            pthread_mutex_unlock(&victim->lock);
+            return 1;
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return 0;
+}
+
+void run_task(task *t)
+{
+    int outer_floor = stack_floor; // a worker joining a nested COB runs tasks inside another
+    stack_floor = t->floor;
+    int status = execute_loop(t->PC, t->BP, t->SP, t->stop_bp, task_trace);
+    stack_floor = outer_floor;
+    if (status == EXEC_HALT) atomic_store(&program_halted, 1);
+    if (status == EXEC_ERROR)
+    {
+        report_position(fault_index);
+        fault_index = -1; // reported; the COB that spawned us fails without a position
+        atomic_store(&program_failed, 1);
+    }
+    atomic_fetch_sub(t->pending, 1);
+}
+
+void *worker_main(void *arg)
+{
+    worker_id = (int)(long)arg;
+    metrics_register_loop();
+    task t;
+    while (!atomic_load(&pool_shutdown))
+    {
+        if (take_task(&t)) run_task(&t);
+        else sched_yield();
+    }
+    return NULL;
+}
+
+// COB 0 n: start the n CAL instructions at PC concurrently and wait for all of them.
+// the free stack of the running code, [stack_floor, SP), is split into one
+// segment per call, so a COB inside a task only divides that task's segment;
+// static links still point into the shared frames above. Returns 0 (after
+// reporting) if a segment is too small to start the call in
+int cobegin(int n, int PC, int BP, int SP)
+{
+    int segment = (SP - stack_floor) / n;
+    if (segment < 3 || segment < code.reserve) // the call frame, and the pushes before the callee's INC
+    {
+        fprintf(stderr, "runtime error: stack overflow\n");
+        return 0;
+    }
+    atomic_int pending = n;
+
+    for (int k = 0; k < n; k++)
+    {
+        instruction call = code.wide[PC + k];
+        if (task_trace & TRACE_PROFILE) profile_counts[PC + k]++;
+        int top = SP - k * segment;
+        task t;
+        pas[top - 1] = base(BP, call.l);        // SL
+        pas[top - 2] = BP;                      // DL
+        pas[top - 3] = TOP - 3 * (PC + n);      // RA (the join point)
+        t.BP = top - 1;
+        t.SP = top;
+        t.floor = top - segment;
+        t.PC = call.m;
+        t.stop_bp = BP;
+        t.pending = &pending;
+        if (!push_task(t)) run_task(&t); // deque full, run it here
+    }
+
+    // join: help with queued work until every call has returned
+    task t;
+    while (atomic_load(&pending) > 0)
+    {
+        if (take_task(&t)) run_task(&t);
+        else sched_yield();
+    }
+    return 1;
+}
+
+
+// the trace helpers and the two loops after them are kept together in
+// LOOP_SECTION, which starts on a 64-byte boundary, so where the loops land
+// in a cache line no longer moves with the size of unrelated code (each
+// place their dispatch can land costs or saves up to 20%)
+#define LOOP_SECTION section(".text.loops")
+
+// tracing and profiling of the instruction just fetched (PC has moved past
+// it). SYS is handled by trace_sys instead, after it executes, since its
+// trace line follows any output (matches instructions formatting). Both
+// helpers read the instruction back from code and stay out of line, so the
+// loops only test trace and keep their registers
+__attribute__((noinline, LOOP_SECTION, aligned(64))) void trace_fetch(int PC, int trace)
+{
+    instruction ir = code.wide[PC - 1];
+    if (trace & TRACE_PROFILE) __atomic_fetch_add(&profile_counts[PC - 1], 1, __ATOMIC_RELAXED);
+    if (trace & TRACE_PRINT)
+    {
+        trace_source_line(PC - 1);
+        print_instruction(ir.op, ir.l, ir.m);
+    }
+}
+
+// the state printed after an instruction executes
+__attribute__((noinline, LOOP_SECTION)) void trace_state(int trace, int PC, int BP, int SP)
+{
+    if (trace & TRACE_PRINT) print_state(PC, BP, SP);
+}
+
+// tracing and profiling of a SYS once it has executed
+__attribute__((noinline, LOOP_SECTION)) void trace_sys(int trace, int PC, int BP, int SP)
+{
+    if (trace & TRACE_PROFILE) __atomic_fetch_add(&profile_counts[PC - 1], 1, __ATOMIC_RELAXED);
+    if (trace & TRACE_PRINT)
+    {
+        trace_source_line(PC - 1);
+        printf("SYS %d %d ", code.wide[PC - 1].l, code.wide[PC - 1].m);
+        print_state(PC, BP, SP);
+    }
+}
+
+// fetch-execute cycle starting from the given registers.
+// returns when the program halts, fails, or (for tasks) the frame
+// whose dynamic link is stop_bp returns
+__attribute__((LOOP_SECTION)) int execute(int PC, int BP, int SP, int stop_bp, int trace)
+{
+    int op, l, m; // instruction register
+    int status;
+    long long executed = 0; // instructions run by this call
+    int low = stack_floor + code.reserve; // see stack_reserve
+    limit_check_at = limit_first_check;
+
+    do {
+        // fetch cycle: one packed word, wide instructions from the side table
+        uint32_t word = code.words[PC];
+        if (word & CODE_WIDE)
+        {
+            if (PC >= code.length) { status = past_end(PC); goto done; }
+            if (executed >= limit_check_at && !(limit_check_at = limits_next_check(executed, PC, BP, SP))) goto limited;
+            op = code.wide[PC].op;
+            l = code.wide[PC].l;
+            m = code.wide[PC].m;
+        }
+        else
+        {
+            op = word & CODE_OP_MASK;
+            l = (word >> CODE_L_SHIFT) & CODE_L_MASK;
+            m = (int32_t)word >> CODE_M_SHIFT;
+        }
+        PC++;
+        executed++;
+        
+        // print instruction before execution
+        if (trace && op != 9) trace_fetch(PC, trace);
+
+        // execution
+        switch(op){
+            case 1: // LIT
+                SP--;
+                pas[SP] = m;
+                break;
+
+            case 2: // OPR
+                switch(m){
+                    case 0: // RTN, also popping the L argument words above the frame
+                        SP = BP + 1 + l;
+                        PC = code_index(pas[BP - 2]);
+                        BP = pas[BP - 1];
+                        if (BP == stop_bp) { status = EXEC_RETURN; goto done; }
+                        break;
+
+                    case 1: // ADD
+                        pas[SP + 1] += pas[SP];
+                        SP++;
+                        break;
+
+                    case 2: // SUB
+                        pas[SP + 1] -= pas[SP];
+                        SP++;
+                        break;
+
+                    case 3: // MUL
+                        pas[SP + 1] *= pas[SP];
+                        SP++;
+                        break;
+
+                    case 4: // DIV
+                        if (pas[SP] == 0)
+                        {
+                            fprintf(stderr, "runtime error: division by zero\n");
+                            goto fail;
+                        }
+                        if (pas[SP] == -1 && pas[SP + 1] == INT_MIN)
+                        {
+                            fprintf(stderr, "runtime error: division overflow\n");
+                            goto fail;
+                        }
+                        pas[SP + 1] /= pas[SP];
+                        SP++;
+                        break;
+
+                    case 5: // EQL
+                        pas[SP + 1] = (pas[SP + 1] == pas[SP]);
+                        SP++;
+                        break;
+
+                    case 6: // NEQ
+                        pas[SP + 1] = (pas[SP + 1] != pas[SP]);
+                        SP++;
+                        break;
+
+                    case 7: // LSS
+                        pas[SP + 1] = (pas[SP + 1] < pas[SP]);
+                        SP++;
+                        break;
+
+                    case 8: // LEQ
+                        pas[SP + 1] = (pas[SP + 1] <= pas[SP]);
+                        SP++;
+                        break;
+
+                    case 9: // GTR
+                        pas[SP + 1] = (pas[SP + 1] > pas[SP]);
+                        SP++;
+                        break;
 
                     case 10: // GEQ
                         pas[SP + 1] = (pas[SP + 1] >= pas[SP]);
@@ -255,77 +1540,2165 @@ int main(int argc, char *argv[])
                         // Stack pointer does NOT change
                         pas[SP] = (pas[SP] % 2 == 0);
                         break;
+
+                    case 12: // RTV: RTN leaving the top of the stack on the caller's stack
+                        m = pas[SP]; // the result
+                        SP = BP + l; // BP + 1 + l, less the word the result takes
+                        PC = code_index(pas[BP - 2]);
+                        BP = pas[BP - 1];
+                        pas[SP] = m;
+                        if (BP == stop_bp) { status = EXEC_RETURN; goto done; }
+                        break;
                 }
                 break;
 
             case 3: // LOD
                 SP--;
-                pas[SP] = pas[base(BP, ir.l) - ir.m];
+                pas[SP] = pas[base(BP, l) - m];
                 break;
 
             case 4: // STO
-                pas[base(BP, ir.l) - ir.m] = pas[SP];
+                pas[base(BP, l) - m] = pas[SP];
+                SP++;
+                break;
+
+            case 14: // LDA: m is the address, resolved at load
+                SP--;
+                pas[SP] = pas[m];
+                break;
+
+            case 15: // STA
+                pas[m] = pas[SP];
                 SP++;
                 break;
 
             case 5: // CAL
-                pas[SP - 1] = base(BP, ir.l); // SL
+                if (SP - 3 < low) goto overflow;
+                pas[SP - 1] = base(BP, l); // SL
                 pas[SP - 2] = BP;             // DL
-                pas[SP - 3] = PC;             // RA
+                pas[SP - 3] = TOP - 3 * PC;   // RA
                 BP = SP - 1;
-                PC = TOP - ir.m;
+                PC = m;
+                calls_made++;
                 break;
 
             case 6: // INC
-                SP -= ir.m;
+                if (SP - m < low) goto overflow;
+                if (SP - m > CODE_FLOOR)
+                {
+                    fprintf(stderr, "runtime error: INC %d moves the stack into the code\n", m);
+                    goto fail;
+                }
+                SP -= m;
                 break;
 
             case 7: // JMP
-                PC = (TOP - ir.m);
+                if (SP < low && m < PC) goto overflow;
+                PC = m;
                 break;
 
             case 8: // JPC
                 if (pas[SP] == 0) {
-                    PC = TOP - ir.m;
+                    if (SP + 1 < low && m < PC) goto overflow;
+                    PC = m;
                 }
                 SP++;
                 break;
 
             case 9: // SYS
-                switch (ir.m) {
+                if (num_workers > 1) pthread_mutex_lock(&io_lock);
+                switch (m) {
                     case 1: // output
-                        printf("Output result is: %d\n", pas[SP]);
+                        write_output(pas[SP]);
                         SP++;
                         break;
 
                     case 2: // read
-                        printf("Please Enter an Integer: ");
                         SP--;
-                        if (scanf("%d", &pas[SP]) != 1) 
+                        if (!read_input(&pas[SP])) 
                         {
-                            fprintf(stderr, "failure to read integer\n");
-                            return 1;
+                            if (num_workers > 1) pthread_mutex_unlock(&io_lock);
+                            goto fail;
                         }
                         break;
 
                     case 3: // hlt
-                        halt = 1;
-                        break;
+                        if (trace) trace_sys(trace, PC, BP, SP);
+                        if (num_workers > 1) pthread_mutex_unlock(&io_lock);
+                        status = EXEC_HALT;
+                        goto done;
 
                     default:
-                        fprintf(stderr, "runtime error: invalid SYS m=%d\n", ir.m);
-                        return 1;
+                        fprintf(stderr, "runtime error: invalid SYS m=%d\n", m);
+                        if (num_workers > 1) pthread_mutex_unlock(&io_lock);
+                        goto fail;
                 }
+                if (num_workers > 1) pthread_mutex_unlock(&io_lock);
                 // print delayed for SYS
-                printf("SYS %d %d ", ir.l, ir.m);
-                print_state(PC, BP, SP);
+                if (trace) trace_sys(trace, PC, BP, SP);
                 continue;  
+
+            case 10: // COB
+                // with a single worker the CALs that follow simply run in order
+                if (num_workers > 1) {
+                    if (!cobegin(m, PC, BP, SP)) goto fail;
+                    PC += m;
+                    executed += m; // the CALs count as executed, as with one thread
+                    if (atomic_load(&program_failed)) { status = EXEC_ERROR; goto done; }
+                    if (atomic_load(&program_limited)) goto limited;
+                    limit_check_at = limit_first_check; // tasks run here may have moved it
+                    if (atomic_load(&program_halted)) { status = EXEC_HALT; goto done; }
+                }
+                break;
+
+            case 11: // LDX: replace the index on top with the array element
+                pas[SP] = pas[base(BP, l) - m - pas[SP]];
+                break;
+
+            case 12: // STX: store top into the array element indexed by the entry below it
+                pas[base(BP, l) - m - pas[SP + 1]] = pas[SP];
+                SP += 2;
+                break;
+
+            case 13: // CHK: index on top must be in [0, m)
+                if (pas[SP] < 0 || pas[SP] >= m)
+                {
+                    fprintf(stderr, "runtime error: array index %d out of bounds [0, %d)\n", pas[SP], m);
+                    goto fail;
+                }
+                break;
         }       
 
         // print state for current execution
-        print_state(PC, BP, SP);
+        if (trace) trace_state(trace, PC, BP, SP);
 
-    } while (!halt);
+    } while (1);
 
-    return 0;
+overflow: // the code from here on could push below the floor of this stack (or COB segment)
+    fprintf(stderr, "runtime error: stack overflow\n");
+fail: // runtime error, already reported; the caller adds where it happened
+    fault_index = PC - 1;
+    status = EXEC_ERROR;
+    goto done;
+limited: // reported by the caller
+    status = EXEC_LIMIT;
+done:
+    atomic_fetch_add(&instructions_executed, executed);
+    return status;
+}
+
+
+// --tos: the same fetch-execute cycle with the top of the stack cached in a
+// local. While cached is set, tos holds the value of pas[SP] and the memory
+// copy may be stale; it is written back only where memory must be current
+// (CAL, INC, COB, SYS read), so "LIT; STO", "LOD; JPC" and binary OPRs
+// touch the stack in memory once instead of three times. Traced and
+// profiled runs print the same lines either way, so they use execute()
+__attribute__((LOOP_SECTION)) int execute_cached(int PC, int BP, int SP, int stop_bp, int trace)
+{
+    if (trace) return execute(PC, BP, SP, stop_bp, trace);
+
+    int op, l, m; // instruction register
+    int status;
+    long long executed = 0; // instructions run by this call
+    int low = stack_floor + code.reserve; // see stack_reserve
+    int tos = 0;            // top of stack while cached
+    int cached = 0;
+    limit_check_at = limit_first_check;
+
+    do {
+        // fetch cycle: one packed word, wide instructions from the side table
+        uint32_t word = code.words[PC];
+        if (word & CODE_WIDE)
+        {
+            if (PC >= code.length) { status = past_end(PC); goto done; }
+            if (executed >= limit_check_at && !(limit_check_at = limits_next_check(executed, PC, BP, SP))) goto limited;
+            op = code.wide[PC].op;
+            l = code.wide[PC].l;
+            m = code.wide[PC].m;
+        }
+        else
+        {
+            op = word & CODE_OP_MASK;
+            l = (word >> CODE_L_SHIFT) & CODE_L_MASK;
+            m = (int32_t)word >> CODE_M_SHIFT;
+        }
+        PC++;
+        executed++;
+
+        switch(op){
+            case 1: // LIT
+                if (cached) pas[SP] = tos;
+                SP--;
+                tos = m;
+                cached = 1;
+                break;
+
+            case 2: // OPR
+                if (m == 0) // RTN, the frame's stack and the L arguments are discarded
+                {
+                    cached = 0;
+                    SP = BP + 1 + l;
+                    PC = code_index(pas[BP - 2]);
+                    BP = pas[BP - 1];
+                    if (BP == stop_bp) { status = EXEC_RETURN; goto done; }
+                    break;
+                }
+                if (m == 12) // RTV: the same, with the result left cached on the caller's stack
+                {
+                    if (!cached) tos = pas[SP];
+                    cached = 1;
+                    SP = BP + l;
+                    PC = code_index(pas[BP - 2]);
+                    BP = pas[BP - 1];
+                    if (BP == stop_bp) { status = EXEC_RETURN; goto done; }
+                    break;
+                }
+                if (!cached) tos = pas[SP];
+                cached = 1;
+                switch(m){
+                    case 1: tos = pas[SP + 1] + tos; SP++; break;   // ADD
+                    case 2: tos = pas[SP + 1] - tos; SP++; break;   // SUB
+                    case 3: tos = pas[SP + 1] * tos; SP++; break;   // MUL
+                    case 4: // DIV
+                        if (tos == 0 || (tos == -1 && pas[SP + 1] == INT_MIN))
+                        {
+                            fprintf(stderr, "runtime error: division %s\n", tos ? "overflow" : "by zero");
+                            goto fail;
+                        }
+                        tos = pas[SP + 1] / tos;
+                        SP++;
+                        break;
+                    case 5: tos = (pas[SP + 1] == tos); SP++; break; // EQL
+                    case 6: tos = (pas[SP + 1] != tos); SP++; break; // NEQ
+                    case 7: tos = (pas[SP + 1] < tos); SP++; break;  // LSS
+                    case 8: tos = (pas[SP + 1] <= tos); SP++; break; // LEQ
+                    case 9: tos = (pas[SP + 1] > tos); SP++; break;  // GTR
+                    case 10: tos = (pas[SP + 1] >= tos); SP++; break; // GEQ
+                    case 11: tos = (tos % 2 == 0); break;            // EVEN
+                }
+                break;
+
+            case 3: // LOD
+                if (cached) pas[SP] = tos;
+                SP--;
+                tos = pas[base(BP, l) - m];
+                cached = 1;
+                break;
+
+            case 4: // STO
+                pas[base(BP, l) - m] = cached ? tos : pas[SP];
+                SP++;
+                cached = 0;
+                break;
+
+            case 14: // LDA
+                if (cached) pas[SP] = tos;
+                SP--;
+                tos = pas[m];
+                cached = 1;
+                break;
+
+            case 15: // STA
+                pas[m] = cached ? tos : pas[SP];
+                SP++;
+                cached = 0;
+                break;
+
+            case 5: // CAL
+                if (SP - 3 < low) goto overflow;
+                calls_made++;
+                if (cached) pas[SP] = tos;
+                cached = 0;
+                pas[SP - 1] = base(BP, l); // SL
+                pas[SP - 2] = BP;             // DL
+                pas[SP - 3] = TOP - 3 * PC;   // RA
+                BP = SP - 1;
+                PC = m;
+                break;
+
+            case 6: // INC
+                if (SP - m < low) goto overflow;
+                if (SP - m > CODE_FLOOR)
+                {
+                    fprintf(stderr, "runtime error: INC %d moves the stack into the code\n", m);
+                    goto fail;
+                }
+                if (cached) pas[SP] = tos;
+                cached = 0;
+                SP -= m;
+                break;
+
+            case 7: // JMP
+                if (SP < low && m < PC) goto overflow;
+                PC = m;
+                break;
+
+            case 8: // JPC
+                if ((cached ? tos : pas[SP]) == 0) {
+                    if (SP + 1 < low && m < PC) goto overflow;
+                    PC = m;
+                }
+                SP++;
+                cached = 0;
+                break;
+
+            case 9: // SYS
+                if (cached) pas[SP] = tos;
+                cached = 0;
+                if (num_workers > 1) pthread_mutex_lock(&io_lock);
+                switch (m) {
+                    case 1: // output
+                        write_output(pas[SP]);
+                        SP++;
+                        break;
+
+                    case 2: // read
+                        SP--;
+                        m = read_input(&pas[SP]);
+                        if (m <= 0)
+                        {
+                            if (num_workers > 1) pthread_mutex_unlock(&io_lock);
+                            if (m < 0) goto suspend;
+                            goto fail;
+                        }
+                        break;
+
+                    case 3: // hlt
+                        if (num_workers > 1) pthread_mutex_unlock(&io_lock);
+                        status = EXEC_HALT;
+                        goto done;
+
+                    default:
+                        fprintf(stderr, "runtime error: invalid SYS m=%d\n", m);
+                        if (num_workers > 1) pthread_mutex_unlock(&io_lock);
+                        goto fail;
+                }
+                if (num_workers > 1) pthread_mutex_unlock(&io_lock);
+                continue;
+
+            case 10: // COB
+                if (cached) pas[SP] = tos;
+                cached = 0;
+                if (num_workers > 1) {
+                    if (!cobegin(m, PC, BP, SP)) goto fail;
+                    PC += m;
+                    executed += m; // the CALs count as executed, as with one thread
+                    if (atomic_load(&program_failed)) { status = EXEC_ERROR; goto done; }
+                    if (atomic_load(&program_limited)) goto limited;
+                    limit_check_at = limit_first_check; // tasks run here may have moved it
+                    if (atomic_load(&program_halted)) { status = EXEC_HALT; goto done; }
+                }
+                break;
+
+            case 11: // LDX
+                if (!cached) tos = pas[SP];
+                tos = pas[base(BP, l) - m - tos];
+                cached = 1;
+                break;
+
+            case 12: // STX: the index is always in memory below the value
+                pas[base(BP, l) - m - pas[SP + 1]] = cached ? tos : pas[SP];
+                SP += 2;
+                cached = 0;
+                break;
+
+            case 13: // CHK
+                if (!cached) tos = pas[SP];
+                cached = 1;
+                if (tos < 0 || tos >= m)
+                {
+                    fprintf(stderr, "runtime error: array index %d out of bounds [0, %d)\n", tos, m);
+                    goto fail;
+                }
+                break;
+        }
+    } while (1);
+
+overflow: // the code from here on could push below the floor of this stack (or COB segment)
+    fprintf(stderr, "runtime error: stack overflow\n");
+fail: // runtime error, already reported; the caller adds where it happened
+    fault_index = PC - 1;
+    status = EXEC_ERROR;
+    goto done;
+suspend: // the SYS 0 2 runs again when the session is resumed
+    SP++;
+    executed--;
+    suspended = (continuation){PC - 1, BP, SP};
+    status = EXEC_SUSPEND;
+    goto done;
+limited: // reported by the caller
+    status = EXEC_LIMIT;
+done:
+    if (cached) pas[SP] = tos;
+    atomic_fetch_add(&instructions_executed, executed);
+    return status;
+}
+
+
+// --memo: reads elf.memo for the program in code, then marks the CALs to
+// its procedures and their returns. Returns 0 (after reporting) if the
+// file is unreadable or describes a different program
+int load_memo_info(const char *path)
+{
+    FILE *input = fopen(path, "r");
+    if (!input)
+    {
+        perror("error w/ memo file");
+        return 0;
+    }
+    int count, procs;
+    if (fscanf(input, "pm0-memo 1 code %d procs %d", &count, &procs) != 2 || count != code.length
+        || procs < 0 || procs > MAX_CODE)
+    {
+        fprintf(stderr, "error: %s is not memo info for this program\n", path);
+        fclose(input);
+        return 0;
+    }
+    memo_procs = calloc(procs + 1, sizeof(memo_proc));
+    memo_op = calloc(MAX_CODE + 1, sizeof(int));
+    memo_calls = calloc(PAS_SIZE, sizeof(memo_call));
+    memo_table = calloc(MEMO_TABLE_SIZE, sizeof(memo_entry));
+    if (!memo_procs || !memo_op || !memo_calls || !memo_table)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < procs; i++)
+    {
+        memo_proc *p = &memo_procs[i];
+        int ok = fscanf(input, "%15s %d %d %d %d in %d", p->name, &p->first, &p->last, &p->args, &p->result,
+                        &p->input_count) == 6
+                 && p->first >= 0 && p->first <= p->last && p->last < code.length && p->args >= 0
+                 && p->input_count >= 0 && p->args + p->input_count <= MEMO_MAX_KEY;
+        for (int j = 0; ok && j < p->input_count; j++)
+        {
+            ok = fscanf(input, "%d %d", &p->inputs[j].d, &p->inputs[j].m) == 2 && p->inputs[j].d > 0;
+        }
+        ok = ok && fscanf(input, " out %d", &p->output_count) == 1 && p->output_count >= 0
+             && p->output_count <= MEMO_MAX_OUTPUTS;
+        for (int j = 0; ok && j < p->output_count; j++)
+        {
+            ok = fscanf(input, "%d %d", &p->outputs[j].d, &p->outputs[j].m) == 2 && p->outputs[j].d > 0;
+        }
+        if (!ok)
+        {
+            fprintf(stderr, "error: %s is truncated or malformed\n", path);
+            fclose(input);
+            return 0;
+        }
+    }
+    fclose(input);
+
+    for (int i = 0; i < procs; i++)
+    {
+        for (int k = 0; k < code.length; k++)
+        {
+            instruction ir = code.wide[k];
+            int is_return = ir.op == 2 && (ir.m == 0 || ir.m == 12) && k >= memo_procs[i].first && k <= memo_procs[i].last;
+            if (is_return || (ir.op == 5 && ir.m == memo_procs[i].first)) memo_op[k] = i + 1;
+        }
+    }
+    for (int k = 0; k < code.length; k++)
+    {
+        if (memo_op[k]) code.words[k] = CODE_WIDE;
+    }
+    memo_count = procs;
+    limit_first_check = 0;
+    return 1;
+}
+
+// the table slot of a call to procedure p with key
+unsigned memo_slot(int p, const int *key, int length)
+{
+    unsigned hash = 2166136261u ^ (unsigned)p;
+    for (int i = 0; i < length; i++)
+    {
+        hash = (hash ^ (unsigned)key[i]) * 16777619u;
+    }
+    return (hash ^ (hash >> 15)) & (MEMO_TABLE_SIZE - 1);
+}
+
+// runs the program like execute_loop, handling the memoized CALs and
+// returns the loop stops at. A hit writes the recorded outputs, pops the
+// arguments (pushing the result) and continues after the CAL; a miss makes
+// the call, and its return fills the slot. Instructions a hit skips count
+// in memo_skipped, so executed + skipped matches a run without --memo
+int execute_memoized(int PC, int BP, int SP, int trace)
+{
+    for (;;)
+    {
+        memo_stopped = 0;
+        int status = execute_loop(PC, BP, SP, -1, trace);
+        if (status != EXEC_LIMIT || !memo_stopped) return status;
+        PC = suspended.PC;
+        BP = suspended.BP;
+        SP = suspended.SP;
+        instruction ir = code.wide[PC];
+        int proc = memo_op[PC] - 1;
+        memo_proc *p = &memo_procs[proc];
+
+        if (ir.op == 5) // CAL
+        {
+            int link = base(BP, ir.l);
+            int key[MEMO_MAX_KEY];
+            int length = p->args + p->input_count;
+            for (int i = 0; i < p->args; i++) key[i] = pas[SP + i];
+            for (int i = 0; i < p->input_count; i++)
+            {
+                key[p->args + i] = pas[base(link, p->inputs[i].d - 1) - p->inputs[i].m];
+            }
+            if (SP - 3 < stack_floor + code.reserve)
+            {
+                fprintf(stderr, "runtime error: stack overflow\n");
+                fault_index = PC;
+                return EXEC_ERROR;
+            }
+            memo_entry *entry = &memo_table[memo_slot(proc, key, length)];
+            p->calls++;
+            calls_made++;
+            if (entry->proc == proc + 1 && memcmp(entry->key, key, length * sizeof(int)) == 0)
+            {
+                p->hits++;
+                p->skipped += entry->cost;
+                memo_skipped += entry->cost;
+                for (int i = 0; i < p->output_count; i++)
+                {
+                    pas[base(link, p->outputs[i].d - 1) - p->outputs[i].m] = entry->outputs[i];
+                }
+                SP += p->args; // the frame would have been SP - 1; RTN leaves BP + 1 + args
+                if (p->result)
+                {
+                    SP--;
+                    pas[SP] = entry->result;
+                }
+                PC++;
+                if (trace & TRACE_PRINT) printf("-- memo: %s answered, %lld instructions skipped\n", p->name, entry->cost);
+                if (trace) trace_fetch(PC, trace);
+                if (trace) trace_state(trace, PC, BP, SP);
+                continue;
+            }
+            if (trace) trace_fetch(PC + 1, trace);
+            if (memo_depth < PAS_SIZE)
+            {
+                memo_call *call = &memo_calls[memo_depth++];
+                call->BP = SP - 1;
+                memcpy(call->key, key, length * sizeof(int));
+                call->start = instructions_executed + memo_skipped;
+            }
+            pas[SP - 1] = link;          // SL
+            pas[SP - 2] = BP;            // DL
+            pas[SP - 3] = TOP - 3 * (PC + 1); // RA
+            BP = SP - 1;
+            PC = ir.m;
+        }
+        else // RTN or RTV of a memoized procedure
+        {
+            if (trace) trace_fetch(PC + 1, trace);
+            int value = pas[SP];
+            if (memo_depth > 0 && memo_calls[memo_depth - 1].BP == BP)
+            {
+                memo_call *call = &memo_calls[--memo_depth];
+                int length = p->args + p->input_count;
+                memo_entry *entry = &memo_table[memo_slot(proc, call->key, length)];
+                entry->proc = proc + 1;
+                memcpy(entry->key, call->key, length * sizeof(int));
+                for (int i = 0; i < p->output_count; i++)
+                {
+                    entry->outputs[i] = pas[base(BP, p->outputs[i].d) - p->outputs[i].m];
+                }
+                entry->result = value;
+                entry->cost = instructions_executed + 1 + memo_skipped - call->start;
+            }
+            SP = BP + 1 + ir.l;
+            PC = code_index(pas[BP - 2]);
+            BP = pas[BP - 1];
+            if (ir.m == 12)
+            {
+                SP--;
+                pas[SP] = value;
+            }
+        }
+        instructions_executed++;
+        if (trace) trace_state(trace, PC, BP, SP);
+    }
+}
+
+// the --memo report on stderr: calls, hits and instructions skipped per procedure
+void report_memo(void)
+{
+    long long total = instructions_executed + memo_skipped;
+    fprintf(stderr, "memo: %lld of %lld instructions skipped (%.2f%%)\n", memo_skipped, total,
+            total ? 100.0 * memo_skipped / total : 0.0);
+    fprintf(stderr, "%-16s %12s %12s %7s %14s\n", "procedure", "calls", "hits", "hit %", "skipped");
+    for (int i = 0; i < memo_count; i++)
+    {
+        memo_proc *p = &memo_procs[i];
+        fprintf(stderr, "%-16s %12lld %12lld %7.2f %14lld\n", p->name, p->calls, p->hits,
+                p->calls ? 100.0 * p->hits / p->calls : 0.0, p->skipped);
+    }
+}
+
+// --serve: per-request input values and collected outputs
+int *request_inputs = NULL;
+int request_input_count = 0, request_input_pos = 0, request_input_cap = 0;
+int *request_outputs = NULL;
+int request_output_count = 0, request_output_cap = 0;
+int request_failed_read = 0;
+
+int request_read(int *value)
+{
+    if (request_input_pos >= request_input_count)
+    {
+        request_failed_read = 1;
+        return 0;
+    }
+    *value = request_inputs[request_input_pos++];
+    return 1;
+}
+
+// parses word, which must be a whole decimal int, as an input value.
+// returns 0 if it is not one
+int parse_input(const char *word, int *value)
+{
+    char *end;
+    errno = 0;
+    long parsed = strtol(word, &end, 10);
+    if (end == word || *end != '\0' || errno == ERANGE || parsed < INT_MIN || parsed > INT_MAX) return 0;
+    *value = (int)parsed;
+    return 1;
+}
+
+void request_write(int value)
+{
+    if (request_output_count == request_output_cap)
+    {
+        request_output_cap = request_output_cap ? request_output_cap * 2 : 64;
+        request_outputs = realloc(request_outputs, request_output_cap * sizeof(int));
+        if (!request_outputs)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    request_outputs[request_output_count++] = value;
+}
+
+// answers "<program> <input>...\n" lines on one connection with
+// "ok <outputs>...\n", "stopped <limit> <outputs>...\n" or
+// "error <reason>: <outputs>...\n", the outputs so far of a failed run
+void serve_connection(int fd)
+{
+    FILE *in = fdopen(fd, "r");
+    FILE *out = fdopen(dup(fd), "w");
+    if (!in || !out)
+    {
+        if (in) fclose(in); else close(fd);
+        if (out) fclose(out);
+        return;
+    }
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    while (getline(&line, &line_cap, in) > 0)
+    {
+        char *cursor = line;
+        char *name = strtok_r(line, " \t\r\n", &cursor);
+        if (!name) continue;
+
+        program *prog = NULL;
+        for (int i = 0; i < program_count; i++)
+        {
+            if (strcmp(programs[i].name, name) == 0) prog = &programs[i];
+        }
+        if (!prog)
+        {
+            fprintf(out, "error unknown program %s:\n", name);
+            fflush(out);
+            continue;
+        }
+
+        request_input_count = request_input_pos = 0;
+        request_output_count = 0;
+        request_failed_read = 0;
+        int bad_input = 0;
+        for (char *word; !bad_input && (word = strtok_r(NULL, " \t\r\n", &cursor)) != NULL; )
+        {
+            if (request_input_count == request_input_cap)
+            {
+                request_input_cap = request_input_cap ? request_input_cap * 2 : 64;
+                request_inputs = realloc(request_inputs, request_input_cap * sizeof(int));
+                if (!request_inputs)
+                {
+                    fprintf(stderr, "out of memory\n");
+                    exit(1);
+                }
+            }
+            if (parse_input(word, &request_inputs[request_input_count])) request_input_count++;
+            else bad_input = 1;
+        }
+        if (bad_input)
+        {
+            fprintf(out, "error bad input:\n");
+            fflush(out);
+            continue;
+        }
+
+        // the code stays loaded; only the stack below it is cleared
+        pas = prog->image;
+        code = prog->code;
+        if (atomic_load(&metrics_armed)) mark_limit_checks(&code);
+        CODE_FLOOR = prog->code_floor;
+        memset(pas, 0, CODE_FLOOR * sizeof(int));
+        limits_start();
+        metrics_state(METRICS_RUNNING);
+        int status = execute_loop(0, CODE_FLOOR - 1, CODE_FLOOR, -1, 0);
+        metrics_state(METRICS_IDLE);
+
+        // a stopped or failed request still returns the outputs it produced
+        if (status == EXEC_HALT) fprintf(out, "ok");
+        else if (status == EXEC_LIMIT) fprintf(out, "stopped %s", limit_reached);
+        else fprintf(out, "error %s:", request_failed_read ? "input exhausted" : "runtime error");
+        for (int i = 0; i < request_output_count; i++) fprintf(out, " %d", request_outputs[i]);
+        fprintf(out, "\n");
+        fflush(out);
+    }
+    free(line);
+    fclose(in);
+    fclose(out);
+}
+
+volatile sig_atomic_t server_stopping = 0;
+
+void stop_server(int sig)
+{
+    (void)sig;
+    server_stopping = 1;
+}
+
+// vm --serve <socket> [--workers N] name=elf.txt ...
+// programs are loaded once, then N pre-forked workers accept connections
+int serve(const char *socket_path, int worker_count, int with_metrics)
+{
+    if (program_count == 0)
+    {
+        fprintf(stderr, "ERROR: --serve needs at least one name=elf.txt program\n");
+        return 1;
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof address);
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof address.sun_path, "%s", socket_path);
+    unlink(socket_path);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof address) != 0
+        || listen(listener, 128) != 0)
+    {
+        perror("error w/ server socket");
+        return 1;
+    }
+
+    read_input = request_read;
+    write_output = request_write;
+    num_workers = 1; // COB runs its calls in order inside a server worker
+
+    pid_t children[MAX_SERVERS];
+    struct sigaction action;
+    memset(&action, 0, sizeof action);
+    action.sa_handler = stop_server;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int i = 0; i < worker_count; i++) children[i] = -1;
+    while (!server_stopping)
+    {
+        // (re)start any worker that is not running
+        for (int i = 0; i < worker_count; i++)
+        {
+            if (children[i] > 0) continue;
+            children[i] = fork();
+            if (children[i] == 0)
+            {
+                signal(SIGINT, SIG_DFL);
+                signal(SIGTERM, metrics_stop_worker);
+                if (with_metrics) metrics_open(socket_path);
+                for (;;)
+                {
+                    int fd = accept(listener, NULL, NULL);
+                    if (fd >= 0) serve_connection(fd);
+                }
+            }
+        }
+
+        pid_t done = wait(NULL);
+        for (int i = 0; i < worker_count; i++)
+        {
+            if (children[i] == done) children[i] = -1;
+        }
+    }
+
+    for (int i = 0; i < worker_count; i++)
+    {
+        if (children[i] > 0) kill(children[i], SIGTERM);
+    }
+    while (wait(NULL) > 0) ;
+    close(listener);
+    unlink(socket_path);
+    return 0;
+}
+
+
+// --sessions <socket>: interactive runs multiplexed by one thread. A client
+// connects, sends the name of a program and then input values whenever it
+// likes (blank separated, on as many lines as it wants). It gets back
+// "output <value>" lines, "input" when the program waits for a value it was
+// not sent yet, and a last line "halt", "stopped instructions|timeout" or
+// "error <reason>", after which the VM closes the connection.
+// A session is a continuation: the stack below CODE_FLOOR of its own and the
+// PC/BP/SP it continues with. A SYS 0 2 with no input queued suspends it
+// (EXEC_SUSPEND, from execute_cached, which every session runs), and at a
+// checkpoint it gives up the thread when its turn of SESSION_SLICE
+// instructions is over or when more than SESSION_OUTPUT_HIGH bytes of its
+// output are still unsent. An epoll loop reads and writes the connections
+// and gives every session that can go on one turn per round; with none it
+// sleeps in epoll_wait.
+// Division errors and stack overflow are runtime errors of the loop as in
+// a plain run. Each stack also has an inaccessible page below it: a
+// SIGSEGV in a turn at an address in the running session's guard page
+// ends the turn with "error stack overflow" for that session only. Every
+// other fault is a bug of the VM and ends it as it would without sessions
+#define SESSION_SLICE (1 << 16)       // instructions in a turn
+#define SESSION_OUTPUT_HIGH (1 << 16) // unsent output bytes that pause a session
+#define SESSION_EVENTS 256            // epoll events taken per wait
+#define SESSION_TOKEN 64              // longest program name or input value
+
+enum session_state {
+    SESSION_NAMING, // no program name yet
+    SESSION_READY,  // in the run queue
+    SESSION_INPUT,  // suspended at SYS 0 2
+    SESSION_OUTPUT, // paused until its output drains to half of SESSION_OUTPUT_HIGH
+    SESSION_DONE    // the last line is written, closed once it is sent
+};
+
+typedef struct session {
+    int fd;
+    int state;
+    int gone;               // connection closed while queued, freed when dequeued
+    program *prog;
+    int *stack;             // the words below prog->code_floor
+    size_t stack_size;      // of the mapping, which starts a guard page below stack
+    continuation at;        // registers of the next turn
+    long long executed;     // instructions so far, for --max-instructions
+    double seconds;         // run time so far (not waiting), for --timeout
+    int *inputs;            // values sent and not read yet
+    int input_head, input_count, input_cap;
+    int input_closed;       // the client shut down its side
+    int failed_read;
+    int bad_input;          // a value sent is not an int; ends the run at its next turn
+    char token[SESSION_TOKEN]; // a name or value cut off at the end of a read
+    int token_length;
+    char *output;           // output[output_sent..output_length) is unsent
+    size_t output_sent, output_length, output_cap;
+    uint32_t events;        // epoll events asked for
+    struct session *next;   // run queue
+} session;
+
+int session_poll = -1;                            // epoll descriptor
+int session_listener = -1;
+int accepting = 1;                                // the listener is in session_poll
+session *run_head = NULL, *run_tail = NULL;
+int run_count = 0;
+session *running = NULL;                          // the session in its turn
+program *loaded = NULL;                           // the program in code
+long long sessions_opened = 0, session_turns = 0;
+sigjmp_buf turn_fault;                            // where a trap in a turn lands
+size_t session_page = 0;                          // page size, the size of a guard page
+
+void session_enqueue(session *s)
+{
+    s->state = SESSION_READY;
+    s->next = NULL;
+    if (run_tail) run_tail->next = s;
+    else run_head = s;
+    run_tail = s;
+    run_count++;
+}
+
+session *session_dequeue(void)
+{
+    session *s = run_head;
+    run_head = s->next;
+    if (!run_head) run_tail = NULL;
+    run_count--;
+    return s;
+}
+
+// the stack of a session, with a page below it that faults when touched
+int *session_stack(int words, size_t *size)
+{
+    size_t page = session_page;
+    *size = (words * sizeof(int) + page - 1) / page * page + page;
+    char *region = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) return NULL;
+    mprotect(region, page, PROT_NONE);
+    return (int *)(region + page);
+}
+
+void session_free(session *s)
+{
+    epoll_ctl(session_poll, EPOLL_CTL_DEL, s->fd, NULL);
+    close(s->fd);
+    if (s->stack) munmap((char *)s->stack - session_page, s->stack_size);
+    free(s->inputs);
+    free(s->output);
+    free(s);
+    if (!accepting)
+    {
+        // a descriptor is free again
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+        accepting = epoll_ctl(session_poll, EPOLL_CTL_ADD, session_listener, &event) == 0;
+    }
+}
+
+// asks epoll for input until the client shuts its side, and for output
+// while some is unsent
+void session_watch(session *s)
+{
+    uint32_t events = (s->input_closed ? 0 : EPOLLIN) | (s->output_length > s->output_sent ? EPOLLOUT : 0);
+    if (events == s->events) return;
+    struct epoll_event event = {.events = events, .data.ptr = s};
+    epoll_ctl(session_poll, EPOLL_CTL_MOD, s->fd, &event);
+    s->events = events;
+}
+
+void session_append(session *s, const char *text)
+{
+    size_t length = strlen(text);
+    if (s->output_length + length > s->output_cap)
+    {
+        // move the unsent part to the front before growing
+        if (s->output_sent > 0) memmove(s->output, s->output + s->output_sent, s->output_length - s->output_sent);
+        s->output_length -= s->output_sent;
+        s->output_sent = 0;
+        while (s->output_length + length > s->output_cap)
+        {
+            s->output_cap = s->output_cap ? s->output_cap * 2 : 256;
+            s->output = realloc(s->output, s->output_cap);
+            if (!s->output)
+            {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+        }
+    }
+    memcpy(s->output + s->output_length, text, length);
+    s->output_length += length;
+}
+
+// writes what the socket takes; returns 0 if the client is gone
+int session_flush(session *s)
+{
+    while (s->output_sent < s->output_length)
+    {
+        ssize_t sent = write(s->fd, s->output + s->output_sent, s->output_length - s->output_sent);
+        if (sent > 0)
+        {
+            s->output_sent += sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        return 0;
+    }
+    if (s->output_sent == s->output_length) s->output_sent = s->output_length = 0;
+    session_watch(s);
+    return 1;
+}
+
+// SYS 0 2 / SYS 0 1 of the running session
+int session_read(int *value)
+{
+    session *s = running;
+    if (s->input_head < s->input_count)
+    {
+        *value = s->inputs[s->input_head++];
+        if (s->input_head == s->input_count) s->input_head = s->input_count = 0;
+        return 1;
+    }
+    if (!s->input_closed) return -1;
+    s->failed_read = 1;
+    return 0;
+}
+
+void session_write(int value)
+{
+    char line[32];
+    snprintf(line, sizeof line, "output %d\n", value);
+    session_append(running, line);
+    if (running->output_length - running->output_sent > SESSION_OUTPUT_HIGH)
+    {
+        turn_yield = 1;
+        limit_check_at = 0; // the loop stops at its next checkpoint
+    }
+}
+
+// ends a session with its last line
+void session_finish(session *s, const char *last)
+{
+    session_append(s, last);
+    s->state = SESSION_DONE;
+}
+
+// sends what the socket takes, then ends a finished session or resumes
+// one whose output has drained
+void session_send(session *s)
+{
+    if (!session_flush(s) || (s->state == SESSION_DONE && s->output_length == 0))
+    {
+        if (s->state == SESSION_READY) s->gone = 1;
+        else session_free(s);
+        return;
+    }
+    if (s->state == SESSION_OUTPUT && s->output_length - s->output_sent <= SESSION_OUTPUT_HIGH / 2)
+    {
+        session_enqueue(s);
+    }
+}
+
+// SIGSEGV: a fault in the guard page of the session in its turn fails that
+// session. Any other (outside a turn, or elsewhere, as in session_write or
+// malloc) is a fault of the VM itself and is raised again, since jumping
+// out of it could leave the heap or the sessions half updated
+void session_trap(int sig, siginfo_t *info, void *context)
+{
+    (void)context;
+    char *address = info->si_addr;
+    if (running && address >= (char *)running->stack - session_page && address < (char *)running->stack)
+    {
+        siglongjmp(turn_fault, sig);
+    }
+    metrics_unlink();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+// one turn of a session from the run queue
+void session_turn(session *s)
+{
+    if (s->bad_input)
+    {
+        session_finish(s, "error bad input\n");
+        session_send(s);
+        return;
+    }
+    running = s;
+    if (loaded != s->prog)
+    {
+        code = s->prog->code;
+        CODE_FLOOR = s->prog->code_floor;
+        loaded = s->prog;
+    }
+    pas = s->stack;
+    // the budget covers this session's instructions and run time only
+    limit_start = instructions_executed - s->executed;
+    limit_clock_at = 0;
+    limit_reached = NULL;
+    atomic_store(&program_limited, 0);
+    volatile double start = 0; // read after a trap's siglongjmp
+    if (timeout_seconds > 0)
+    {
+        start = seconds_now();
+        limit_deadline = start + timeout_seconds - s->seconds;
+    }
+    turn_yield = turn_yielded = 0;
+    long long before = instructions_executed;
+    int trap = sigsetjmp(turn_fault, 1); // the instructions of a trapped turn are not counted
+    int status = trap ? EXEC_ERROR : execute_loop(s->at.PC, s->at.BP, s->at.SP, -1, 0);
+    s->executed += instructions_executed - before;
+    if (timeout_seconds > 0) s->seconds += seconds_now() - start;
+    session_turns++;
+
+    if (status == EXEC_LIMIT && turn_yielded)
+    {
+        s->at = suspended;
+        if (s->output_length - s->output_sent > SESSION_OUTPUT_HIGH) s->state = SESSION_OUTPUT;
+        else session_enqueue(s);
+    }
+    else if (status == EXEC_SUSPEND)
+    {
+        s->at = suspended;
+        s->state = SESSION_INPUT;
+        session_append(s, "input\n");
+    }
+    else if (status == EXEC_HALT) session_finish(s, "halt\n");
+    else if (status == EXEC_LIMIT)
+    {
+        char line[64];
+        snprintf(line, sizeof line, "stopped %s\n", limit_reached);
+        session_finish(s, line);
+    }
+    else if (trap) session_finish(s, "error stack overflow\n");
+    else session_finish(s, s->failed_read ? "error input exhausted\n" : "error runtime error\n");
+    running = NULL;
+    session_send(s);
+}
+
+// a name or value has arrived
+void session_token(session *s, const char *token)
+{
+    if (s->state != SESSION_NAMING)
+    {
+        if (s->input_count == s->input_cap)
+        {
+            s->input_cap = s->input_cap ? s->input_cap * 2 : 16;
+            s->inputs = realloc(s->inputs, s->input_cap * sizeof(int));
+            if (!s->inputs)
+            {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+        }
+        if (!parse_input(token, &s->inputs[s->input_count]))
+        {
+            // a queued session is still in the run queue: it ends there
+            if (s->state == SESSION_READY) s->bad_input = 1;
+            else session_finish(s, "error bad input\n");
+            return;
+        }
+        s->input_count++;
+        if (s->state == SESSION_INPUT) session_enqueue(s);
+        return;
+    }
+    for (int i = 0; i < program_count; i++)
+    {
+        if (strcmp(programs[i].name, token) == 0) s->prog = &programs[i];
+    }
+    if (!s->prog)
+    {
+        char line[SESSION_TOKEN + 32];
+        snprintf(line, sizeof line, "error unknown program %s\n", token);
+        session_finish(s, line);
+        return;
+    }
+    int floor = s->prog->code_floor;
+    s->stack = session_stack(floor, &s->stack_size);
+    if (!s->stack)
+    {
+        session_finish(s, "error out of memory\n");
+        return;
+    }
+    s->at = (continuation){0, floor - 1, floor};
+    session_enqueue(s);
+}
+
+// reads what the client sent; frees the session when it is over
+void session_receive(session *s)
+{
+    char buffer[4096];
+    for (;;)
+    {
+        ssize_t got = read(s->fd, buffer, sizeof buffer);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (got <= 0)
+        {
+            s->input_closed = 1;
+            session_watch(s);
+            got = 0;
+        }
+        // blanks end a token; the end of the input ends the last one
+        for (ssize_t i = 0; i <= got && s->state != SESSION_DONE; i++)
+        {
+            int end = i == got ? s->input_closed : buffer[i] == ' ' || buffer[i] == '\t'
+                                                   || buffer[i] == '\r' || buffer[i] == '\n';
+            if (i == got && !end) break;
+            if (!end)
+            {
+                if (s->token_length < SESSION_TOKEN - 1) s->token[s->token_length++] = buffer[i];
+                continue;
+            }
+            if (s->token_length == 0) continue;
+            s->token[s->token_length] = '\0';
+            s->token_length = 0;
+            session_token(s, s->token);
+        }
+        if (s->input_closed || s->state == SESSION_DONE) break;
+    }
+
+    if (s->input_closed && s->state == SESSION_NAMING) session_finish(s, "error no program\n");
+    if (s->input_closed && s->state == SESSION_INPUT) session_enqueue(s); // its read fails now
+    session_send(s);
+}
+
+void session_accept(int listener)
+{
+    for (;;)
+    {
+        int fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0 && (errno == EMFILE || errno == ENFILE))
+        {
+            // stop listening until a session ends and frees a descriptor
+            epoll_ctl(session_poll, EPOLL_CTL_DEL, listener, NULL);
+            accepting = 0;
+        }
+        if (fd < 0) return;
+        session *s = calloc(1, sizeof *s);
+        if (!s)
+        {
+            close(fd);
+            return;
+        }
+        s->fd = fd;
+        s->state = SESSION_NAMING;
+        s->events = EPOLLIN;
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = s};
+        if (epoll_ctl(session_poll, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            close(fd);
+            free(s);
+            continue;
+        }
+        sessions_opened++;
+    }
+}
+
+// vm --sessions <socket> name=elf.txt ...
+int run_sessions(const char *socket_path, int with_metrics)
+{
+    if (program_count == 0)
+    {
+        fprintf(stderr, "ERROR: --sessions needs at least one name=elf.txt program\n");
+        return 1;
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof address);
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof address.sun_path, "%s", socket_path);
+    unlink(socket_path);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof address) != 0
+        || listen(listener, 1024) != 0)
+    {
+        perror("error w/ session socket");
+        return 1;
+    }
+    session_listener = listener;
+    session_poll = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+    if (session_poll < 0 || epoll_ctl(session_poll, EPOLL_CTL_ADD, listener, &event) != 0)
+    {
+        perror("error w/ epoll");
+        return 1;
+    }
+
+    // one descriptor per session: take all the process may have
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max)
+    {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    // every program is preempted at its checkpoints
+    for (int i = 0; i < program_count; i++) mark_limit_checks(&programs[i].code);
+    turn_slice = SESSION_SLICE;
+    limit_first_check = 0;
+    num_workers = 1; // COB runs its calls in order
+    execute_loop = execute_cached; // sessions are not traced, and only this loop suspends at SYS 0 2
+    read_input = session_read;
+    write_output = session_write;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof action);
+    action.sa_handler = stop_server;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    session_page = sysconf(_SC_PAGESIZE);
+    action.sa_sigaction = session_trap;
+    action.sa_flags = SA_SIGINFO | SA_NODEFER; // left by siglongjmp, which restores the mask anyway
+    sigaction(SIGSEGV, &action, NULL);
+    if (with_metrics) metrics_open(socket_path);
+    metrics_state(METRICS_IDLE);
+
+    struct epoll_event events[SESSION_EVENTS];
+    int busy = 0;
+    while (!server_stopping)
+    {
+        int ready = epoll_wait(session_poll, events, SESSION_EVENTS, run_head ? 0 : -1);
+        if (ready < 0 && errno != EINTR)
+        {
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < ready; i++)
+        {
+            session *s = events[i].data.ptr;
+            if (!s) session_accept(listener);
+            else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) session_receive(s);
+            else if (events[i].events & EPOLLOUT) session_send(s);
+        }
+
+        // a turn for every session that was ready when the round began
+        if (run_head && !busy)
+        {
+            metrics_state(METRICS_RUNNING);
+            busy = 1;
+        }
+        for (int turns = run_count; turns > 0 && run_head; turns--)
+        {
+            session *s = session_dequeue();
+            if (s->gone) session_free(s);
+            else session_turn(s);
+        }
+        if (!run_head && busy)
+        {
+            metrics_state(METRICS_IDLE);
+            busy = 0;
+        }
+    }
+
+    fprintf(stderr, "sessions: %lld served, %lld instructions in %lld turns\n",
+            sessions_opened, (long long)instructions_executed, session_turns);
+    metrics_close();
+    close(listener);
+    unlink(socket_path);
+    return 0;
+}
+
+
+// --batch inputs.txt: one run of the program per line of inputs.txt (the
+// values SYS 0 2 reads, separated by blanks). Runs are taken BATCH_LANES at
+// a time into a lane group that executes them in lockstep: every stack word
+// is a vector with one lane per run, so LIT/LOD/STO and the OPR arithmetic
+// and comparisons are vector operations (GCC vector extensions; SSE2 by
+// default, AVX2 with -mavx2 or -march=native). PC, BP and SP are shared by
+// the group, which holds as long as the runs take the same branches. A JPC
+// whose condition differs between lanes splits the group: the larger side
+// continues and the other lanes are copied into a new group that runs after
+// it, and a group left with one lane finishes in the scalar interpreter.
+// Lanes that read past their inputs or fail stop on their own. Groups are
+// not merged again once split
+#define BATCH_LANES 8
+typedef int32_t lane_vector __attribute__((vector_size(BATCH_LANES * sizeof(int32_t))));
+
+typedef struct batch_run {
+    int *inputs;
+    int input_count, input_pos;
+    int *outputs;
+    int output_count, output_cap;
+    int status;             // exec_status once finished, -1 before
+    int failed_read;        // the error was SYS 0 2 past the last input
+    int bad_input;          // a word of its line is not an int: it does not run
+    const char *reached;    // the limit that stopped it (EXEC_LIMIT)
+    long long executed;
+} batch_run;
+
+// runs in lockstep: lane i carries runs[run[i]] while bit i of active is set
+typedef struct lane_group {
+    int PC, BP, SP;
+    unsigned active;
+    int run[BATCH_LANES];
+    long long executed;
+    double deadline;        // --timeout of its runs
+    struct lane_group *next; // pending groups
+    lane_vector stack[];    // words 0 .. CODE_FLOOR - 1
+} lane_group;
+
+batch_run *batch_runs = NULL;
+int batch_run_count = 0;
+batch_run *batch_scalar = NULL; // run being finished by the scalar interpreter
+lane_group *batch_pending = NULL;
+int batch_groups = 0, batch_scalar_runs = 0;
+
+void batch_output(batch_run *r, int value)
+{
+    if (r->output_count == r->output_cap)
+    {
+        r->output_cap = r->output_cap ? r->output_cap * 2 : 16;
+        r->outputs = realloc(r->outputs, r->output_cap * sizeof(int));
+        if (!r->outputs)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    r->outputs[r->output_count++] = value;
+}
+
+// SYS I/O of a run in the scalar interpreter
+int batch_read(int *value)
+{
+    if (batch_scalar->input_pos >= batch_scalar->input_count)
+    {
+        batch_scalar->failed_read = 1;
+        return 0;
+    }
+    *value = batch_scalar->inputs[batch_scalar->input_pos++];
+    return 1;
+}
+
+void batch_write(int value)
+{
+    batch_output(batch_scalar, value);
+}
+
+lane_group *new_lane_group(void)
+{
+    size_t size = sizeof(lane_group) + CODE_FLOOR * sizeof(lane_vector);
+    size = (size + sizeof(lane_vector) - 1) / sizeof(lane_vector) * sizeof(lane_vector);
+    lane_group *g = aligned_alloc(sizeof(lane_vector), size);
+    if (!g)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    batch_groups++;
+    return g;
+}
+
+// ends lane's run with status; the group goes on with the other lanes
+void lane_stop(lane_group *g, int lane, int status, long long executed)
+{
+    batch_run *r = &batch_runs[g->run[lane]];
+    r->status = status;
+    r->executed = executed;
+    g->active &= ~(1u << lane);
+}
+
+// base() for a group: static links are the same in every lane
+int lane_base(lane_group *g, int BP, int L)
+{
+    int lane = __builtin_ctz(g->active);
+    while (L > 0)
+    {
+        BP = g->stack[BP][lane];
+        L--;
+    }
+    return BP;
+}
+
+// the limit that stops a group at executed instructions, or NULL
+const char *lane_limit(long long executed, double deadline)
+{
+    if (max_instructions > 0 && executed >= max_instructions) return "instructions";
+    if (timeout_seconds > 0 && seconds_now() >= deadline) return "timeout";
+    return NULL;
+}
+
+// address of element index of the array at address array, -1 if it is
+// outside the stack (the scalar VM does not check this; CHK normally does)
+int lane_element(int array, int index)
+{
+    int address = array - index;
+    return address >= 0 && address < CODE_FLOOR ? address : -1;
+}
+
+void run_lane_scalar(lane_group *g);
+
+// a stack check failed (see stack_reserve): every lane of g stops with the error
+void lane_overflow(lane_group *g, long long executed)
+{
+    fprintf(stderr, "runtime error: stack overflow\n");
+    for (int lane = 0; lane < BATCH_LANES; lane++)
+    {
+        if (g->active & (1u << lane)) lane_stop(g, lane, EXEC_ERROR, executed);
+    }
+}
+
+// runs group g until every lane has stopped or moved to another group
+void run_lane_group(lane_group *g)
+{
+    lane_vector *pas_v = g->stack;
+    int PC = g->PC, BP = g->BP, SP = g->SP;
+    long long executed = g->executed;
+    long long check_at = executed; // next lane_limit() call
+    lane_vector one = {0};
+    one += 1;
+
+    while (g->active)
+    {
+        if (executed >= check_at)
+        {
+            const char *reached = lane_limit(executed, g->deadline);
+            if (reached)
+            {
+                for (int lane = 0; lane < BATCH_LANES; lane++)
+                {
+                    if (!(g->active & (1u << lane))) continue;
+                    batch_runs[g->run[lane]].reached = reached;
+                    lane_stop(g, lane, EXEC_LIMIT, executed);
+                }
+                break;
+            }
+            check_at = executed + LIMIT_SLICE;
+            if (max_instructions > 0 && max_instructions < check_at) check_at = max_instructions;
+        }
+        if (PC >= code.length)
+        {
+            past_end(PC);
+            for (int lane = 0; lane < BATCH_LANES; lane++)
+            {
+                if (g->active & (1u << lane)) lane_stop(g, lane, EXEC_ERROR, executed);
+            }
+            break;
+        }
+        instruction ir = code.wide[PC];
+        PC++;
+        executed++;
+
+        switch (ir.op)
+        {
+            case 1: // LIT
+                SP--;
+                pas_v[SP] = one * ir.m;
+                break;
+
+            case 2: // OPR
+                switch (ir.m)
+                {
+                    case 0: // RTN
+                    case 12: // RTV
+                    {
+                        int lane = __builtin_ctz(g->active);
+                        lane_vector result = pas_v[SP];
+                        SP = ir.m == 0 ? BP + 1 + ir.l : BP + ir.l;
+                        PC = code_index(pas_v[BP - 2][lane]);
+                        BP = pas_v[BP - 1][lane];
+                        if (ir.m == 12) pas_v[SP] = result;
+                        break;
+                    }
+                    case 1: pas_v[SP + 1] += pas_v[SP]; SP++; break; // ADD
+                    case 2: pas_v[SP + 1] -= pas_v[SP]; SP++; break; // SUB
+                    case 3: pas_v[SP + 1] *= pas_v[SP]; SP++; break; // MUL
+                    case 4: // DIV, lane by lane: a zero divisor (or INT_MIN / -1) stops only its lane
+                        for (int lane = 0; lane < BATCH_LANES; lane++)
+                        {
+                            if (!(g->active & (1u << lane))) continue;
+                            if (pas_v[SP][lane] == 0 || (pas_v[SP][lane] == -1 && pas_v[SP + 1][lane] == INT_MIN))
+                            {
+                                fprintf(stderr, "runtime error: division %s\n", pas_v[SP][lane] ? "overflow" : "by zero");
+                                lane_stop(g, lane, EXEC_ERROR, executed);
+                                continue;
+                            }
+                            pas_v[SP + 1][lane] /= pas_v[SP][lane];
+                        }
+                        SP++;
+                        break;
+                    case 5: pas_v[SP + 1] = (pas_v[SP + 1] == pas_v[SP]) & one; SP++; break; // EQL
+                    case 6: pas_v[SP + 1] = (pas_v[SP + 1] != pas_v[SP]) & one; SP++; break; // NEQ
+                    case 7: pas_v[SP + 1] = (pas_v[SP + 1] < pas_v[SP]) & one; SP++; break;  // LSS
+                    case 8: pas_v[SP + 1] = (pas_v[SP + 1] <= pas_v[SP]) & one; SP++; break; // LEQ
+                    case 9: pas_v[SP + 1] = (pas_v[SP + 1] > pas_v[SP]) & one; SP++; break;  // GTR
+                    case 10: pas_v[SP + 1] = (pas_v[SP + 1] >= pas_v[SP]) & one; SP++; break; // GEQ
+                    case 11: pas_v[SP] = ((pas_v[SP] & one) == 0) & one; break; // EVEN
+                }
+                break;
+
+            case 3: // LOD
+                SP--;
+                pas_v[SP] = pas_v[lane_base(g, BP, ir.l) - ir.m];
+                break;
+
+            case 4: // STO
+                pas_v[lane_base(g, BP, ir.l) - ir.m] = pas_v[SP];
+                SP++;
+                break;
+
+            case 5: // CAL
+                if (SP - 3 < code.reserve)
+                {
+                    lane_overflow(g, executed);
+                    break;
+                }
+                pas_v[SP - 1] = one * lane_base(g, BP, ir.l); // SL
+                pas_v[SP - 2] = one * BP;                     // DL
+                pas_v[SP - 3] = one * (TOP - 3 * PC);         // RA
+                BP = SP - 1;
+                PC = ir.m;
+                break;
+
+            case 6: // INC
+                if (SP - ir.m < code.reserve)
+                {
+                    lane_overflow(g, executed);
+                    break;
+                }
+                if (SP - ir.m > CODE_FLOOR)
+                {
+                    fprintf(stderr, "runtime error: INC %d moves the stack into the code\n", ir.m);
+                    for (int lane = 0; lane < BATCH_LANES; lane++)
+                    {
+                        if (g->active & (1u << lane)) lane_stop(g, lane, EXEC_ERROR, executed);
+                    }
+                    break;
+                }
+                SP -= ir.m;
+                break;
+
+            case 7: // JMP
+                if (SP < code.reserve && ir.m < PC)
+                {
+                    lane_overflow(g, executed);
+                    break;
+                }
+                PC = ir.m;
+                break;
+
+            case 8: // JPC
+            {
+                unsigned taken = 0;
+                for (int lane = 0; lane < BATCH_LANES; lane++)
+                {
+                    if (pas_v[SP][lane] == 0) taken |= 1u << lane;
+                }
+                taken &= g->active;
+                SP++;
+                if (taken && SP < code.reserve && ir.m < PC)
+                {
+                    // only the lanes that jump back overflow
+                    fprintf(stderr, "runtime error: stack overflow\n");
+                    for (int lane = 0; lane < BATCH_LANES; lane++)
+                    {
+                        if (taken & (1u << lane)) lane_stop(g, lane, EXEC_ERROR, executed);
+                    }
+                    taken = 0;
+                    if (!g->active) break;
+                }
+                if (taken == g->active)
+                {
+                    PC = ir.m;
+                }
+                else if (taken)
+                {
+                    // the lanes diverge: the smaller side becomes a group of its own
+                    unsigned fall = g->active & ~taken;
+                    int taken_larger = __builtin_popcount(taken) > __builtin_popcount(fall);
+                    lane_group *split = new_lane_group();
+                    memcpy(split, g, sizeof(lane_group) + CODE_FLOOR * sizeof(lane_vector));
+                    split->PC = taken_larger ? PC : ir.m;
+                    split->BP = BP;
+                    split->SP = SP;
+                    split->executed = executed;
+                    split->active = taken_larger ? fall : taken;
+                    split->next = batch_pending;
+                    batch_pending = split;
+                    g->active = taken_larger ? taken : fall;
+                    if (taken_larger) PC = ir.m;
+                    if (__builtin_popcount(g->active) == 1)
+                    {
+                        // both sides are single lanes: the scalar loop is faster
+                        g->PC = PC;
+                        g->BP = BP;
+                        g->SP = SP;
+                        g->executed = executed;
+                        run_lane_scalar(g);
+                        return;
+                    }
+                }
+                break;
+            }
+
+            case 9: // SYS
+                for (int lane = 0; lane < BATCH_LANES; lane++)
+                {
+                    if (!(g->active & (1u << lane))) continue;
+                    batch_run *r = &batch_runs[g->run[lane]];
+                    if (ir.m == 1) batch_output(r, pas_v[SP][lane]);
+                    else if (ir.m == 2)
+                    {
+                        if (r->input_pos < r->input_count) pas_v[SP - 1][lane] = r->inputs[r->input_pos++];
+                        else
+                        {
+                            r->failed_read = 1;
+                            lane_stop(g, lane, EXEC_ERROR, executed);
+                        }
+                    }
+                    else if (ir.m == 3) lane_stop(g, lane, EXEC_HALT, executed);
+                    else
+                    {
+                        fprintf(stderr, "runtime error: invalid SYS m=%d\n", ir.m);
+                        lane_stop(g, lane, EXEC_ERROR, executed);
+                    }
+                }
+                if (ir.m == 1) SP++;
+                else if (ir.m == 2) SP--;
+                break;
+
+            case 10: // COB: the CALs that follow run in order
+                break;
+
+            case 11: // LDX
+            case 12: // STX
+            {
+                int array = lane_base(g, BP, ir.l) - ir.m;
+                int index_slot = ir.op == 11 ? SP : SP + 1;
+                for (int lane = 0; lane < BATCH_LANES; lane++)
+                {
+                    if (!(g->active & (1u << lane))) continue;
+                    int address = lane_element(array, pas_v[index_slot][lane]);
+                    if (address < 0)
+                    {
+                        fprintf(stderr, "runtime error: array index %d outside the stack\n", pas_v[index_slot][lane]);
+                        lane_stop(g, lane, EXEC_ERROR, executed);
+                    }
+                    else if (ir.op == 11) pas_v[SP][lane] = pas_v[address][lane];
+                    else pas_v[address][lane] = pas_v[SP][lane];
+                }
+                if (ir.op == 12) SP += 2;
+                break;
+            }
+
+            case 13: // CHK
+                for (int lane = 0; lane < BATCH_LANES; lane++)
+                {
+                    if (!(g->active & (1u << lane))) continue;
+                    if (pas_v[SP][lane] < 0 || pas_v[SP][lane] >= ir.m)
+                    {
+                        fprintf(stderr, "runtime error: array index %d out of bounds [0, %d)\n", pas_v[SP][lane], ir.m);
+                        lane_stop(g, lane, EXEC_ERROR, executed);
+                    }
+                }
+                break;
+
+            case 14: // LDA
+                SP--;
+                pas_v[SP] = pas_v[ir.m];
+                break;
+
+            case 15: // STA
+                pas_v[ir.m] = pas_v[SP];
+                SP++;
+                break;
+
+            default:
+                fprintf(stderr, "runtime error: invalid opcode %d\n", ir.op);
+                for (int lane = 0; lane < BATCH_LANES; lane++)
+                {
+                    if (g->active & (1u << lane)) lane_stop(g, lane, EXEC_ERROR, executed);
+                }
+                break;
+        }
+    }
+}
+
+// finishes the single lane of g with the scalar interpreter
+void run_lane_scalar(lane_group *g)
+{
+    int lane = __builtin_ctz(g->active);
+    batch_run *r = &batch_runs[g->run[lane]];
+    for (int address = 0; address < CODE_FLOOR; address++) pas[address] = g->stack[address][lane];
+    batch_scalar = r;
+    limits_start();
+    limit_start -= g->executed; // the budget counts what the group already ran
+    limit_deadline = g->deadline;
+    long long before = instructions_executed;
+    r->status = execute_loop(g->PC, g->BP, g->SP, -1, 0);
+    r->executed = g->executed + (instructions_executed - before);
+    if (r->status == EXEC_LIMIT) r->reached = limit_reached;
+    batch_scalar_runs++;
+}
+
+// reads one run per line of path into batch_runs
+int load_batch_inputs(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+    {
+        perror(path);
+        return 0;
+    }
+    char *line = NULL;
+    size_t line_cap = 0;
+    int run_cap = 0;
+    while (getline(&line, &line_cap, fp) > 0)
+    {
+        if (batch_run_count == run_cap)
+        {
+            run_cap = run_cap ? run_cap * 2 : 64;
+            batch_runs = realloc(batch_runs, run_cap * sizeof(batch_run));
+            if (!batch_runs)
+            {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+        }
+        batch_run *r = &batch_runs[batch_run_count++];
+        memset(r, 0, sizeof *r);
+        r->status = -1;
+        int input_cap = 0;
+        char *cursor = line;
+        for (char *word; !r->bad_input && (word = strtok_r(cursor, " \t\r\n", &cursor)) != NULL; )
+        {
+            if (r->input_count == input_cap)
+            {
+                input_cap = input_cap ? input_cap * 2 : 8;
+                r->inputs = realloc(r->inputs, input_cap * sizeof(int));
+                if (!r->inputs)
+                {
+                    fprintf(stderr, "out of memory\n");
+                    exit(1);
+                }
+            }
+            if (parse_input(word, &r->inputs[r->input_count])) r->input_count++;
+            else r->bad_input = 1;
+        }
+    }
+    free(line);
+    fclose(fp);
+    return 1;
+}
+
+// vm --batch inputs.txt elf.txt: prints one line per run, in input order,
+// in the --serve reply format ("error <reason>: <outputs so far>..." for a
+// failed run)
+int run_batch(const char *inputs_path)
+{
+    if (!load_batch_inputs(inputs_path)) return 1;
+    read_input = batch_read;
+    write_output = batch_write;
+    num_workers = 1;
+
+    double start = seconds_now();
+    long long total = 0;
+    int failed = 0;
+    for (int first = 0; first < batch_run_count; first += BATCH_LANES)
+    {
+        lane_group *g = new_lane_group();
+        memset(g->stack, 0, CODE_FLOOR * sizeof(lane_vector));
+        g->PC = 0;
+        g->BP = CODE_FLOOR - 1;
+        g->SP = CODE_FLOOR;
+        g->executed = 0;
+        g->deadline = seconds_now() + timeout_seconds;
+        g->active = 0;
+        for (int lane = 0; lane < BATCH_LANES; lane++)
+        {
+            g->run[lane] = first + lane < batch_run_count ? first + lane : first;
+            if (first + lane < batch_run_count && !batch_runs[first + lane].bad_input) g->active |= 1u << lane;
+        }
+        g->next = NULL;
+        batch_pending = g;
+        while ((g = batch_pending) != NULL)
+        {
+            batch_pending = g->next;
+            if (__builtin_popcount(g->active) == 1) run_lane_scalar(g);
+            else run_lane_group(g);
+            free(g);
+        }
+
+        for (int i = first; i < batch_run_count && i < first + BATCH_LANES; i++)
+        {
+            batch_run *r = &batch_runs[i];
+            total += r->executed;
+            if (r->status == EXEC_HALT) printf("ok");
+            else if (r->status == EXEC_LIMIT) printf("stopped %s", r->reached);
+            else
+            {
+                printf("error %s:", r->bad_input ? "bad input" : r->failed_read ? "input exhausted" : "runtime error");
+                failed++;
+            }
+            for (int j = 0; j < r->output_count; j++) printf(" %d", r->outputs[j]);
+            printf("\n");
+            free(r->inputs);
+            free(r->outputs);
+        }
+    }
+    fflush(stdout);
+    double elapsed = seconds_now() - start;
+    fprintf(stderr, "batch: %d runs, %lld instructions in %.6f s (%.1f ns/instruction); "
+            "%d lane groups, %d runs finished scalar\n", batch_run_count, total, elapsed,
+            total ? elapsed * 1e9 / total : 0.0, batch_groups, batch_scalar_runs);
+    return failed ? 1 : 0;
+}
+
+
+void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [--threads N] [--tos] [--stats] [--record log | --replay log]\n"
+                    "          [--debug elf.dbg] [--profile] [--no-trace] [--max-instructions N]\n"
+                    "          [--timeout s] [--memo elf.memo] [--no-metrics] elf.txt\n"
+                    "       %s --batch inputs.txt [--tos] [--max-instructions N] [--timeout s] elf.txt\n"
+                    "       %s --serve <socket> [--workers N] [--tos] [--max-instructions N] [--timeout s]\n"
+                    "          [--no-metrics] name=elf.txt [name2=other.txt ...]\n"
+                    "       %s --sessions <socket> [--max-instructions N] [--timeout s]\n"
+                    "          [--no-metrics] name=elf.txt [name2=other.txt ...]\n",
+            name, name, name, name);
+}
+
+// the value of a numeric option: a whole decimal number in [low, high].
+// Anything else (a typo, "1e6", a value out of range) prints the usage and
+// exits, since --max-instructions and --timeout must never quietly turn
+// into "unlimited"
+long long option_count(const char *name, const char *option, const char *word, long long low, long long high)
+{
+    char *end;
+    errno = 0;
+    long long value = strtoll(word, &end, 10);
+    if (end == word || *end != '\0' || errno == ERANGE || value < low || value > high)
+    {
+        fprintf(stderr, "ERROR: %s needs a whole number from %lld to %lld, not \"%s\"\n", option, low, high, word);
+        usage(name);
+        exit(1);
+    }
+    return value;
+}
+
+// the value of --timeout: a finite number of seconds, at least 0
+double option_seconds(const char *name, const char *option, const char *word)
+{
+    char *end;
+    errno = 0;
+    double value = strtod(word, &end);
+    if (end == word || *end != '\0' || errno == ERANGE || !isfinite(value) || value < 0)
+    {
+        fprintf(stderr, "ERROR: %s needs a number of seconds, not \"%s\"\n", option, word);
+        usage(name);
+        exit(1);
+    }
+    return value;
+}
+
+int main(int argc, char *argv[]) 
+{
+    const char *input_path = NULL;
+    const char *socket_path = NULL; // --serve
+    const char *record_path = NULL; // --record
+    const char *replay_path = NULL; // --replay
+    const char *debug_path = NULL;  // --debug
+    const char *batch_path = NULL;  // --batch
+    const char *sessions_path = NULL; // --sessions
+    const char *memo_path = NULL;   // --memo
+    int profile = 0;                // --profile
+    int quiet = 0;                  // --no-trace, or --replay
+    int server_workers = 4;         // --workers
+    int with_metrics = 1;           // --no-metrics clears it
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            num_workers = (int)option_count(argv[0], argv[i], argv[i + 1], 1, MAX_WORKERS);
+            i++;
+        }
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+        {
+            socket_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--sessions") == 0 && i + 1 < argc)
+        {
+            sessions_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+        {
+            stats_init();
+        }
+        else if (strcmp(argv[i], "--tos") == 0)
+        {
+            execute_loop = execute_cached;
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            record_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+        {
+            replay_path = argv[++i];
+            quiet = 1;
+        }
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+        {
+            batch_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--debug") == 0 && i + 1 < argc)
+        {
+            debug_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--memo") == 0 && i + 1 < argc)
+        {
+            memo_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--profile") == 0)
+        {
+            profile = 1;
+        }
+        else if (strcmp(argv[i], "--no-trace") == 0)
+        {
+            quiet = 1;
+        }
+        else if (strcmp(argv[i], "--max-instructions") == 0 && i + 1 < argc)
+        {
+            max_instructions = option_count(argv[0], argv[i], argv[i + 1], 0, LLONG_MAX);
+            i++;
+        }
+        else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc)
+        {
+            timeout_seconds = option_seconds(argv[0], argv[i], argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "--no-metrics") == 0)
+        {
+            with_metrics = 0;
+        }
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+        {
+            server_workers = (int)option_count(argv[0], argv[i], argv[i + 1], 1, MAX_SERVERS);
+            i++;
+        }
+        else if ((socket_path || sessions_path) && strchr(argv[i], '='))
+        {
+            // name=elf.txt program for the server
+            char *separator = strchr(argv[i], '=');
+            if (program_count == MAX_PROGRAMS || separator - argv[i] >= (long)sizeof programs[0].name)
+            {
+                fprintf(stderr, "ERROR: cannot load %s\n", argv[i]);
+                return 1;
+            }
+            program *prog = &programs[program_count];
+            memcpy(prog->name, argv[i], separator - argv[i]);
+            prog->name[separator - argv[i]] = '\0';
+            prog->code_floor = load_program(separator + 1, prog->image);
+            if (prog->code_floor < 0) return 1;
+            if (!encode_program(prog->image, prog->code_floor, &prog->code, separator + 1)) return 1;
+            program_count++;
+        }
+        else if (!input_path)
+        {
+            input_path = argv[i];
+        }
+        else
+        {
+            input_path = NULL;
+            break;
+        }
+    }
+
+    if (memo_path && (socket_path || sessions_path || batch_path || num_workers > 1))
+    {
+        fprintf(stderr, "ERROR: --memo cannot be combined with --serve, --sessions, --batch or --threads\n");
+        return 1;
+    }
+    int limited = max_instructions > 0 || timeout_seconds > 0;
+    for (int i = 0; limited && i < program_count; i++) mark_limit_checks(&programs[i].code);
+    if (socket_path) return serve(socket_path, server_workers, with_metrics);
+    if (sessions_path) return run_sessions(sessions_path, with_metrics);
+
+    // exactly 1 input file check
+    if (!input_path) {
+        fprintf(stderr, "ERROR: ONLY USE 1 input.txt\n");
+        return 1;
+    }
+
+    stats_begin("load");
+    int lowestUsed = load_program(input_path, pas);
+    if (lowestUsed < 0 || !encode_program(pas, lowestUsed, &code, input_path)) return 1;
+    if (limited) mark_limit_checks(&code);
+    if (debug_path && !load_debug_info(debug_path)) return 1;
+    if (memo_path && !load_memo_info(memo_path)) return 1;
+    stats_end();
+
+    // init registers per assignment details in section 3
+    // (PC = PAS_SIZE - 1 is instruction 0):
+    int PC = 0;
+    int SP = lowestUsed;    
+    int BP = SP - 1;
+    CODE_FLOOR = SP;
+    if (batch_path) return run_batch(batch_path);
+
+    if (record_path)
+    {
+        record_log = fopen(record_path, "w");
+        if (!record_log)
+        {
+            perror("error w/ record log");
+            return 1;
+        }
+        read_input = record_read;
+        write_output = record_write;
+    }
+    if (replay_path)
+    {
+        if (!load_replay_log(replay_path)) return 1;
+        read_input = replay_read;
+        write_output = replay_write;
+    }
+
+    if (with_metrics) metrics_open(input_path);
+
+    // print initial values
+    if (!quiet) printf("Initial values: %d %d %d\n", TOP - 3 * PC, BP, SP);
+
+    // start the work-stealing pool; this thread is worker 0
+    for (int i = 0; i < num_workers; i++)
+    {
+        pthread_mutex_init(&workers[i].lock, NULL);
+    }
+    for (int i = 1; i < num_workers; i++)
+    {
+        pthread_create(&workers[i].thread, NULL, worker_main, (void *)(long)i);
+    }
+
+    // main execution loop (replays and --no-trace run untraced at full speed)
+    limits_start();
+    metrics_state(METRICS_RUNNING);
+    double start = seconds_now();
+    stats_begin("execute");
+    task_trace = profile ? TRACE_PROFILE : 0;
+    int trace = (quiet ? 0 : TRACE_PRINT) | task_trace;
+    int status = memo_count ? execute_memoized(PC, BP, SP, trace) : execute_loop(PC, BP, SP, -1, trace);
+    fflush(stdout);
+    if (status == EXEC_ERROR) report_position(fault_index);
+    stats_end();
+    double elapsed = seconds_now() - start;
+    if (status == EXEC_LIMIT) report_limit(elapsed);
+    metrics_state(status == EXEC_HALT ? METRICS_HALTED : status == EXEC_LIMIT ? METRICS_LIMITED : METRICS_ERROR);
+    metrics_close(); // before the pool stops, since it resets the workers' loops
+
+    atomic_store(&pool_shutdown, 1);
+    for (int i = 1; i < num_workers; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    stats_report("vm");
+    if (profile) report_profile();
+    if (memo_path) report_memo();
+
+    int exit_status = status == EXEC_LIMIT ? 3 : status == EXEC_ERROR ? 1 : 0;
+    if (record_log)
+    {
+        fprintf(record_log, "n %lld\n", (long long)instructions_executed + memo_skipped);
+        fprintf(record_log, "s %d\n", exit_status);
+        fclose(record_log);
+    }
+    if (replay_path)
+    {
+        long long executed = instructions_executed + memo_skipped; // as many as without --memo
+        if (replay_output_pos != replay_output_count)
+        {
+            if (!replay_mismatch)
+            {
+                fprintf(stderr, "replay: %d outputs, recorded %d\n", replay_output_pos, replay_output_count);
+            }
+            replay_mismatch = 1;
+        }
+        if (replay_instructions >= 0 && executed != replay_instructions)
+        {
+            fprintf(stderr, "replay: %lld instructions executed, recorded %lld\n", executed, replay_instructions);
+            replay_mismatch = 1;
+        }
+        if (replay_status >= 0 && exit_status != replay_status)
+        {
+            fprintf(stderr, "replay: exit status %d, recorded %d\n", exit_status, replay_status);
+            replay_mismatch = 1;
+        }
+        fprintf(stderr, "replay: %s, %lld instructions in %.6f s (%.1f ns/instruction)\n",
+                replay_mismatch ? "MISMATCH" : "ok", executed, elapsed,
+                executed ? elapsed * 1e9 / executed : 0.0);
+        if (replay_mismatch) return 2;
+    }
+
+    return exit_status;
 }
@@ -0,0 +1,66 @@
+/*
+Live metrics segment shared by vm.c (writer) and vmstat.c (reader).
+
+Every VM run creates a POSIX shared-memory object /pm0vm.<pid> (under
+/dev/shm on Linux) holding one vm_metrics struct, and removes it at exit,
+including when a fatal signal ends it. vm --serve workers each have
+their own, named after the worker's pid.
+
+Nothing is published while nobody watches: a reader attaches and keeps
+watch_until (CLOCK_REALTIME seconds) in the future, and the VM's metrics
+thread then turns on the checkpoints that --max-instructions uses (backward
+JMP/JPC, CAL, RTN/RTV). From then on the interpreter publishes a snapshot
+every METRICS_SLICE instructions, so an unwatched run executes exactly the
+code it did before.
+
+The snapshot fields are written under a sequence lock: seq is odd while the
+VM writes them, and a reader retries until it sees the same even seq before
+and after copying. The I/O counters and watch_until are atomics of their own.
+*/
+#ifndef VM_METRICS_H
+#define VM_METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define METRICS_MAGIC 0x706d3076u  // "v0mp"
+#define METRICS_VERSION 1
+#define METRICS_PREFIX "pm0vm."    // shm_open name is "/" METRICS_PREFIX "<pid>"
+#define METRICS_SLICE (1 << 14)    // instructions between two snapshots while watched
+#define METRICS_WATCH_SECONDS 5.0  // how far ahead a reader moves watch_until
+
+enum metrics_state {
+    METRICS_IDLE = 0,    // loaded, not running a program (a --serve worker between requests)
+    METRICS_RUNNING = 1,
+    METRICS_HALTED = 2,  // SYS 0 3 reached
+    METRICS_ERROR = 3,   // runtime error
+    METRICS_LIMITED = 4  // stopped by --max-instructions or --timeout
+};
+
+typedef struct vm_metrics {
+    uint32_t magic, version;
+    int32_t pid;
+    char program[64];           // elf.txt path, or the socket for --serve
+    double started;             // CLOCK_REALTIME seconds
+
+    atomic_uint seq;            // odd while the fields below are written
+    int32_t state;              // enum metrics_state
+    int64_t instructions;       // executed since the VM started
+    int64_t calls;              // CAL executed since the VM started
+    int32_t depth, max_depth;   // activation records below main's
+    int32_t stack_words, max_stack_words; // words between SP and the code
+    int32_t pc;                 // PM/0 address of the last checkpoint
+    char procedure[16];         // its procedure (with --debug), else ""
+    int64_t samples;            // snapshots written
+    double updated;             // CLOCK_REALTIME of the last snapshot
+
+    atomic_llong io_reads, io_writes; // SYS 0 2 / SYS 0 1, always counted
+    _Atomic double watch_until; // set by readers; the VM publishes while it is ahead of now
+} vm_metrics;
+
+static void metrics_segment_name(char *dest, size_t size, int pid) {
+    snprintf(dest, size, "/" METRICS_PREFIX "%d", pid);
+}
+
+#endif
@@ -0,0 +1,238 @@
+/*
+Live metrics viewer for running PM/0 VMs
+
+Attaches to the shared-memory segment a running vm publishes (see
+vm_metrics.h) and prints its progress from outside the process, without
+tracing it. While vmstat is attached the VM writes a
+snapshot about ten times a second; once it detaches the VM goes back to
+its unobserved speed.
+
+Language: C (only)
+
+To Compile:
+    gcc -O2 -std=c11 -o vmstat vmstat.c -lrt
+
+To Execute:
+    ./vmstat                                 list the running VMs
+    ./vmstat [--interval s] [--count N] pid  watch one of them
+where:
+    --interval  seconds between two lines (default 1)
+    --count     lines to print before exiting (default: until the VM exits)
+    pid         process id of a vm, or of a vm --serve worker
+Notes:
+    - each line shows instructions, calls and SYS reads/writes per second
+      over the interval, then the call depth and the stack words in use
+      (current/maximum) and the PC and procedure of the last checkpoint;
+      the procedure name needs vm --debug
+    - segments left behind by a VM that was killed with SIGKILL are
+      removed when the list is printed
+*/
+
+#define _GNU_SOURCE // kill and nanosleep under -std=c11
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "vm_metrics.h"
+
+#define HEADER_EVERY 20 // lines between two column headers
+
+// a consistent copy of the seqlock-protected fields
+typedef struct sample {
+    int state;
+    long long instructions, calls, io_reads, io_writes, samples;
+    int depth, max_depth, stack_words, max_stack_words, pc;
+    char procedure[16];
+    double updated;
+} sample;
+
+const char *state_names[] = {"idle", "running", "halted", "error", "limited"};
+
+
+double wall_seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int process_alive(int pid)
+{
+    return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+// maps the segment of pid; NULL if there is none or it is not a VM's
+vm_metrics *attach(int pid)
+{
+    char name[64];
+    metrics_segment_name(name, sizeof name, pid);
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) return NULL;
+    void *segment = mmap(NULL, sizeof(vm_metrics), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED) return NULL;
+    vm_metrics *m = segment;
+    if (m->magic != METRICS_MAGIC || m->version != METRICS_VERSION)
+    {
+        munmap(segment, sizeof(vm_metrics));
+        return NULL;
+    }
+    return m;
+}
+
+// copies the snapshot, retrying while the VM is in the middle of writing it
+void read_sample(vm_metrics *m, sample *s)
+{
+    unsigned before, after;
+    do {
+        before = atomic_load_explicit(&m->seq, memory_order_acquire);
+        if (before & 1) continue;
+        s->state = m->state;
+        s->instructions = m->instructions;
+        s->calls = m->calls;
+        s->samples = m->samples;
+        s->depth = m->depth;
+        s->max_depth = m->max_depth;
+        s->stack_words = m->stack_words;
+        s->max_stack_words = m->max_stack_words;
+        s->pc = m->pc;
+        memcpy(s->procedure, m->procedure, sizeof s->procedure);
+        s->procedure[sizeof s->procedure - 1] = '\0';
+        s->updated = m->updated;
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&m->seq, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+    s->io_reads = atomic_load(&m->io_reads);
+    s->io_writes = atomic_load(&m->io_writes);
+}
+
+const char *state_name(int state)
+{
+    return state >= 0 && state <= METRICS_LIMITED ? state_names[state] : "?";
+}
+
+// vmstat with no pid: one line per running VM
+int list_vms(void)
+{
+    DIR *dir = opendir("/dev/shm");
+    if (!dir)
+    {
+        perror("/dev/shm");
+        return 1;
+    }
+    int found = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        size_t prefix = strlen(METRICS_PREFIX);
+        if (strncmp(entry->d_name, METRICS_PREFIX, prefix) != 0) continue;
+        int pid = atoi(entry->d_name + prefix);
+        if (pid <= 0) continue;
+        if (!process_alive(pid))
+        {
+            char name[64];
+            metrics_segment_name(name, sizeof name, pid);
+            shm_unlink(name);
+            fprintf(stderr, "removed the segment of exited VM %d\n", pid);
+            continue;
+        }
+        vm_metrics *m = attach(pid);
+        if (!m) continue;
+        sample s;
+        read_sample(m, &s);
+        if (found++ == 0) printf("%8s %-8s %14s %10s  %s\n", "pid", "state", "instructions", "uptime", "program");
+        printf("%8d %-8s %14lld %9.1fs  %s\n", pid, state_name(s.state), s.instructions,
+               wall_seconds() - m->started, m->program);
+        munmap(m, sizeof(vm_metrics));
+    }
+    closedir(dir);
+    if (!found) printf("no running VMs\n");
+    return 0;
+}
+
+// per second rate of a counter between two samples
+double rate(long long now, long long before, double seconds)
+{
+    return seconds > 0 ? (now - before) / seconds : 0;
+}
+
+// vmstat pid: keeps the VM publishing and prints a line per interval
+int watch(int pid, double interval, long count)
+{
+    vm_metrics *m = attach(pid);
+    if (!m)
+    {
+        fprintf(stderr, "ERROR: no VM metrics for pid %d (not a vm, or run with --no-metrics)\n", pid);
+        return 1;
+    }
+    double lead = interval * 2 > METRICS_WATCH_SECONDS ? interval * 2 : METRICS_WATCH_SECONDS;
+    atomic_store(&m->watch_until, wall_seconds() + lead);
+    printf("vm %d: %s\n", pid, m->program);
+
+    sample last, now;
+    read_sample(m, &last);
+    double last_time = wall_seconds();
+    for (long line = 0; count <= 0 || line < count; line++)
+    {
+        struct timespec pause = {(time_t)interval, (long)((interval - (time_t)interval) * 1e9)};
+        nanosleep(&pause, NULL);
+        atomic_store(&m->watch_until, wall_seconds() + lead);
+        read_sample(m, &now);
+
+        // rates over the time between the two snapshots; a VM that is idle
+        // or finished has not moved, so the wall clock is used instead
+        double seconds = now.updated - last.updated;
+        if (now.samples == last.samples || now.state != METRICS_RUNNING) seconds = wall_seconds() - last_time;
+        if (line % HEADER_EVERY == 0)
+        {
+            printf("%-8s %14s %12s %10s %10s %11s %11s %6s  %s\n", "state", "instr/s", "calls/s", "reads/s",
+                   "writes/s", "depth/max", "stack/max", "pc", "procedure");
+        }
+        char depth[24], stack[24];
+        snprintf(depth, sizeof depth, "%d/%d", now.depth, now.max_depth);
+        snprintf(stack, sizeof stack, "%d/%d", now.stack_words, now.max_stack_words);
+        printf("%-8s %14.0f %12.0f %10.0f %10.0f %11s %11s %6d  %s\n", state_name(now.state),
+               rate(now.instructions, last.instructions, seconds), rate(now.calls, last.calls, seconds),
+               rate(now.io_reads, last.io_reads, seconds), rate(now.io_writes, last.io_writes, seconds),
+               depth, stack, now.pc, now.procedure);
+        fflush(stdout);
+        last = now;
+        last_time = wall_seconds();
+
+        if (!process_alive(pid) || now.state == METRICS_HALTED || now.state == METRICS_ERROR
+            || now.state == METRICS_LIMITED)
+        {
+            printf("vm %d %s after %lld instructions\n", pid,
+                   process_alive(pid) ? state_name(now.state) : "exited", now.instructions);
+            break;
+        }
+    }
+    munmap(m, sizeof(vm_metrics));
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    double interval = 1;
+    long count = 0;
+    int pid = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) interval = atof(argv[++i]);
+        else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) count = atol(argv[++i]);
+        else if (argv[i][0] != '-' && pid == 0 && atoi(argv[i]) > 0) pid = atoi(argv[i]);
+        else
+        {
+            fprintf(stderr, "Usage: %s [--interval s] [--count N] [pid]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (interval < 0.01) interval = 0.01;
+    return pid ? watch(pid, interval, count) : list_vms();
+}